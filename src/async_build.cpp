@@ -0,0 +1,174 @@
+
+//
+// Background program builds: time to the first result with and without waiting for the compiler
+//
+// A typical application knows (e.g. from blas1_tuning) which configuration of vec_dot is the fastest, but building
+// it together with a few alternatives costs noticeable time at startup. Two strategies are compared:
+//  - synchronous:  build all configurations, then compute
+//  - background:   start all builds on worker threads, compute with the generic defaults right away and
+//                  switch to the tuned (and JIT-specialized) configuration once its build has finished
+//
+// Usage: async_build [size]
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-program-cache.hpp"
+#include "ocl-tuner.hpp"
+#include "ocl-blas1-tuned.hpp"
+#include "benchmark-utils.hpp"
+
+
+// Configurations an application might keep around: the tuned one first, alternatives for other sizes after it
+std::vector<ocl::parameter_set> candidate_configurations()
+{
+  std::vector<ocl::parameter_set> result;
+  int wg[3]     = { 256, 128, 64 };
+  int unroll[2] = { 4, 1 };
+  for (int i=0; i<3; ++i)
+    for (int j=0; j<2; ++j)
+    {
+      ocl::parameter_set p = ocl::blas1_tuned_kernels::defaults();
+      p.set("WG", wg[i]); p.set("GROUPS", 512); p.set("UNROLL", unroll[j]); p.set("VW", 4);
+      result.push_back(p);
+    }
+  return result;
+}
+
+
+int main(int argc, char **argv)
+{
+  cl_uint N = (argc > 1) ? cl_uint(std::atof(argv[1])) : 4*1024*1024;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create memory buffers ///////////////////////////////////
+  //
+  std::vector<ScalarType> x(N), y(N);
+  double reference = 0;
+  for (cl_uint i=0; i<N; ++i)
+  {
+    x[i] = ScalarType((i * 7919) % 1000) / 1000;
+    y[i] = ScalarType((i * 104729) % 997) / 997;
+    reference += double(x[i]) * double(y[i]);
+  }
+  cl_mem ocl_x      = ctx.create_buffer(N * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_y      = ctx.create_buffer(N * sizeof(ScalarType), &(y[0]));
+  cl_mem ocl_result = ctx.create_buffer(sizeof(ScalarType));
+
+  bool all_ok = true;
+  auto check = [&]() {
+    ScalarType value;
+    cl_int status = clEnqueueReadBuffer(ctx.queue(), ocl_result, CL_TRUE, 0, sizeof(ScalarType), &value, 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+    all_ok &= (std::fabs(value - reference) < 1e-2 * std::fabs(reference));
+  };
+
+  //
+  /////////////////////////// Part 3: Synchronous: build everything, then compute ///////////////////////////////////
+  //
+  double sync_first_result = 0;
+  {
+    Timer timer;
+    ocl::program_cache cache(ctx);
+    ocl::blas1_tuned_kernels kernels(cache);
+    std::vector<ocl::parameter_set> configurations = candidate_configurations();
+    ocl::parameter_set tuned = kernels.valid(configurations[0]) ? configurations[0] : ocl::blas1_tuned_kernels::defaults();
+    for (std::size_t i=0; i<configurations.size(); ++i)
+      if (kernels.valid(configurations[i]))
+        cache.get(ocl::blas1_tuned_program_source, kernels.build_options(configurations[i]));
+    kernels.specialize(true);
+    kernels.dot(ocl_x, ocl_y, ocl_result, 0, N, tuned);
+    check();
+    sync_first_result = timer.get();
+    std::cout << "# Synchronous: " << cache.builds() << " programs built, first result after " << sync_first_result << " s" << std::endl;
+  }
+
+  //
+  /////////////////////////// Part 4: Background builds with the generic defaults as fallback ///////////////////////////////////
+  //
+  double async_first_result = 0, async_tuned = 0;
+  std::size_t calls = 0, fallback_calls = 0;
+  {
+    Timer timer;
+    ocl::program_cache cache(ctx);
+    ocl::blas1_tuned_kernels kernels(cache);
+    std::vector<ocl::parameter_set> configurations = candidate_configurations();
+    kernels.specialize(true);
+    ocl::parameter_set tuned = kernels.valid(configurations[0]) ? configurations[0] : ocl::blas1_tuned_kernels::defaults();
+    kernels.prefer(tuned);
+    kernels.prepare(configurations);
+
+    // keep computing until the specialized tuned configuration takes over, or its build has failed:
+    ocl::parameter_set target = ocl::blas1_tuned_kernels::specialized(tuned, N);
+    bool tuned_ready = false;
+    while (true)
+    {
+      tuned_ready = kernels.ready(target);
+      kernels.dot(ocl_x, ocl_y, ocl_result, 0, N);
+      check();
+      ++calls;
+      if (calls == 1)
+        async_first_result = timer.get();
+      if (tuned_ready)
+        break;
+      ++fallback_calls;
+      if (kernels.failed(target) || (cache.pending() == 0 && !kernels.ready(target)))   // the dot() above has started the build
+        break;
+    }
+    async_tuned = timer.get();
+    if (tuned_ready)
+      std::cout << "# Background:  first result after " << async_first_result << " s, tuned configuration after "
+                << async_tuned << " s (" << fallback_calls << " of " << calls << " calls with the fallback)" << std::endl;
+    else
+      std::cout << "# Background:  first result after " << async_first_result << " s, build of the tuned configuration failed, "
+                << "stopped after " << calls << " calls with the fallback" << std::endl;
+    std::cout << "#              " << cache.pending() << " builds still pending" << std::endl;
+  }
+
+  //
+  /////////////////////////// Part 5: Report ///////////////////////////////////
+  //
+  std::cout << std::endl;
+  std::cout << "Time to first result: " << sync_first_result << " s (synchronous) vs. " << async_first_result << " s (background)" << std::endl;
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(ocl_x);
+  clReleaseMemObject(ocl_y);
+  clReleaseMemObject(ocl_result);
+
+  if (!all_ok)
+  {
+    std::cout << "# Results do NOT match the host reference!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Background build study finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
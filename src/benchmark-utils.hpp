@@ -0,0 +1,207 @@
+#ifndef BENCHMARK_UTILS_HPP_
+#define BENCHMARK_UTILS_HPP_
+
+
+/** @file benchmark-utils.hpp
+    @brief Wall-clock timer (modelled after the one in ViennaCL) and the benchmark harness used for all reported timings
+
+    benchmark() runs an operation a few times for warmup (lazy JIT compilation, page faults, caches), then repeats it until
+    both a minimum number of runs and a minimum total time are reached. It reports the median with a 95% confidence interval
+    and percentiles, and flags noisy runs as well as drift or CPU frequency changes during the measurement.
+    The defaults can be overridden for all executables through the environment:
+      OCL_BENCHMARK_WARMUP, OCL_BENCHMARK_MIN_RUNS, OCL_BENCHMARK_MAX_RUNS, OCL_BENCHMARK_MIN_TIME (seconds)
+*/
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <numeric>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <type_traits>
+#include <cmath>
+#include <cstdlib>
+
+  /** @brief Wall-clock timer. Call start(), then get() returns the elapsed time in seconds. */
+  class Timer
+  {
+  public:
+    Timer() : start_(clock_type::now()) {}
+
+    void start() { start_ = clock_type::now(); }
+
+    double get() const
+    {
+      return std::chrono::duration<double>(clock_type::now() - start_).count();
+    }
+
+  private:
+    typedef std::chrono::steady_clock  clock_type;
+
+    clock_type::time_point start_;
+  };
+
+
+  /** @brief How often benchmark() runs an operation. The constructor applies the OCL_BENCHMARK_* environment variables. */
+  struct BenchmarkSettings
+  {
+    BenchmarkSettings() : warmup_runs(2), min_runs(10), max_runs(1000), min_time(0.1), noise_threshold(0.05)
+    {
+      if (const char * env = std::getenv("OCL_BENCHMARK_WARMUP"))   warmup_runs = std::size_t(std::atoi(env));
+      if (const char * env = std::getenv("OCL_BENCHMARK_MIN_RUNS")) min_runs    = std::size_t(std::atoi(env));
+      if (const char * env = std::getenv("OCL_BENCHMARK_MAX_RUNS")) max_runs    = std::size_t(std::atoi(env));
+      if (const char * env = std::getenv("OCL_BENCHMARK_MIN_TIME")) min_time    = std::atof(env);
+      min_runs = std::max<std::size_t>(min_runs, 1);
+      max_runs = std::max(max_runs, min_runs);
+    }
+
+    std::size_t warmup_runs;       // runs discarded before measuring
+    std::size_t min_runs;          // measured runs, at least
+    std::size_t max_runs;          // measured runs, at most (bounds min_time for very short operations)
+    double      min_time;          // seconds of measured runs, at least
+    double      noise_threshold;   // relative width of the confidence interval (and relative drift) considered noisy
+  };
+
+
+  /** @brief Statistics of the measured runs of benchmark(). All times in seconds. */
+  struct BenchmarkResult
+  {
+    BenchmarkResult() : runs(0), min(0), median(0), mean(0), stddev(0), p10(0), p90(0), ci_low(0), ci_high(0),
+                        noisy(false), drift(false), frequency_before(0), frequency_after(0) {}
+
+    std::size_t runs;
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double p10;
+    double p90;
+    double ci_low;             // 95% confidence interval of the median (order statistics, no distribution assumed)
+    double ci_high;
+    bool   noisy;              // confidence interval wider than noise_threshold relative to the median
+    bool   drift;              // first and last third of the runs differ by more than noise_threshold (throttling, turbo, other load)
+    double frequency_before;   // kHz of CPU 0 from cpufreq, 0 if not available
+    double frequency_after;
+
+    /** @brief True if the CPU clock changed by more than 10% during the measurement (frequency scaling) */
+    bool frequency_changed() const
+    {
+      return frequency_before > 0 && frequency_after > 0 && std::fabs(frequency_after - frequency_before) > 0.1 * frequency_before;
+    }
+
+    /** @brief Prints e.g. 'median 12.1 us [11.9, 12.4], p10 11.8 us, p90 13.0 us, 25 runs' followed by any warnings */
+    void print(std::ostream & os) const
+    {
+      os << "median " << median * 1e6 << " us [" << ci_low * 1e6 << ", " << ci_high * 1e6 << "], p10 " << p10 * 1e6
+         << " us, p90 " << p90 * 1e6 << " us, " << runs << " runs";
+      if (noisy)               os << " (NOISY)";
+      if (drift)               os << " (DRIFT)";
+      if (frequency_changed()) os << " (CPU FREQUENCY CHANGED)";
+    }
+  };
+
+
+  namespace benchmark_detail
+  {
+    inline double cpu_frequency()
+    {
+      std::ifstream file("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq");
+      double khz = 0;
+      if (!(file >> khz))
+        return 0;
+      return khz;
+    }
+
+    /** @brief Linearly interpolated percentile (0 <= p <= 1) of sorted values */
+    inline double percentile(std::vector<double> const & sorted, double p)
+    {
+      double pos  = p * double(sorted.size() - 1);
+      std::size_t lower = std::size_t(pos);
+      std::size_t upper = std::min(lower + 1, sorted.size() - 1);
+      return sorted[lower] + (pos - double(lower)) * (sorted[upper] - sorted[lower]);
+    }
+
+    inline double median(std::vector<double> values)
+    {
+      std::sort(values.begin(), values.end());
+      return percentile(values, 0.5);
+    }
+
+    /** @brief Statistics of the measured times, given in the order they were taken */
+    inline BenchmarkResult evaluate(std::vector<double> const & times, BenchmarkSettings const & settings)
+    {
+      BenchmarkResult result;
+      std::vector<double> sorted(times);
+      std::sort(sorted.begin(), sorted.end());
+      std::size_t n = sorted.size();
+
+      result.runs   = n;
+      result.min    = sorted[0];
+      result.median = percentile(sorted, 0.5);
+      result.p10    = percentile(sorted, 0.1);
+      result.p90    = percentile(sorted, 0.9);
+      result.mean   = std::accumulate(sorted.begin(), sorted.end(), 0.0) / double(n);
+      double variance = 0;
+      for (std::size_t i=0; i<n; ++i)
+        variance += (sorted[i] - result.mean) * (sorted[i] - result.mean);
+      result.stddev = (n > 1) ? std::sqrt(variance / double(n - 1)) : 0;
+
+      // ranks n/2 -+ 1.96 sqrt(n)/2 bound the median with 95% confidence:
+      double half_width = 1.96 * std::sqrt(double(n)) / 2;
+      double lower_rank = std::floor(double(n) / 2 - half_width);
+      double upper_rank = std::ceil (double(n) / 2 + half_width);
+      result.ci_low  = sorted[std::size_t(std::max(lower_rank, 0.0))];
+      result.ci_high = sorted[std::min(std::size_t(upper_rank), n - 1)];
+      result.noisy   = (result.ci_high - result.ci_low) > settings.noise_threshold * result.median;
+
+      if (n >= 9)
+      {
+        std::vector<double> first(times.begin(), times.begin() + n / 3);
+        std::vector<double> last(times.end() - n / 3, times.end());
+        double first_median = median(first);
+        result.drift = std::fabs(median(last) - first_median) > settings.noise_threshold * first_median;
+      }
+      return result;
+    }
+  } //namespace benchmark_detail
+
+
+  /** @brief Runs 'op' for warmup, then repeatedly until settings.min_runs and settings.min_time are reached.
+  *
+  *  If 'op' returns a double, it is taken as the time of the run in seconds (e.g. from OpenCL profiling events).
+  *  Otherwise each call is timed with the wall clock, so 'op' has to wait for its commands to complete (clFinish).
+  */
+  template <typename OpT>
+  BenchmarkResult benchmark(OpT op, BenchmarkSettings const & settings = BenchmarkSettings())
+  {
+    for (std::size_t run=0; run<settings.warmup_runs; ++run)
+      op();
+
+    double frequency_before = benchmark_detail::cpu_frequency();
+    std::vector<double> times;
+    double total = 0;
+    while (times.size() < settings.max_runs && (times.size() < settings.min_runs || total < settings.min_time))
+    {
+      double time;
+      if constexpr (std::is_same<decltype(op()), double>::value)
+        time = op();
+      else
+      {
+        Timer timer;
+        op();
+        time = timer.get();
+      }
+      times.push_back(time);
+      total += time;
+    }
+
+    BenchmarkResult result = benchmark_detail::evaluate(times, settings);
+    result.frequency_before = frequency_before;
+    result.frequency_after  = benchmark_detail::cpu_frequency();
+    return result;
+  }
+
+
+#endif
@@ -0,0 +1,262 @@
+
+//
+// Parameter study for vec_add and vec_dot: launch configuration, work distribution, reduction, loop unrolling, vector width and floating-point build profiles
+//
+// For every configuration the throughput of vec_dot is reported together with the relative error against a
+// double-precision host reference, so that the effect of -cl-mad-enable, -cl-fast-relaxed-math, ... on speed and
+// accuracy can be compared per device. The launch configurations are swept with the strict build profile, the other
+// build profiles only for the fastest few of them. The best configurations are then compared to their JIT-specialized versions.
+//
+// Usage: blas1_tuning [size]
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-program-cache.hpp"
+#include "ocl-tuner.hpp"
+#include "ocl-blas1-tuned.hpp"
+#include "benchmark-utils.hpp"
+
+
+struct dot_result
+{
+  double gbs;
+  double relative_error;
+};
+
+
+int main(int argc, char **argv)
+{
+  cl_int err;
+  cl_uint N = (argc > 1) ? cl_uint(std::atof(argv[1])) : 4*1024*1024;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Programs are built on demand for each configuration ///////////////////////////////////
+  //
+  ocl::program_cache cache(ctx);
+  ocl::blas1_tuned_kernels kernels(cache);
+
+  //
+  /////////////////////////// Part 3: Create memory buffers ///////////////////////////////////
+  //
+  std::vector<ScalarType> x(N), y(N);
+  double reference = 0;
+  for (cl_uint i=0; i<N; ++i)
+  {
+    x[i] = ScalarType((i * 7919) % 1000) / 1000;
+    y[i] = ScalarType((i * 104729) % 997) / 997;
+    reference += double(x[i]) * double(y[i]);
+  }
+  cl_mem ocl_x      = ctx.create_buffer(N * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_y      = ctx.create_buffer(N * sizeof(ScalarType), &(y[0]));
+  cl_mem ocl_z      = ctx.create_buffer(N * sizeof(ScalarType), &(x[0]));   // target of vec_add, keeps x unchanged
+  cl_mem ocl_result = ctx.create_buffer(sizeof(ScalarType));
+
+  // one sweep has up to 288 configurations (each a program build), so fewer runs per configuration than usual:
+  BenchmarkSettings settings;
+  settings.min_runs = std::min<std::size_t>(settings.min_runs, 5);
+  settings.min_time = 0;
+
+  //
+  /////////////////////////// Part 4: Parameter sweeps ///////////////////////////////////
+  //
+  std::cout << std::endl << "# vec_dot, N = " << N << " (GB/s, relative error):" << std::endl;
+  std::map<ocl::parameter_set, dot_result> dot_results;
+  auto measure_dot = [&](ocl::parameter_set const & p) {
+      if (!kernels.valid(p)) return -1.0;
+      double time = benchmark([&]() { kernels.dot(ocl_x, ocl_y, ocl_result, 0, N, p); clFinish(ctx.queue()); }, settings).median;
+
+      ScalarType value;
+      cl_int status = clEnqueueReadBuffer(ctx.queue(), ocl_result, CL_TRUE, 0, sizeof(ScalarType), &value, 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+      dot_result r;
+      r.gbs            = 2.0 * sizeof(ScalarType) * N / time * 1e-9;
+      r.relative_error = std::fabs(value - reference) / std::fabs(reference);
+      dot_results[p] = r;
+      std::cout << "#   " << std::left << std::setw(64) << p.to_string() << std::right
+                << std::setw(10) << r.gbs << std::setw(14) << r.relative_error << std::endl;
+      return time;
+    };
+  ocl::tuning_result dot = ocl::tune(kernels.space(), measure_dot);
+
+  // build profiles for the fastest launch configurations only:
+  std::size_t num_profiled = 4;
+  std::vector<std::pair<double, ocl::parameter_set> > fastest;
+  for (std::map<ocl::parameter_set, dot_result>::const_iterator it = dot_results.begin(); it != dot_results.end(); ++it)
+    fastest.push_back(std::make_pair(-it->second.gbs, it->first));
+  std::sort(fastest.begin(), fastest.end());
+  for (std::size_t i=0; i<std::min(num_profiled, fastest.size()); ++i)
+  {
+    std::vector<ocl::parameter_set> variants = ocl::blas1_tuned_kernels::build_profile_variants(fastest[i].second);
+    for (std::size_t j=0; j<variants.size(); ++j)
+    {
+      double time = -1;
+      try { time = measure_dot(variants[j]); }
+      catch (std::exception const &) { continue; }   // as in ocl::tune(): e.g. build failure
+      if (time < 0)
+        continue;
+      ++dot.tested;
+      if (time < dot.best_time)
+      {
+        dot.best_time = time;
+        dot.best      = variants[j];
+      }
+    }
+  }
+
+  std::cout << std::endl << "# vec_add, N = " << N << ":" << std::endl;
+  std::map<ocl::parameter_set, double> add_results;
+  ocl::tuning_result add = ocl::tune(kernels.space(false), [&](ocl::parameter_set const & p) {
+      if (!kernels.valid(p)) return -1.0;
+      double time = benchmark([&]() { kernels.add(ocl_z, ocl_y, N, p); clFinish(ctx.queue()); }, settings).median;
+      add_results[p] = 3.0 * sizeof(ScalarType) * N / time * 1e-9;
+      return time;
+    }, true);
+
+  //
+  /////////////////////////// Part 5: Report ///////////////////////////////////
+  //
+  if (dot.tested == 0 || add.tested == 0)
+  {
+    std::cout << "# No valid configuration found!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // best vec_dot configuration per build profile:
+  std::cout << std::endl << "# Best vec_dot per build profile (other than strict only for the " << num_profiled << " fastest launch configurations):" << std::endl;
+  std::vector<std::string> profiles = ocl::build_profiles();
+  bool all_ok = true;
+  for (std::size_t i=0; i<profiles.size(); ++i)
+  {
+    ocl::parameter_set const * best = NULL;
+    for (std::map<ocl::parameter_set, dot_result>::const_iterator it = dot_results.begin(); it != dot_results.end(); ++it)
+      if (it->first.str("BUILD_PROFILE") == profiles[i] && (!best || it->second.gbs > dot_results[*best].gbs))
+        best = &(it->first);
+    if (!best)
+      continue;
+    dot_result const & r = dot_results[*best];
+    std::cout << std::left << std::setw(18) << profiles[i] << std::right << std::setw(10) << r.gbs << " GB/s, relative error "
+              << r.relative_error << "  (" << best->to_string() << ")" << std::endl;
+    all_ok &= (r.relative_error < 1e-2);
+  }
+
+  ocl::parameter_set defaults = ocl::blas1_tuned_kernels::defaults();
+  if (dot_results.count(defaults))
+    std::cout << std::left << std::setw(18) << "tutorial defaults" << std::right << std::setw(10) << dot_results[defaults].gbs
+              << " GB/s, relative error " << dot_results[defaults].relative_error << std::endl;
+
+  // best configuration per work distribution (grid-stride suits GPUs, contiguous blocks per work group CPUs)
+  // and per reduction within a work group (local memory tree vs. sub-group builtins):
+  auto report_best = [&](std::string const & name, const char * labels[2], bool with_add) {
+    for (int v=0; v<2; ++v)
+    {
+      double best_dot = 0, best_add = 0;
+      for (std::map<ocl::parameter_set, dot_result>::const_iterator it = dot_results.begin(); it != dot_results.end(); ++it)
+        if (it->first.value(name) == v)
+          best_dot = std::max(best_dot, it->second.gbs);
+      for (std::map<ocl::parameter_set, double>::const_iterator it = add_results.begin(); it != add_results.end(); ++it)
+        if (it->first.value(name) == v)
+          best_add = std::max(best_add, it->second);
+      std::cout << std::left << std::setw(18) << labels[v] << std::right << "vec_dot " << std::setw(10) << best_dot;
+      if (with_add)
+        std::cout << "   vec_add " << std::setw(10) << best_add;
+      std::cout << std::endl;
+    }
+  };
+  const char * layouts[2]    = { "grid-stride", "blocked" };
+  const char * reductions[2] = { "local memory", "sub-groups" };
+  std::cout << std::endl << "# Best per work distribution (GB/s):" << std::endl;
+  report_best("BLOCKED", layouts, true);
+  std::cout << std::endl << "# Best per work group reduction (GB/s, 0 if sub-groups are not supported):" << std::endl;
+  report_best("SUBGROUPS", reductions, false);
+
+  std::cout << std::endl;
+  std::cout << "vec_dot: " << dot.best.to_string() << ", " << 2.0 * sizeof(ScalarType) * N / dot.best_time * 1e-9 << " GB/s"
+            << " (" << dot.tested << " configurations)" << std::endl;
+  std::cout << "vec_add: " << add.best.to_string() << ", " << 3.0 * sizeof(ScalarType) * N / add.best_time * 1e-9 << " GB/s"
+            << " (" << add.tested << " configurations)" << std::endl;
+
+  //
+  /////////////////////////// Part 6: JIT specialization of the best configurations ///////////////////////////////////
+  //
+  // N and the launch configuration as compile-time constants. For a multiple of the work per loop iteration
+  // all bounds checks vanish (EXACT), for N - 1 only the remainder loops remain.
+  std::cout << std::endl << "# JIT specialization (GB/s, generic vs. specialized):" << std::endl;
+  cl_uint sizes[2] = { N, N - 1 };
+  for (int s=0; s<2; ++s)
+  {
+    cl_uint n = sizes[s];
+    ocl::parameter_set dot_spec = ocl::blas1_tuned_kernels::specialized(dot.best, n);
+    ocl::parameter_set add_spec = ocl::blas1_tuned_kernels::specialized(add.best, n);
+
+    double dot_generic     = benchmark([&]() { kernels.dot(ocl_x, ocl_y, ocl_result, 0, n, dot.best); clFinish(ctx.queue()); }).median;
+    double dot_specialized = benchmark([&]() { kernels.dot(ocl_x, ocl_y, ocl_result, 0, n, dot_spec); clFinish(ctx.queue()); }).median;
+    ScalarType value;
+    err = clEnqueueReadBuffer(ctx.queue(), ocl_result, CL_TRUE, 0, sizeof(ScalarType), &value, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+    double expected = reference - ((s == 1) ? double(x[N - 1]) * double(y[N - 1]) : 0.0);
+    all_ok &= (std::fabs(value - expected) < 1e-2 * std::fabs(expected));
+
+    double add_generic     = benchmark([&]() { kernels.add(ocl_z, ocl_y, n, add.best); clFinish(ctx.queue()); }).median;
+    double add_specialized = benchmark([&]() { kernels.add(ocl_z, ocl_y, n, add_spec); clFinish(ctx.queue()); }).median;
+
+    std::cout << "N = " << n << (add_spec.value("EXACT") ? " (exact)" : "") << ":" << std::endl;
+    std::cout << "  vec_dot: " << 2.0 * sizeof(ScalarType) * n / dot_generic * 1e-9 << " vs. "
+              << 2.0 * sizeof(ScalarType) * n / dot_specialized * 1e-9 << std::endl;
+    std::cout << "  vec_add: " << 3.0 * sizeof(ScalarType) * n / add_generic * 1e-9 << " vs. "
+              << 3.0 * sizeof(ScalarType) * n / add_specialized * 1e-9 << std::endl;
+  }
+  std::cout << "Programs built: " << cache.builds() << std::endl;
+
+  // check vec_add of the best configuration, specialized:
+  err = clEnqueueWriteBuffer(ctx.queue(), ocl_z, CL_TRUE, 0, N * sizeof(ScalarType), &(x[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  kernels.add(ocl_z, ocl_y, N, ocl::blas1_tuned_kernels::specialized(add.best, N));
+  std::vector<ScalarType> z(N);
+  err = clEnqueueReadBuffer(ctx.queue(), ocl_z, CL_TRUE, 0, N * sizeof(ScalarType), &(z[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  for (cl_uint i=0; i<N; ++i)
+    all_ok &= (z[i] == x[i] + y[i]);
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(ocl_x);
+  clReleaseMemObject(ocl_y);
+  clReleaseMemObject(ocl_z);
+  clReleaseMemObject(ocl_result);
+
+  if (!all_ok)
+  {
+    std::cout << "# Results do NOT match the host reference!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# vec_add/vec_dot parameter study finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
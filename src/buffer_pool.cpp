@@ -0,0 +1,156 @@
+
+//
+// Benchmark for the device buffer pool: a solver-like loop allocates its temporaries in every iteration
+//
+// Each iteration allocates two work vectors and a scalar, runs vec_add and vec_dot on them and releases them again.
+// Compares plain clCreateBuffer/clReleaseMemObject with the size-class pool and the pool carving small buffers out of arenas.
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-scan.hpp"
+#include "ocl-buffer-pool.hpp"
+#include "benchmark-utils.hpp"
+
+
+// One iteration: temporaries from the pool if given, from clCreateBuffer otherwise
+void iteration(ocl::context const & ctx, ocl::blas1_kernels & blas1, ocl::buffer_pool * pool, cl_mem x, cl_uint N)
+{
+  size_t num_bytes = N * sizeof(ScalarType);
+  cl_mem p     = pool ? pool->allocate(num_bytes)          : ctx.create_buffer(num_bytes);
+  cl_mem q     = pool ? pool->allocate(num_bytes)          : ctx.create_buffer(num_bytes);
+  cl_mem alpha = pool ? pool->allocate(sizeof(ScalarType)) : ctx.create_buffer(sizeof(ScalarType));
+
+  cl_int err;
+  err = clEnqueueCopyBuffer(ctx.queue(), x, p, 0, 0, num_bytes, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  err = clEnqueueCopyBuffer(ctx.queue(), x, q, 0, 0, num_bytes, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  blas1.add(p, q, N);
+  blas1.dot(p, q, alpha, 0, N);
+
+  if (pool)
+  {
+    pool->release(p);
+    pool->release(q);
+    pool->release(alpha);
+  }
+  else
+  {
+    clReleaseMemObject(p);
+    clReleaseMemObject(q);
+    clReleaseMemObject(alpha);
+  }
+}
+
+
+int main()
+{
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create a program and extract kernels ///////////////////////////////////
+  //
+  ocl::blas1_kernels blas1(ctx);
+  ocl::scan_kernels  scan(ctx);
+
+  std::size_t num_iterations = 200;
+
+  std::cout << std::endl;
+  std::cout << "#       N  clCreateBuffer [us/iter]  pool [us/iter]  pool+sub-buffers [us/iter]" << std::endl;
+
+  for (cl_uint vector_size = 1024; vector_size <= 1024*1024; vector_size *= 32)
+  {
+    //
+    /////////////////////////// Part 3: Create memory buffers ///////////////////////////////////
+    //
+    std::vector<ScalarType> x(vector_size, 1.0);
+    cl_mem ocl_x = ctx.create_buffer(vector_size * sizeof(ScalarType), &(x[0]));
+
+    ocl::buffer_pool pool(ctx);
+    ocl::buffer_pool sub_buffer_pool(ctx, 64*1024);
+    ocl::buffer_pool * pools[3] = { NULL, &pool, &sub_buffer_pool };
+    double times[3];
+
+    //
+    /////////////////////////// Part 4: Run the loop with each allocation strategy ///////////////////////////////////
+    //
+    for (int i=0; i<3; ++i)
+    {
+      iteration(ctx, blas1, pools[i], ocl_x, vector_size);   // warmup, fills the pools
+      clFinish(ctx.queue());
+
+      Timer timer;
+      for (std::size_t run=0; run<num_iterations; ++run)
+        iteration(ctx, blas1, pools[i], ocl_x, vector_size);
+      clFinish(ctx.queue());
+      times[i] = timer.get() / num_iterations;
+    }
+
+    //
+    /////////////////////////// Part 5: Report ///////////////////////////////////
+    //
+    std::cout << vector_size << "  " << times[0] * 1e6 << "  " << times[1] * 1e6 << "  " << times[2] * 1e6 << std::endl;
+    std::cout << "#   pool:             "; pool.statistics().print(std::cout);            std::cout << std::endl;
+    std::cout << "#   pool+sub-buffers: "; sub_buffer_pool.statistics().print(std::cout); std::cout << std::endl;
+
+    clReleaseMemObject(ocl_x);
+  }
+
+  //
+  // The scan allocates its block sums in every call, hence benefits from a pool as well:
+  //
+  cl_uint scan_size = 1024*1024;
+  std::vector<ScalarType> x(scan_size, 1.0);
+  cl_mem ocl_x = ctx.create_buffer(scan_size * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_y = ctx.create_buffer(scan_size * sizeof(ScalarType));
+
+  ocl::buffer_pool scan_pool(ctx, 64*1024);
+  for (int use_pool = 0; use_pool < 2; ++use_pool)
+  {
+    scan.use_pool(use_pool ? &scan_pool : NULL);
+    scan.inclusive(ocl_x, ocl_y, scan_size);
+    clFinish(ctx.queue());
+
+    Timer timer;
+    for (std::size_t run=0; run<num_iterations; ++run)
+      scan.inclusive(ocl_x, ocl_y, scan_size);
+    clFinish(ctx.queue());
+    std::cout << std::endl << "# Inclusive scan of " << scan_size << " entries " << (use_pool ? "with" : "without") << " pool: "
+              << timer.get() / num_iterations * 1e6 << " us" << std::endl;
+  }
+  scan.use_pool(NULL);
+  std::cout << "#   "; scan_pool.statistics().print(std::cout); std::cout << std::endl;
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(ocl_x);
+  clReleaseMemObject(ocl_y);
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Buffer pool benchmark finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
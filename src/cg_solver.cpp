@@ -0,0 +1,241 @@
+
+//
+// Conjugate gradient solver for the 2D Poisson problem running entirely on the OpenCL device
+//
+// All vectors and scalars stay in device memory. Only the residual norm is read back, asynchronously and only
+// every 'check_interval' iterations, so the host keeps enqueueing iterations while the device works.
+//
+// Usage: cg_solver [grid_size] [check_interval] [csr|sell]
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-spmv.hpp"
+#include "benchmark-utils.hpp"
+
+
+// Collects the profiling events of one kernel type and reports the accumulated device time and bandwidth
+struct kernel_statistics
+{
+  kernel_statistics(std::string const & n, double b) : name(n), bytes_per_launch(b) {}
+
+  std::string name;
+  double bytes_per_launch;
+  std::vector<cl_event> events;
+
+  cl_event * new_event() { events.push_back(cl_event()); return &(events.back()); }
+
+  void report(std::size_t iterations)
+  {
+    cl_int err;
+    double total_time = 0;
+    for (std::size_t i=0; i<events.size(); ++i)
+    {
+      cl_ulong start, end;
+      err = clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL); OPENCL_ERR_CHECK(err);
+      err = clGetEventProfilingInfo(events[i], CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &end,   NULL); OPENCL_ERR_CHECK(err);
+      total_time += (end - start) * 1e-9;
+      clReleaseEvent(events[i]);
+    }
+    std::size_t launches = events.size();
+    events.clear();
+    if (iterations == 0 || total_time <= 0)
+      return;
+    std::cout << name << " " << total_time / iterations * 1e6 << " us/iteration, "
+              << bytes_per_launch * launches / total_time * 1e-9 << " GB/s" << std::endl;
+  }
+};
+
+
+int main(int argc, char **argv)
+{
+  cl_int err;
+  cl_uint grid_size      = (argc > 1) ? cl_uint(std::atoi(argv[1])) : 512;
+  cl_uint check_interval = (argc > 2) ? cl_uint(std::atoi(argv[2])) : 10;
+  std::string format     = (argc > 3) ? argv[3] : "csr";
+  cl_uint max_iterations = 10000;
+  ScalarType tolerance   = 1e-6f;
+  if (check_interval == 0)
+    check_interval = 1;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx(CL_QUEUE_PROFILING_ENABLE);
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create a program and extract kernels ///////////////////////////////////
+  //
+  ocl::blas1_kernels blas1(ctx);
+  ocl::spmv_kernels  spmv(ctx);
+
+  //
+  /////////////////////////// Part 3: Create memory buffers ///////////////////////////////////
+  //
+  ocl::host_csr_matrix host_A = ocl::poisson_2d(grid_size);
+  cl_uint N = host_A.rows;
+  std::cout << "# Unknowns: " << N << ", nonzeros: " << host_A.values.size() << ", format: " << format << std::endl;
+
+  ocl::csr_matrix A(ctx, host_A);
+  ocl::sell_matrix A_sell;
+  if (format == "sell")
+    spmv.convert(A, A_sell);
+  else
+    spmv.prepare_adaptive(A);
+
+  std::vector<ScalarType> b(N, 1.0);
+  std::vector<ScalarType> x(N, 0.0);
+
+  cl_mem ocl_x  = ctx.create_buffer(N * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_r  = ctx.create_buffer(N * sizeof(ScalarType), &(b[0]));   // x = 0, hence r = b
+  cl_mem ocl_p  = ctx.create_buffer(N * sizeof(ScalarType), &(b[0]));   //             p = r
+  cl_mem ocl_Ap = ctx.create_buffer(N * sizeof(ScalarType));
+
+  // device scalars: [0], [1]: <r,r> of the current and the next iteration (alternating), [2]: <p,Ap>
+  cl_mem ocl_scalars = ctx.create_buffer(3 * sizeof(ScalarType));
+  const cl_uint pAp_index = 2;
+  cl_mem ocl_partials = ctx.create_buffer(blas1.num_partials() * sizeof(ScalarType));
+
+  //
+  /////////////////////////// Part 4: Run CG iterations ///////////////////////////////////
+  //
+  double vector_bytes = double(N) * sizeof(ScalarType);
+  double spmv_bytes   = (format == "sell")
+                      ? double(A_sell.stored_entries) * (sizeof(ScalarType) + sizeof(cl_uint)) + 3 * vector_bytes
+                      : double(A.nnz) * (sizeof(ScalarType) + sizeof(cl_uint)) + double(N + 1) * sizeof(cl_uint) + 2 * vector_bytes;
+  kernel_statistics spmv_stats("SpMV:        ", spmv_bytes);
+  kernel_statistics dot_stats ("vec_dot:     ", 2 * vector_bytes);
+  kernel_statistics sum_stats ("vec_sum:     ", blas1.num_partials() * sizeof(ScalarType));
+  kernel_statistics axpy_stats("axpy (x, r): ", 3 * vector_bytes);
+  kernel_statistics xpay_stats("xpay (p):    ", 3 * vector_bytes);
+
+  blas1.dot(ocl_r, ocl_r, ocl_scalars, 0, N);
+  ScalarType initial_residual;
+  err = clEnqueueReadBuffer(ctx.queue(), ocl_scalars, CL_TRUE, 0, sizeof(ScalarType), &initial_residual, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  initial_residual = std::sqrt(initial_residual);
+
+  ScalarType host_residual = 0;     // target of the asynchronous residual reads
+  cl_event   residual_event = NULL;
+  cl_uint    residual_iteration = 0;
+  cl_uint    converged_iteration = 0;
+  ScalarType converged_residual = initial_residual;
+
+  Timer timer;
+  cl_uint iter = 0;
+  for (; iter < max_iterations; ++iter)
+  {
+    cl_uint rr_index     = iter % 2;
+    cl_uint rr_new_index = 1 - rr_index;
+
+    if (format == "sell")
+      spmv.sell(A_sell, ocl_p, ocl_Ap, spmv_stats.new_event());
+    else
+      spmv.csr_adaptive(A, ocl_p, ocl_Ap, spmv_stats.new_event());
+
+    blas1.dot_partials(ocl_p, ocl_Ap, ocl_partials, N, dot_stats.new_event());
+    blas1.sum(ocl_partials, blas1.num_partials(), ocl_scalars, pAp_index, sum_stats.new_event());
+
+    blas1.axpy(ocl_x, ocl_p,  ocl_scalars, rr_index, pAp_index,  1.0f, N, axpy_stats.new_event());
+    blas1.axpy(ocl_r, ocl_Ap, ocl_scalars, rr_index, pAp_index, -1.0f, N, axpy_stats.new_event());
+
+    blas1.dot_partials(ocl_r, ocl_r, ocl_partials, N, dot_stats.new_event());
+    blas1.sum(ocl_partials, blas1.num_partials(), ocl_scalars, rr_new_index, sum_stats.new_event());
+
+    blas1.xpay(ocl_p, ocl_r, ocl_scalars, rr_new_index, rr_index, 1.0f, N, xpay_stats.new_event());
+
+    if ((iter + 1) % check_interval == 0)
+    {
+      // evaluate the residual requested at the previous check. The device meanwhile processed 'check_interval' further iterations.
+      if (residual_event)
+      {
+        err = clWaitForEvents(1, &residual_event); OPENCL_ERR_CHECK(err);
+        clReleaseEvent(residual_event);
+        residual_event = NULL;
+        converged_residual = std::sqrt(host_residual);
+        if (converged_residual <= tolerance * initial_residual)
+        {
+          converged_iteration = residual_iteration;
+          break;
+        }
+      }
+
+      residual_iteration = iter + 1;
+      err = clEnqueueReadBuffer(ctx.queue(), ocl_scalars, CL_FALSE, sizeof(ScalarType) * rr_new_index, sizeof(ScalarType), &host_residual, 0, NULL, &residual_event); OPENCL_ERR_CHECK(err);
+      err = clFlush(ctx.queue()); OPENCL_ERR_CHECK(err);
+    }
+  }
+  err = clFinish(ctx.queue()); OPENCL_ERR_CHECK(err);
+  double solver_time = timer.get();
+
+  if (residual_event)
+  {
+    clReleaseEvent(residual_event);
+    converged_residual = std::sqrt(host_residual);
+    if (!converged_iteration && converged_residual <= tolerance * initial_residual)
+      converged_iteration = residual_iteration;
+  }
+  if (iter < max_iterations)
+    ++iter;   // the iteration in which the check happened has been enqueued as well
+
+  //
+  /////////////////////////// Part 5: Get data from OpenCL buffer ///////////////////////////////////
+  //
+  err = clEnqueueReadBuffer(ctx.queue(), ocl_x, CL_TRUE, 0, sizeof(ScalarType) * x.size(), &(x[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+
+  std::vector<ScalarType> Ax(N);
+  host_A.apply(x, Ax);
+  double true_residual = 0;
+  for (cl_uint i=0; i<N; ++i)
+    true_residual += (b[i] - Ax[i]) * (b[i] - Ax[i]);
+  true_residual = std::sqrt(true_residual);
+
+  std::cout << std::endl;
+  std::cout << "Converged after:        " << (converged_iteration ? converged_iteration : iter) << " iterations"
+            << (converged_iteration ? "" : " (NOT converged)") << std::endl;
+  std::cout << "Iterations executed:    " << iter << std::endl;
+  std::cout << "Relative residual (CG): " << converged_residual / initial_residual << std::endl;
+  std::cout << "Relative residual (true): " << true_residual / initial_residual << std::endl;
+  std::cout << "Solver time:            " << solver_time << " s, " << iter / solver_time << " iterations/s" << std::endl;
+  std::cout << std::endl;
+  std::cout << "# Per-kernel device times:" << std::endl;
+  spmv_stats.report(iter);
+  dot_stats.report(iter);
+  sum_stats.report(iter);
+  axpy_stats.report(iter);
+  xpay_stats.report(iter);
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(ocl_x);
+  clReleaseMemObject(ocl_r);
+  clReleaseMemObject(ocl_p);
+  clReleaseMemObject(ocl_Ap);
+  clReleaseMemObject(ocl_scalars);
+  clReleaseMemObject(ocl_partials);
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# CG solver finished " << (converged_iteration ? "successfully!" : "without reaching the tolerance!") << std::endl;
+  std::cout << "#" << std::endl;
+  return converged_iteration ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,150 @@
+
+//
+// Persistent compute daemon for vec_add and vec_dot, plus a client measuring the round trip
+//
+// Usage:
+//   compute_daemon serve [socket]                       keeps context, programs and buffer pool warm until stopped
+//   compute_daemon client [size] [repetitions] [socket] submits dot and add requests, vectors shared through a memfd
+//   compute_daemon stop [socket]
+//
+// The client also sets up a context and builds the blas1 program itself once, which is what every short-lived
+// job pays without the daemon.
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-daemon.hpp"
+#include "benchmark-utils.hpp"
+
+
+int serve(std::string const & socket_path)
+{
+  Timer timer;
+  ocl::context ctx;
+  ocl::compute_daemon daemon(ctx, socket_path);
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+  std::cout << "# Setup time: " << timer.get() * 1e3 << " ms, " << (daemon.zero_copy() ? "zero copy (unified memory)" : "copying to device buffers") << std::endl;
+  std::cout << "# Listening on " << socket_path << std::endl;
+
+  daemon.run();
+
+  std::cout << "# Requests processed: " << daemon.requests() << std::endl;
+  std::cout << "# Buffer pool: "; daemon.pool().statistics().print(std::cout); std::cout << std::endl;
+  return EXIT_SUCCESS;
+}
+
+
+int client(std::size_t vector_size, std::size_t repetitions, std::string const & socket_path)
+{
+  //
+  /////////////////////////// Part 1: Set up the shared vectors ///////////////////////////////////
+  //
+  vector_size = std::max<std::size_t>(vector_size, 1);
+  repetitions = std::max<std::size_t>(repetitions, 1);
+  ocl::shared_vectors v(vector_size);
+  for (std::size_t i=0; i<vector_size; ++i)
+  {
+    v.x()[i] = 1.0;
+    v.y()[i] = 2.0;
+  }
+
+  //
+  /////////////////////////// Part 2: Submit requests ///////////////////////////////////
+  //
+  Timer timer;
+  ocl::daemon_client daemon(socket_path);
+  double connect_time = timer.get();
+
+  timer.start();
+  ScalarType dot_result = 0;
+  for (std::size_t run=0; run<repetitions; ++run)
+    dot_result = daemon.dot(v);
+  double dot_time = timer.get() / repetitions;
+
+  timer.start();
+  daemon.add(v);
+  double add_time = timer.get();
+
+  //
+  /////////////////////////// Part 3: Cost of a cold start, for comparison ///////////////////////////////////
+  //
+  timer.start();
+  {
+    ocl::context ctx;
+    ocl::blas1_kernels kernels(ctx);
+  }
+  double setup_time = timer.get();
+
+  //
+  /////////////////////////// Part 4: Report ///////////////////////////////////
+  //
+  std::cout << "Connect:              " << connect_time * 1e6 << " us" << std::endl;
+  std::cout << "dot request:          " << dot_time * 1e6 << " us (average of " << repetitions << ")" << std::endl;
+  std::cout << "add request:          " << add_time * 1e6 << " us" << std::endl;
+  std::cout << "Cold context + build: " << setup_time * 1e6 << " us" << std::endl;
+  std::cout << std::endl;
+  std::cout << "Result of dot(x,y): " << dot_result << " (expected " << 2.0 * vector_size << ")" << std::endl;
+  std::cout << "x after add: " << v.x()[0] << " " << v.x()[1] << " " << v.x()[2] << " ..." << std::endl;
+
+  if (std::fabs(dot_result - 2.0 * vector_size) > 1e-3 * vector_size || v.x()[vector_size - 1] != 3.0)
+  {
+    std::cout << "# Results from the daemon are WRONG!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char **argv)
+{
+  std::string mode = (argc > 1) ? argv[1] : "";
+
+  int result = EXIT_FAILURE;
+  if (mode == "serve")
+    result = serve((argc > 2) ? argv[2] : ocl::daemon_default_socket);
+  else if (mode == "client")
+    result = client((argc > 2) ? std::size_t(std::atof(argv[2])) : 1024*1024,
+                    (argc > 3) ? std::size_t(std::atoi(argv[3])) : 100,
+                    (argc > 4) ? argv[4] : ocl::daemon_default_socket);
+  else if (mode == "stop")
+  {
+    ocl::daemon_client daemon((argc > 2) ? argv[2] : ocl::daemon_default_socket);
+    daemon.shutdown();
+    result = EXIT_SUCCESS;
+  }
+  else
+  {
+    std::cout << "Usage: " << argv[0] << " serve [socket]" << std::endl;
+    std::cout << "       " << argv[0] << " client [size] [repetitions] [socket]" << std::endl;
+    std::cout << "       " << argv[0] << " stop [socket]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (result == EXIT_SUCCESS)
+  {
+    std::cout << std::endl;
+    std::cout << "#" << std::endl;
+    std::cout << "# Compute daemon application finished successfully!" << std::endl;
+    std::cout << "#" << std::endl;
+  }
+  return result;
+}
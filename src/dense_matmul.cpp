@@ -0,0 +1,187 @@
+
+//
+// Parameter study for dense matrix-vector (GEMV, row- and column-major) and matrix-matrix (GEMM) products
+//
+// Sweeps the work group size of GEMV (bandwidth-bound) and the tile sizes of GEMM (compute-bound),
+// reports the best configuration found and checks the results against a host reference.
+//
+// Usage: dense_matmul [gemv_size] [gemm_size]
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-program-cache.hpp"
+#include "ocl-tuner.hpp"
+#include "ocl-dense.hpp"
+#include "benchmark-utils.hpp"
+
+
+// Median time of 'op' from the benchmark harness. The warmup runs include the build of a new configuration.
+template <typename OpT>
+double time_operation(ocl::context const & ctx, OpT op, std::size_t num_runs = 5)
+{
+  BenchmarkSettings settings;
+  settings.min_runs = std::max(settings.min_runs, num_runs);
+  settings.min_time = 0;   // one sweep tests dozens of configurations
+  return benchmark([&]() { op(); clFinish(ctx.queue()); }, settings).median;
+}
+
+bool check_result(std::vector<ScalarType> const & result, std::vector<ScalarType> const & reference)
+{
+  for (size_t i=0; i<reference.size(); ++i)
+    if (std::fabs(result[i] - reference[i]) > 1e-3 * (1 + std::fabs(reference[i])))
+    {
+      std::cout << "Mismatch at index " << i << ": " << result[i] << " vs. " << reference[i] << std::endl;
+      return false;
+    }
+  return true;
+}
+
+
+int main(int argc, char **argv)
+{
+  cl_int err;
+  cl_uint gemv_size = (argc > 1) ? cl_uint(std::atoi(argv[1])) : 4096;
+  cl_uint gemm_size = (argc > 2) ? cl_uint(std::atoi(argv[2])) : 1024;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Programs are built on demand for each configuration ///////////////////////////////////
+  //
+  ocl::program_cache cache(ctx);
+  ocl::dense_kernels dense(cache);
+  bool all_ok = true;
+
+  //
+  /////////////////////////// Part 3: Create memory buffers ///////////////////////////////////
+  //
+  cl_uint M = gemv_size, N = gemv_size;
+  std::vector<ScalarType> A(M * N), x(N), y(M), y_ref(M, 0);
+  for (size_t i=0; i<A.size(); ++i) A[i] = ScalarType(i % 13) / 13;
+  for (size_t i=0; i<x.size(); ++i) x[i] = ScalarType(i % 5) / 5;
+
+  // row-major reference. The column-major kernel gets the transposed storage of the same matrix.
+  std::vector<ScalarType> A_col(M * N);
+  for (cl_uint i=0; i<M; ++i)
+    for (cl_uint j=0; j<N; ++j)
+    {
+      y_ref[i] += A[i * N + j] * x[j];
+      A_col[i + j * M] = A[i * N + j];
+    }
+
+  cl_mem ocl_A     = ctx.create_buffer(A.size() * sizeof(ScalarType), &(A[0]));
+  cl_mem ocl_A_col = ctx.create_buffer(A_col.size() * sizeof(ScalarType), &(A_col[0]));
+  cl_mem ocl_x     = ctx.create_buffer(x.size() * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_y     = ctx.create_buffer(y.size() * sizeof(ScalarType));
+
+  cl_uint S = gemm_size;
+  std::vector<ScalarType> gA(S * S), gB(S * S), gC(S * S), gC_ref(S * S, 0);
+  for (size_t i=0; i<gA.size(); ++i) { gA[i] = ScalarType(i % 7) / 7; gB[i] = ScalarType(i % 11) / 11; }
+  for (cl_uint i=0; i<S; ++i)
+    for (cl_uint k=0; k<S; ++k)
+      for (cl_uint j=0; j<S; ++j)
+        gC_ref[i * S + j] += gA[i * S + k] * gB[k * S + j];
+
+  cl_mem ocl_gA = ctx.create_buffer(gA.size() * sizeof(ScalarType), &(gA[0]));
+  cl_mem ocl_gB = ctx.create_buffer(gB.size() * sizeof(ScalarType), &(gB[0]));
+  cl_mem ocl_gC = ctx.create_buffer(gC.size() * sizeof(ScalarType));
+
+  //
+  /////////////////////////// Part 4: Parameter sweeps ///////////////////////////////////
+  //
+  double gemv_bytes = (double(M) * N + M + N) * sizeof(ScalarType);
+  double gemm_flops = 2.0 * S * S * S;
+
+  std::cout << std::endl << "# GEMV row-major, " << M << " x " << N << ":" << std::endl;
+  ocl::tuning_result gemv_row = ocl::tune(dense.gemv_space(), [&](ocl::parameter_set const & p) {
+      if (!dense.gemv_valid(p)) return -1.0;
+      return time_operation(ctx, [&]() { dense.gemv_row_major(ocl_A, ocl_x, ocl_y, M, N, p); });
+    }, true);
+
+  std::cout << std::endl << "# GEMV column-major, " << M << " x " << N << ":" << std::endl;
+  ocl::tuning_result gemv_col = ocl::tune(dense.gemv_space(), [&](ocl::parameter_set const & p) {
+      if (!dense.gemv_valid(p)) return -1.0;
+      return time_operation(ctx, [&]() { dense.gemv_col_major(ocl_A_col, ocl_x, ocl_y, M, N, p); });
+    }, true);
+
+  std::cout << std::endl << "# GEMM, " << S << " x " << S << " x " << S << ":" << std::endl;
+  ocl::tuning_result gemm = ocl::tune(dense.gemm_space(), [&](ocl::parameter_set const & p) {
+      if (!dense.gemm_valid(p)) return -1.0;
+      return time_operation(ctx, [&]() { dense.gemm(ocl_gA, ocl_gB, ocl_gC, S, S, S, p); }, 3);
+    }, true);
+
+  //
+  /////////////////////////// Part 5: Verify best configurations and report ///////////////////////////////////
+  //
+  if (gemv_row.tested == 0 || gemv_col.tested == 0 || gemm.tested == 0)
+  {
+    std::cout << "# No valid configuration found!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  dense.gemv_row_major(ocl_A, ocl_x, ocl_y, M, N, gemv_row.best);
+  err = clEnqueueReadBuffer(ctx.queue(), ocl_y, CL_TRUE, 0, sizeof(ScalarType) * y.size(), &(y[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  all_ok &= check_result(y, y_ref);
+
+  dense.gemv_col_major(ocl_A_col, ocl_x, ocl_y, M, N, gemv_col.best);
+  err = clEnqueueReadBuffer(ctx.queue(), ocl_y, CL_TRUE, 0, sizeof(ScalarType) * y.size(), &(y[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  all_ok &= check_result(y, y_ref);
+
+  dense.gemm(ocl_gA, ocl_gB, ocl_gC, S, S, S, gemm.best);
+  err = clEnqueueReadBuffer(ctx.queue(), ocl_gC, CL_TRUE, 0, sizeof(ScalarType) * gC.size(), &(gC[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  all_ok &= check_result(gC, gC_ref);
+
+  std::cout << std::endl;
+  std::cout << "GEMV row-major:    " << gemv_row.best.to_string() << ", " << gemv_bytes / gemv_row.best_time * 1e-9 << " GB/s"
+            << " (" << gemv_row.tested << " configurations)" << std::endl;
+  std::cout << "GEMV column-major: " << gemv_col.best.to_string() << ", " << gemv_bytes / gemv_col.best_time * 1e-9 << " GB/s"
+            << " (" << gemv_col.tested << " configurations)" << std::endl;
+  std::cout << "GEMM:              " << gemm.best.to_string() << ", " << gemm_flops / gemm.best_time * 1e-9 << " GFLOP/s"
+            << " (" << gemm.tested << " configurations)" << std::endl;
+  std::cout << "Programs built:    " << cache.builds() << std::endl;
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(ocl_A);
+  clReleaseMemObject(ocl_A_col);
+  clReleaseMemObject(ocl_x);
+  clReleaseMemObject(ocl_y);
+  clReleaseMemObject(ocl_gA);
+  clReleaseMemObject(ocl_gB);
+  clReleaseMemObject(ocl_gC);
+
+  if (!all_ok)
+  {
+    std::cout << "# Results do NOT match the host reference!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Dense parameter study finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
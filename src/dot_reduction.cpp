@@ -0,0 +1,182 @@
+
+//
+// Reduction strategies for vec_dot, from cache-resident to DRAM-sized vectors:
+//  - host:        one partial result per work group, summed on the host (as in vector_dot.cpp)
+//  - two-kernel:  partial results summed on the device by a second kernel (vec_sum)
+//  - atomic:      single kernel, work groups add their sums to the result atomically
+//  - reproducible: fixed-point sum, identical bits for every launch configuration (two passes over the data)
+//
+// All strategies use the same launch configuration. Times include reading the result to the host,
+// which the host reduction needs anyway. Part 4 then compares the bits of the fast and the reproducible
+// result across launch configurations.
+//
+// Usage: dot_reduction [max_size]
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <set>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-program-cache.hpp"
+#include "ocl-tuner.hpp"
+#include "ocl-blas1-tuned.hpp"
+#include "benchmark-utils.hpp"
+
+
+int main(int argc, char **argv)
+{
+  cl_int err;
+  cl_uint max_size = (argc > 1) ? cl_uint(std::atof(argv[1])) : 16*1024*1024;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  ocl::program_cache cache(ctx);
+  ocl::blas1_tuned_kernels kernels(cache);
+  ocl::parameter_set p = kernels.current(max_size);   // generic defaults for this device
+  std::cout << "# Configuration: " << p.to_string() << std::endl;
+
+  bool with_atomics = ocl::blas1_tuned_kernels::atomics_supported(ctx);
+  if (!with_atomics)
+    std::cout << "# No global atomics on this device, skipping the atomic reduction" << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create memory buffers ///////////////////////////////////
+  //
+  std::vector<ScalarType> x(max_size), y(max_size);
+  for (cl_uint i=0; i<max_size; ++i)
+  {
+    x[i] = ScalarType((i * 7919) % 1000) / 1000;
+    y[i] = ScalarType((i * 104729) % 997) / 997;
+  }
+  cl_uint groups = cl_uint(p.value("GROUPS"));
+  std::vector<ScalarType> partials(groups);
+  cl_mem ocl_x        = ctx.create_buffer(max_size * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_y        = ctx.create_buffer(max_size * sizeof(ScalarType), &(y[0]));
+  cl_mem ocl_partials = ctx.create_buffer(groups * sizeof(ScalarType));
+  cl_mem ocl_result   = ctx.create_buffer(sizeof(ScalarType));
+
+  //
+  /////////////////////////// Part 3: Compare the strategies ///////////////////////////////////
+  //
+  std::cout << std::endl;
+  std::cout << "#        N       host [GB/s]   two-kernel [GB/s]   atomic [GB/s]   reproducible [GB/s]" << std::endl;
+  bool all_ok = true;
+  for (cl_uint N = 16*1024; N <= max_size; N *= 4)
+  {
+    double reference = 0;
+    for (cl_uint i=0; i<N; ++i)
+      reference += double(x[i]) * double(y[i]);
+
+    ScalarType value_host = 0, value_device = 0, value_atomic = 0, value_reproducible = 0;
+    BenchmarkResult host = benchmark([&]() {
+        kernels.dot_partials(ocl_x, ocl_y, ocl_partials, N, p);
+        cl_int status = clEnqueueReadBuffer(ctx.queue(), ocl_partials, CL_TRUE, 0, groups * sizeof(ScalarType), &(partials[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+        value_host = 0;
+        for (cl_uint i=0; i<groups; ++i)
+          value_host += partials[i];
+      });
+    BenchmarkResult device = benchmark([&]() {
+        kernels.dot(ocl_x, ocl_y, ocl_result, 0, N, p);
+        cl_int status = clEnqueueReadBuffer(ctx.queue(), ocl_result, CL_TRUE, 0, sizeof(ScalarType), &value_device, 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+      });
+    BenchmarkResult atomic;
+    if (with_atomics)
+      atomic = benchmark([&]() {
+          kernels.dot_atomic(ocl_x, ocl_y, ocl_result, 0, N, p);
+          cl_int status = clEnqueueReadBuffer(ctx.queue(), ocl_result, CL_TRUE, 0, sizeof(ScalarType), &value_atomic, 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+        });
+
+    BenchmarkResult reproducible = benchmark([&]() {
+        kernels.dot_reproducible(ocl_x, ocl_y, ocl_result, 0, N, p);
+        cl_int status = clEnqueueReadBuffer(ctx.queue(), ocl_result, CL_TRUE, 0, sizeof(ScalarType), &value_reproducible, 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+      });
+
+    double bytes = 2.0 * sizeof(ScalarType) * N;
+    std::cout << std::setw(10) << N
+              << std::setw(18) << bytes / host.median * 1e-9
+              << std::setw(20) << bytes / device.median * 1e-9;
+    if (with_atomics)
+      std::cout << std::setw(16) << bytes / atomic.median * 1e-9;
+    else
+      std::cout << std::setw(16) << "-";
+    std::cout << std::setw(22) << bytes / reproducible.median * 1e-9 << std::endl;
+
+    double tolerance = 1e-3 * std::fabs(reference);
+    all_ok &= (std::fabs(value_host - reference) < tolerance) && (std::fabs(value_device - reference) < tolerance)
+           && (std::fabs(value_reproducible - reference) < tolerance);
+    if (with_atomics)
+      all_ok &= (std::fabs(value_atomic - reference) < tolerance);
+  }
+
+  //
+  /////////////////////////// Part 4: Bits of the result across launch configurations ///////////////////////////////////
+  //
+  // configurations that differ in the summation order: work group size, number of groups, work distribution, reduction
+  std::set<unsigned int> fast_bits, reproducible_bits;
+  std::size_t configurations = 0;
+  std::vector<ocl::parameter_set> all_configurations = kernels.space().configurations();
+  for (std::size_t i=0; i<all_configurations.size(); ++i)
+  {
+    ocl::parameter_set const & q = all_configurations[i];
+    if (!kernels.valid(q) || q.str("BUILD_PROFILE") != "strict" || q.value("UNROLL") != 1 || q.value("VW") != 1)
+      continue;
+    ++configurations;
+
+    ScalarType value;
+    unsigned int bits;
+    kernels.dot(ocl_x, ocl_y, ocl_result, 0, max_size, q);
+    err = clEnqueueReadBuffer(ctx.queue(), ocl_result, CL_TRUE, 0, sizeof(ScalarType), &value, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+    std::memcpy(&bits, &value, sizeof(bits));
+    fast_bits.insert(bits);
+
+    kernels.dot_reproducible(ocl_x, ocl_y, ocl_result, 0, max_size, q);
+    err = clEnqueueReadBuffer(ctx.queue(), ocl_result, CL_TRUE, 0, sizeof(ScalarType), &value, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+    std::memcpy(&bits, &value, sizeof(bits));
+    reproducible_bits.insert(bits);
+  }
+  std::cout << std::endl;
+  std::cout << "Distinct results for N = " << max_size << " over " << configurations << " launch configurations: "
+            << fast_bits.size() << " (fast), " << reproducible_bits.size() << " (reproducible)" << std::endl;
+  all_ok &= (reproducible_bits.size() == 1);
+
+  //
+  // cleanup
+  //
+  err = clReleaseMemObject(ocl_x); OPENCL_ERR_CHECK(err);
+  err = clReleaseMemObject(ocl_y); OPENCL_ERR_CHECK(err);
+  err = clReleaseMemObject(ocl_partials); OPENCL_ERR_CHECK(err);
+  err = clReleaseMemObject(ocl_result); OPENCL_ERR_CHECK(err);
+
+  if (!all_ok)
+  {
+    std::cout << "# Results do NOT match the host reference!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Dot product reduction study finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+#ifndef OPENCL_ASYNC_HPP_
+#define OPENCL_ASYNC_HPP_
+
+
+/** @file ocl-async.hpp
+    @brief Non-blocking vec_add/vec_dot: operations return future-like handles instead of waiting for the queue to drain
+
+    Each handle wraps the cl_event of the last command of the operation. Completion can be polled with ready(),
+    waited for with wait(), or observed through a callback registered with then() (clSetEventCallback).
+    dot() reads its result back with a non-blocking read, so get() only waits for that particular read.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <memory>
+#include <functional>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-buffer-pool.hpp"
+
+  namespace ocl
+  {
+
+    /** @brief Handle to an enqueued command. Copies share the underlying cl_event (reference counted by OpenCL). */
+    class event_future
+    {
+    public:
+      event_future() : event_(NULL) {}
+      explicit event_future(cl_event e) : event_(e) {}   // takes ownership
+
+      event_future(event_future const & other) : event_(other.event_) { if (event_) clRetainEvent(event_); }
+      event_future & operator=(event_future const & other)
+      {
+        if (other.event_) clRetainEvent(other.event_);
+        if (event_)       clReleaseEvent(event_);
+        event_ = other.event_;
+        return *this;
+      }
+      ~event_future() { if (event_) clReleaseEvent(event_); }
+
+      bool valid() const { return event_ != NULL; }
+
+      /** @brief Non-blocking check whether the command has finished. Throws if it terminated abnormally. */
+      bool ready() const
+      {
+        if (!event_)
+          return true;
+        cl_int status;
+        cl_int err = clGetEventInfo(event_, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, NULL); OPENCL_ERR_CHECK(err);
+        if (status < 0)
+          OPENCL_ERR_CHECK(status);
+        return status == CL_COMPLETE;
+      }
+
+      /** @brief Blocks until the command has finished. Other commands in the queue may still be running afterwards. */
+      void wait() const
+      {
+        if (event_)
+        {
+          cl_int err = clWaitForEvents(1, &event_); OPENCL_ERR_CHECK(err);
+        }
+      }
+
+      /** @brief Calls 'f' once the command has finished. 'f' runs on a thread of the OpenCL runtime and must not call blocking OpenCL functions. */
+      void then(std::function<void()> f) const
+      {
+        if (!event_)
+        {
+          f();
+          return;
+        }
+        std::function<void()> * callback = new std::function<void()>(f);
+        cl_int err = clSetEventCallback(event_, CL_COMPLETE, &event_future::callback_trampoline, callback);
+        if (err != CL_SUCCESS)
+          delete callback;   // never called, hence never deleted by the trampoline
+        OPENCL_ERR_CHECK(err);
+      }
+
+      cl_event handle() const { return event_; }
+
+    private:
+      static void CL_CALLBACK callback_trampoline(cl_event, cl_int, void * user_data)
+      {
+        std::function<void()> * callback = static_cast<std::function<void()> *>(user_data);
+        (*callback)();
+        delete callback;
+      }
+
+      cl_event event_;
+    };
+
+
+    /** @brief Handle to a dot product in flight. get() waits for the result and returns it. */
+    class dot_future : public event_future
+    {
+      // owns the host target of the non-blocking read, which must stay alive until the read has completed.
+      // Dropped by whichever handle releases it last (destructor or assignment), so the wait is done here.
+      struct state
+      {
+        state() : value(0), result(NULL), pool(NULL), read_event(NULL) {}
+        ~state()
+        {
+          if (read_event)
+          {
+            clWaitForEvents(1, &read_event);
+            clReleaseEvent(read_event);
+          }
+          if (result && pool)
+            pool->release(result);
+          else if (result)
+            clReleaseMemObject(result);
+        }
+
+        float         value;
+        cl_mem        result;
+        buffer_pool * pool;    // owner of 'result', if any
+        cl_event      read_event;   // retained
+      };
+
+    public:
+      dot_future() {}
+
+      float get() const
+      {
+        wait();
+        return state_ ? state_->value : 0;
+      }
+
+    private:
+      friend class async_blas1;
+
+      dot_future(cl_event e, std::shared_ptr<state> s) : event_future(e), state_(s) {}
+
+      std::shared_ptr<state> state_;
+    };
+
+
+    /** @brief Non-blocking front end for vec_add and vec_dot. All operations are flushed to the device right away. */
+    class async_blas1
+    {
+    public:
+      /** @param pool   If not NULL, the result buffers of dot() are taken from and returned to the pool. Must outlive all dot_future handles. */
+      async_blas1(context const & ctx, blas1_kernels & kernels, buffer_pool * pool = NULL) : ctx_(ctx), kernels_(kernels), pool_(pool) {}
+
+      /** @brief x += y. The returned handle becomes ready once the kernel has finished. */
+      event_future add(cl_mem x, cl_mem y, cl_uint N)
+      {
+        cl_event e;
+        kernels_.add(x, y, N, &e);
+        cl_int err = clFlush(ctx_.queue()); OPENCL_ERR_CHECK(err);
+        return event_future(e);
+      }
+
+      /** @brief x^T y. The result is reduced on the device and read back without blocking the host. */
+      dot_future dot(cl_mem x, cl_mem y, cl_uint N)
+      {
+        cl_int err;
+        std::shared_ptr<dot_future::state> s(new dot_future::state());
+        s->pool   = pool_;
+        s->result = pool_ ? pool_->allocate(sizeof(float)) : ctx_.create_buffer(sizeof(float));
+        kernels_.dot(x, y, s->result, 0, N);
+
+        cl_event e;
+        err = clEnqueueReadBuffer(ctx_.queue(), s->result, CL_FALSE, 0, sizeof(float), &(s->value), 0, NULL, &e); OPENCL_ERR_CHECK(err);
+        err = clRetainEvent(e); OPENCL_ERR_CHECK(err);
+        s->read_event = e;
+        err = clFlush(ctx_.queue()); OPENCL_ERR_CHECK(err);
+        return dot_future(e, s);
+      }
+
+      /** @brief Non-blocking read of 'num_bytes' from 'buffer' to 'host_ptr'. 'host_ptr' must stay valid until the handle is ready. */
+      event_future read(cl_mem buffer, size_t num_bytes, void * host_ptr)
+      {
+        cl_event e;
+        cl_int err = clEnqueueReadBuffer(ctx_.queue(), buffer, CL_FALSE, 0, num_bytes, host_ptr, 0, NULL, &e); OPENCL_ERR_CHECK(err);
+        err = clFlush(ctx_.queue()); OPENCL_ERR_CHECK(err);
+        return event_future(e);
+      }
+
+    private:
+      async_blas1(async_blas1 const &);
+      async_blas1 & operator=(async_blas1 const &);
+
+      context const & ctx_;
+      blas1_kernels & kernels_;
+      buffer_pool *   pool_;
+    };
+
+  } //namespace ocl
+
+
+#endif
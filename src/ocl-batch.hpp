@@ -0,0 +1,250 @@
+#ifndef OPENCL_BATCH_HPP_
+#define OPENCL_BATCH_HPP_
+
+
+/** @file ocl-batch.hpp
+    @brief Records many small vector operations and submits them together
+
+    Consecutive element-wise operations (x += y, x -= y, x *= y) on vectors of the same length are merged into one
+    generated kernel, which loads every vector involved once, applies the operations in order and stores the modified
+    vectors. The generated source only depends on the pattern of the operations, not on the buffers, so a loop issuing
+    the same sequence builds one program. A dot product ends the current run of element-wise operations.
+
+    Kernel arguments are set through memoized_kernel, so unchanged arguments do not reach clSetKernelArg.
+    flush() only calls clFlush, the host synchronizes with finish() or a blocking read.
+
+    Distinct cl_mem handles are assumed not to overlap (no overlapping sub-buffers within one run).
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <stdexcept>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-program-cache.hpp"
+#include "ocl-kernel-args.hpp"
+#include "ocl-blas1.hpp"
+
+  namespace ocl
+  {
+
+    class batch
+    {
+      struct elementwise_op
+      {
+        cl_mem x;
+        cl_mem y;
+        char   op;   // '+', '-' or '*': x op= y
+      };
+
+      typedef std::map<std::string, memoized_kernel>  kernel_map;
+
+    public:
+      /** @param max_ops   Number of recorded operations after which the batch is flushed automatically */
+      batch(context const & ctx, program_cache & cache, std::size_t max_ops = 64)
+        : ctx_(ctx), cache_(cache), max_ops_(max_ops), recorded_(0), run_N_(0), launches_(0), partials_(NULL)
+      {
+        dot_ = memoized_kernel(cache_.create_kernel(blas1_program_source, std::string(), "vec_dot"));
+        sum_ = memoized_kernel(cache_.create_kernel(blas1_program_source, std::string(), "vec_sum"));
+        partials_ = ctx_.create_buffer(blas1_kernels::num_partials() * sizeof(float));
+      }
+
+      ~batch()
+      {
+        try
+        {
+          flush();
+        }
+        catch (std::exception const & e)   // must not leave the destructor
+        {
+          std::cerr << "batch: flush failed: " << e.what() << std::endl;
+        }
+        for (kernel_map::iterator it = fused_.begin(); it != fused_.end(); ++it)
+          clReleaseKernel(it->second.handle());
+        clReleaseKernel(dot_.handle());
+        clReleaseKernel(sum_.handle());
+        clReleaseMemObject(partials_);
+      }
+
+      /** @brief x += y */
+      void add(cl_mem x, cl_mem y, cl_uint N) { record(x, y, '+', N); }
+
+      /** @brief x -= y */
+      void sub(cl_mem x, cl_mem y, cl_uint N) { record(x, y, '-', N); }
+
+      /** @brief x *= y (entry-wise) */
+      void mul(cl_mem x, cl_mem y, cl_uint N) { record(x, y, '*', N); }
+
+      /** @brief result[result_index] = x^T y, enqueued after all operations recorded before */
+      void dot(cl_mem x, cl_mem y, cl_mem result, cl_uint result_index, cl_uint N)
+      {
+        submit_run();
+
+        dot_.arg(0, x);
+        dot_.arg(1, y);
+        dot_.arg(2, partials_);
+        dot_.arg(3, N);
+        dot_.local(4, sizeof(float) * blas1_local_size);
+        enqueue(dot_.handle(), blas1_global_size);
+
+        cl_uint num_partials = blas1_kernels::num_partials();
+        sum_.arg(0, partials_);
+        sum_.arg(1, num_partials);
+        sum_.arg(2, result);
+        sum_.arg(3, result_index);
+        sum_.local(4, sizeof(float) * blas1_local_size);
+        enqueue(sum_.handle(), blas1_local_size);
+
+        count_op();
+      }
+
+      /** @brief Enqueues all recorded operations and submits them to the device without waiting */
+      void flush()
+      {
+        submit_run();
+        if (recorded_ > 0)
+        {
+          cl_int err = clFlush(ctx_.queue()); OPENCL_ERR_CHECK(err);
+          recorded_ = 0;
+        }
+      }
+
+      /** @brief flush() and wait until the device has completed all operations */
+      void finish()
+      {
+        flush();
+        cl_int err = clFinish(ctx_.queue()); OPENCL_ERR_CHECK(err);
+      }
+
+      std::size_t launches() const { return launches_; }   // kernel launches so far
+      std::size_t programs() const { return fused_.size(); }   // distinct generated kernels
+
+      /** @brief Number of clSetKernelArg calls avoided by memoization */
+      std::size_t args_skipped() const
+      {
+        std::size_t skipped = dot_.skipped() + sum_.skipped();
+        for (kernel_map::const_iterator it = fused_.begin(); it != fused_.end(); ++it)
+          skipped += it->second.skipped();
+        return skipped;
+      }
+
+    private:
+      batch(batch const &);
+      batch & operator=(batch const &);
+
+      void record(cl_mem x, cl_mem y, char op, cl_uint N)
+      {
+        if (!run_.empty() && N != run_N_)
+          submit_run();
+        elementwise_op e = { x, y, op };
+        run_.push_back(e);
+        run_N_ = N;
+        count_op();
+      }
+
+      void count_op()
+      {
+        if (++recorded_ >= max_ops_)
+          flush();
+      }
+
+      /** @brief Enqueues the pending element-wise operations as one kernel */
+      void submit_run()
+      {
+        if (run_.empty())
+          return;
+
+        // number the buffers in order of appearance:
+        std::vector<cl_mem> buffers;
+        std::vector<bool>   written;
+        std::vector<std::pair<std::size_t, std::size_t> > operands;
+        for (std::size_t i=0; i<run_.size(); ++i)
+        {
+          std::size_t x = index_of(buffers, written, run_[i].x);
+          std::size_t y = index_of(buffers, written, run_[i].y);
+          written[x] = true;
+          operands.push_back(std::make_pair(x, y));
+        }
+
+        std::string source = fused_source(buffers.size(), written, operands);
+        kernel_map::iterator it = fused_.find(source);
+        if (it == fused_.end())
+          it = fused_.insert(std::make_pair(source, memoized_kernel(cache_.create_kernel(source, std::string(), "fused")))).first;
+
+        memoized_kernel & k = it->second;
+        for (std::size_t i=0; i<buffers.size(); ++i)
+          k.arg(cl_uint(i), buffers[i]);
+        k.arg(cl_uint(buffers.size()), run_N_);
+        enqueue(k.handle(), blas1_global_size);
+
+        run_.clear();
+      }
+
+      static std::size_t index_of(std::vector<cl_mem> & buffers, std::vector<bool> & written, cl_mem buffer)
+      {
+        for (std::size_t i=0; i<buffers.size(); ++i)
+          if (buffers[i] == buffer)
+            return i;
+        buffers.push_back(buffer);
+        written.push_back(false);
+        return buffers.size() - 1;
+      }
+
+      std::string fused_source(std::size_t num_buffers, std::vector<bool> const & written,
+                               std::vector<std::pair<std::size_t, std::size_t> > const & operands) const
+      {
+        std::ostringstream ss;
+        ss << "__kernel void fused(";
+        for (std::size_t i=0; i<num_buffers; ++i)
+          ss << "__global " << (written[i] ? "" : "const ") << "float *b" << i << ", ";
+        ss << "unsigned int N) \n";
+        ss << "{ \n";
+        ss << "  for (unsigned int i = get_global_id(0); i < N; i += get_global_size(0)) \n";
+        ss << "  { \n";
+        for (std::size_t i=0; i<num_buffers; ++i)
+          ss << "    float v" << i << " = b" << i << "[i]; \n";
+        for (std::size_t i=0; i<operands.size(); ++i)
+          ss << "    v" << operands[i].first << " " << run_[i].op << "= v" << operands[i].second << "; \n";
+        for (std::size_t i=0; i<num_buffers; ++i)
+          if (written[i])
+            ss << "    b" << i << "[i] = v" << i << "; \n";
+        ss << "  } \n";
+        ss << "} \n";
+        return ss.str();
+      }
+
+      void enqueue(cl_kernel k, size_t global_size)
+      {
+        size_t local_size = blas1_local_size;
+        cl_int err = clEnqueueNDRangeKernel(ctx_.queue(), k, 1, NULL, &global_size, &local_size, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+        ++launches_;
+      }
+
+      context const &             ctx_;
+      program_cache &             cache_;
+      std::size_t                 max_ops_;
+      std::size_t                 recorded_;   // operations since the last clFlush
+      std::vector<elementwise_op> run_;
+      cl_uint                     run_N_;
+      std::size_t                 launches_;
+      kernel_map                  fused_;
+      memoized_kernel             dot_;
+      memoized_kernel             sum_;
+      cl_mem                      partials_;
+    };
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,722 @@
+#ifndef OPENCL_BLAS1_TUNED_HPP_
+#define OPENCL_BLAS1_TUNED_HPP_
+
+
+/** @file ocl-blas1-tuned.hpp
+    @brief vec_add and vec_dot with tunable launch configuration, loop unrolling and build profile
+
+    The kernel parameters are macros supplied through a parameter_set (see ocl-tuner.hpp):
+     - WG             work group size
+     - GROUPS         number of work groups (vec_dot writes one partial result per group, vec_dot_atomic adds it atomically)
+     - UNROLL         vectors per work item and loop iteration, unrolled by the compiler
+     - VW             vector width of the loads and stores (1, 2, 4, 8, 16)
+     - BLOCKED        work distribution: 0 = grid-stride over the whole vector (coalesced on GPUs),
+                      1 = one contiguous block per work group, strided by WG inside it (cache-line friendly
+                      on CPU devices, where a work group runs on one core)
+     - SUBGROUPS      reduction within a work group: 0 = tree in local memory with a barrier per level,
+                      1 = sub_group_reduce_add() first, only one value per sub-group goes through local memory
+                      (requires cl_intel_subgroups, or cl_khr_subgroups with OpenCL C 2.0 or 3.0, checked by valid();
+                      the khr builtins are not available in the default OpenCL C 1.x, so -cl-std is added then)
+     - BUILD_PROFILE  floating-point compiler flags (strict, mad, no_signed_zeros, unsafe, fast_relaxed)
+
+    With a single accumulator, unrolling only pays off for vec_dot if the build profile permits reassociation
+    (unsafe, fast_relaxed), which in turn changes the rounding of the result.
+
+    JIT specialization (specialized(), or specialize(true) for all launches) additionally bakes the vector length
+    into the program as SPEC_N. If it is a multiple of VW * UNROLL * GROUPS * WG, EXACT=1 drops all bounds checks and
+    remainder loops. Each specialized signature is a separate entry of the program cache.
+
+    Besides dot() (two kernels), dot_atomic() reduces in a single kernel and dot_reproducible() returns the same bits
+    for every parameter_set, at the cost of a second pass over x and y.
+
+    The overloads of add() and dot() without a parameter_set do not wait for the compiler, except for the generic
+    defaults() whose build is started by the constructor: they launch the configuration set with prefer()
+    (specialized, if enabled) once its background build has finished, and the defaults() until then
+    (with BLOCKED=1 on CPU devices).
+    prepare() starts the background builds of further configurations.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-program-cache.hpp"
+#include "ocl-tuner.hpp"
+
+  namespace ocl
+  {
+
+    static const char * blas1_tuned_program_source = ""
+    "#ifndef VW \n"
+    "#define VW 1 \n"
+    "#endif \n"
+    "#ifndef EXACT \n"
+    "#define EXACT 0 \n"
+    "#endif \n"
+    "#ifndef BLOCKED \n"
+    "#define BLOCKED 0 \n"
+    "#endif \n"
+    "#ifndef SUBGROUPS \n"
+    "#define SUBGROUPS 0 \n"
+    "#endif \n"
+    "#ifdef cl_khr_global_int32_base_atomics \n"
+    "#pragma OPENCL EXTENSION cl_khr_global_int32_base_atomics : enable \n"
+    "#if __OPENCL_VERSION__ < 110 \n"   // OpenCL 1.0 spells the extension functions atom_*
+    "#define atomic_inc     atom_inc \n"
+    "#define atomic_xchg    atom_xchg \n"
+    "#define atomic_cmpxchg atom_cmpxchg \n"
+    "#endif \n"
+    "#endif \n"
+    "#if SUBGROUPS && defined(cl_intel_subgroups) \n"
+    "#pragma OPENCL EXTENSION cl_intel_subgroups : enable \n"
+    "#elif SUBGROUPS && defined(cl_khr_subgroups) \n"
+    "#pragma OPENCL EXTENSION cl_khr_subgroups : enable \n"
+    "#endif \n"
+    "#ifdef SPEC_N \n"
+    "#define LENGTH SPEC_N \n"
+    "#else \n"
+    "#define LENGTH N \n"
+    "#endif \n"
+    "#define STRIDE (GROUPS * WG) \n"
+    ""
+    "// range [i, end) of vectors of a work item and the distance STEP between its vectors: \n"
+    "#if BLOCKED \n"
+    "#define BLOCK ((LENGTH / VW + GROUPS - 1) / GROUPS) \n"
+    "#define STEP WG \n"
+    "#define RANGE(i, end) i = get_group_id(0) * BLOCK + get_local_id(0); end = min((unsigned int)(get_group_id(0) + 1) * BLOCK, (unsigned int)(LENGTH / VW)); \n"
+    "#else \n"
+    "#define STEP STRIDE \n"
+    "#define RANGE(i, end) i = get_global_id(0); end = LENGTH / VW; \n"
+    "#endif \n"
+    ""
+    "// vectors of VW entries: \n"
+    "#if VW == 1 \n"
+    "#define VLOAD(i, p)     (p)[i] \n"
+    "#define VSTORE(v, i, p) (p)[i] = (v) \n"
+    "#define VDOT(a, b)      ((a) * (b)) \n"
+    "#elif VW == 2 \n"
+    "#define VLOAD(i, p)     vload2(i, p) \n"
+    "#define VSTORE(v, i, p) vstore2(v, i, p) \n"
+    "#define VDOT(a, b)      dot(a, b) \n"
+    "#elif VW == 4 \n"
+    "#define VLOAD(i, p)     vload4(i, p) \n"
+    "#define VSTORE(v, i, p) vstore4(v, i, p) \n"
+    "#define VDOT(a, b)      dot(a, b) \n"
+    "#elif VW == 8 \n"
+    "#define VLOAD(i, p)     vload8(i, p) \n"
+    "#define VSTORE(v, i, p) vstore8(v, i, p) \n"
+    "#define VDOT(a, b)      (dot((a).lo, (b).lo) + dot((a).hi, (b).hi)) \n"
+    "#elif VW == 16 \n"
+    "#define VLOAD(i, p)     vload16(i, p) \n"
+    "#define VSTORE(v, i, p) vstore16(v, i, p) \n"
+    "#define VDOT(a, b)      (dot((a).lo.lo, (b).lo.lo) + dot((a).lo.hi, (b).lo.hi) + dot((a).hi.lo, (b).hi.lo) + dot((a).hi.hi, (b).hi.hi)) \n"
+    "#endif \n"
+    ""
+    "// reduction tree over WG entries of local memory, fully unrolled since WG is a compile-time constant: \n"
+    "#define REDUCE_STEP(S) if (WG > S) { barrier(CLK_LOCAL_MEM_FENCE); if (get_local_id(0) < S) shared_array[get_local_id(0)] += shared_array[get_local_id(0) + S]; } \n"
+    "#define REDUCE() REDUCE_STEP(512) REDUCE_STEP(256) REDUCE_STEP(128) REDUCE_STEP(64) REDUCE_STEP(32) \\\n"
+    "                 REDUCE_STEP(16)  REDUCE_STEP(8)   REDUCE_STEP(4)   REDUCE_STEP(2)  REDUCE_STEP(1) \n"
+    ""
+    "// sum of 'value' over the work group, written to 'target' by one work item: \n"
+    "#if SUBGROUPS \n"
+    "#define WORK_GROUP_SUM(value, target) { \\\n"
+    "  float sg_sum = sub_group_reduce_add(value); \\\n"
+    "  if (get_sub_group_local_id() == 0) shared_array[get_sub_group_id()] = sg_sum; \\\n"
+    "  barrier(CLK_LOCAL_MEM_FENCE); \\\n"
+    "  if (get_sub_group_id() == 0) { \\\n"
+    "    sg_sum = 0; \\\n"
+    "    for (unsigned int j = get_sub_group_local_id(); j < get_num_sub_groups(); j += get_sub_group_size()) sg_sum += shared_array[j]; \\\n"
+    "    sg_sum = sub_group_reduce_add(sg_sum); \\\n"
+    "    if (get_sub_group_local_id() == 0) target = sg_sum; } } \n"
+    "#else \n"
+    "#define WORK_GROUP_SUM(value, target) { \\\n"
+    "  shared_array[get_local_id(0)] = value; \\\n"
+    "  REDUCE() \\\n"
+    "  if (get_local_id(0) == 0) target = shared_array[0]; } \n"
+    "#endif \n"
+    ""
+    "// EXACT: LENGTH is a multiple of VW * UNROLL * STRIDE, so neither bounds checks nor remainder loops are needed \n"
+    "__kernel __attribute__((reqd_work_group_size(WG, 1, 1))) \n"
+    "void vec_add(__global float *x, \n"
+    "             __global const float *y, \n"
+    "             unsigned int N) \n"
+    "{ \n"
+    "  unsigned int i, end; \n"
+    "  RANGE(i, end) \n"
+    "#if EXACT \n"
+    "  for (; i < end; i += UNROLL * STEP) \n"
+    "    for (unsigned int u = 0; u < UNROLL; ++u) \n"
+    "      VSTORE(VLOAD(i + u * STEP, x) + VLOAD(i + u * STEP, y), i + u * STEP, x); \n"
+    "#else \n"
+    "  for (; i + (UNROLL - 1) * STEP < end; i += UNROLL * STEP) \n"
+    "    for (unsigned int u = 0; u < UNROLL; ++u) \n"
+    "      VSTORE(VLOAD(i + u * STEP, x) + VLOAD(i + u * STEP, y), i + u * STEP, x); \n"
+    "  for (; i < end; i += STEP) \n"
+    "    VSTORE(VLOAD(i, x) + VLOAD(i, y), i, x); \n"
+    "  for (i = LENGTH / VW * VW + get_global_id(0); i < LENGTH; i += STRIDE) \n"
+    "    x[i] += y[i]; \n"
+    "#endif \n"
+    "} \n"
+    ""
+    "// contribution of one work item to x^T y: \n"
+    "float thread_dot(__global const float *x, \n"
+    "                 __global const float *y, \n"
+    "                 unsigned int N) \n"
+    "{ \n"
+    "  float thread_result = 0; \n"
+    "  unsigned int i, end; \n"
+    "  RANGE(i, end) \n"
+    "#if EXACT \n"
+    "  for (; i < end; i += UNROLL * STEP) \n"
+    "    for (unsigned int u = 0; u < UNROLL; ++u) \n"
+    "      thread_result += VDOT(VLOAD(i + u * STEP, x), VLOAD(i + u * STEP, y)); \n"
+    "#else \n"
+    "  for (; i + (UNROLL - 1) * STEP < end; i += UNROLL * STEP) \n"
+    "    for (unsigned int u = 0; u < UNROLL; ++u) \n"
+    "      thread_result += VDOT(VLOAD(i + u * STEP, x), VLOAD(i + u * STEP, y)); \n"
+    "  for (; i < end; i += STEP) \n"
+    "    thread_result += VDOT(VLOAD(i, x), VLOAD(i, y)); \n"
+    "  for (i = LENGTH / VW * VW + get_global_id(0); i < LENGTH; i += STRIDE) \n"
+    "    thread_result += x[i] * y[i]; \n"
+    "#endif \n"
+    "  return thread_result; \n"
+    "} \n"
+    ""
+    "__kernel __attribute__((reqd_work_group_size(WG, 1, 1))) \n"
+    "void vec_dot(__global const float *x, \n"
+    "             __global const float *y, \n"
+    "             __global float *partials, \n"
+    "             unsigned int N) \n"
+    "{ \n"
+    "  __local float shared_array[WG]; \n"
+    "  float thread_result = thread_dot(x, y, N); \n"
+    "  WORK_GROUP_SUM(thread_result, partials[get_group_id(0)]) \n"
+    "} \n"
+    ""
+    "#if __OPENCL_VERSION__ >= 110 || defined(cl_khr_global_int32_base_atomics) \n"
+    "// *target += value for the bit pattern of a float, with a compare-exchange loop (OpenCL 1.x has no float atomics) \n"
+    "void atomic_add_float(volatile __global unsigned int *target, float value) \n"
+    "{ \n"
+    "  unsigned int old_bits, new_bits; \n"
+    "  do { \n"
+    "    old_bits = *target; \n"
+    "    new_bits = as_uint(as_float(old_bits) + value); \n"
+    "  } while (atomic_cmpxchg(target, old_bits, new_bits) != old_bits); \n"
+    "} \n"
+    ""
+    "// Single-kernel vec_dot: each work group adds its sum to scratch[0] atomically and counts itself in scratch[1]. \n"
+    "// The last work group moves the sum to result[result_index] and resets scratch (zero initially) for the next launch. \n"
+    "__kernel __attribute__((reqd_work_group_size(WG, 1, 1))) \n"
+    "void vec_dot_atomic(__global const float *x, \n"
+    "                    __global const float *y, \n"
+    "                    __global float *result, \n"
+    "                    unsigned int result_index, \n"
+    "                    volatile __global unsigned int *scratch, \n"
+    "                    unsigned int N) \n"
+    "{ \n"
+    "  __local float shared_array[WG]; \n"
+    "  __local float group_result; \n"
+    "  float thread_result = thread_dot(x, y, N); \n"
+    "  WORK_GROUP_SUM(thread_result, group_result) \n"
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  if (get_local_id(0) == 0) \n"
+    "  { \n"
+    "    atomic_add_float(scratch, group_result); \n"
+    "    mem_fence(CLK_GLOBAL_MEM_FENCE); \n"
+    "    if (atomic_inc(scratch + 1) == get_num_groups(0) - 1) \n"
+    "    { \n"
+    "      result[result_index] = as_float(atomic_xchg(scratch, 0u)); \n"
+    "      atomic_xchg(scratch + 1, 0u); \n"
+    "    } \n"
+    "  } \n"
+    "} \n"
+    "#endif \n"
+    ""
+    "// Reproducible vec_dot in three kernels: each product x_i * y_i is rounded to a 64-bit fixed-point number whose \n"
+    "// scale follows from the largest |x_i * y_i| and N. Integer addition is exact, so the result has the same bits \n"
+    "// for any launch configuration. The scale is derived per launch, so slices computed in separate launches \n"
+    "// (e.g. on several devices) have different scales and cannot be combined exactly. \n"
+    "#define FIXED_SUM(value, target) { \\\n"
+    "  shared_sum[get_local_id(0)] = value; \\\n"
+    "  for (unsigned int s = WG / 2; s > 0; s /= 2) { \\\n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \\\n"
+    "    if (get_local_id(0) < s) shared_sum[get_local_id(0)] += shared_sum[get_local_id(0) + s]; } \\\n"
+    "  if (get_local_id(0) == 0) target = shared_sum[0]; } \n"
+    ""
+    "float work_group_max(float value, __local float *shared_array) \n"
+    "{ \n"
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  shared_array[get_local_id(0)] = value; \n"
+    "  for (unsigned int s = WG / 2; s > 0; s /= 2) \n"
+    "  { \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "    if (get_local_id(0) < s) shared_array[get_local_id(0)] = fmax(shared_array[get_local_id(0)], shared_array[get_local_id(0) + s]); \n"
+    "  } \n"
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  return shared_array[0]; \n"
+    "} \n"
+    ""
+    "// x_i * y_i is scaled by 2^shift, so that all N scaled products sum up to less than 2^62 in magnitude \n"
+    "int fixed_shift(__global const float *max_partials, unsigned int N, __local float *shared_array) \n"
+    "{ \n"
+    "  float m = 0; \n"
+    "  for (unsigned int i = get_local_id(0); i < GROUPS; i += WG) \n"
+    "    m = fmax(m, max_partials[i]); \n"
+    "  int exponent; \n"
+    "  frexp(work_group_max(m, shared_array), &exponent); \n"
+    "  return 62 - (32 - (int)clz(N)) - exponent; \n"
+    "} \n"
+    ""
+    "// Pass 1: largest |x_i * y_i| per work group \n"
+    "__kernel __attribute__((reqd_work_group_size(WG, 1, 1))) \n"
+    "void vec_dot_max(__global const float *x, \n"
+    "                 __global const float *y, \n"
+    "                 __global float *max_partials, \n"
+    "                 unsigned int N) \n"
+    "{ \n"
+    "  __local float shared_array[WG]; \n"
+    "  float thread_max = 0; \n"
+    "  for (unsigned int i = get_global_id(0); i < LENGTH; i += STRIDE) \n"
+    "    thread_max = fmax(thread_max, fabs(x[i] * y[i])); \n"
+    "  thread_max = work_group_max(thread_max, shared_array); \n"
+    "  if (get_local_id(0) == 0) \n"
+    "    max_partials[get_group_id(0)] = thread_max; \n"
+    "} \n"
+    ""
+    "// Pass 2: fixed-point sum per work group \n"
+    "__kernel __attribute__((reqd_work_group_size(WG, 1, 1))) \n"
+    "void vec_dot_fixed(__global const float *x, \n"
+    "                   __global const float *y, \n"
+    "                   __global const float *max_partials, \n"
+    "                   __global long *partials, \n"
+    "                   unsigned int N) \n"
+    "{ \n"
+    "  __local float shared_array[WG]; \n"
+    "  __local long  shared_sum[WG]; \n"
+    "  int shift = fixed_shift(max_partials, LENGTH, shared_array); \n"
+    "  long thread_sum = 0; \n"
+    "  for (unsigned int i = get_global_id(0); i < LENGTH; i += STRIDE) \n"
+    "    thread_sum += convert_long_rte(ldexp(x[i] * y[i], shift)); \n"
+    "  FIXED_SUM(thread_sum, partials[get_group_id(0)]) \n"
+    "} \n"
+    ""
+    "// Pass 3: sum of the GROUPS fixed-point partials, rounded once to float. Launched with a single work group. \n"
+    "__kernel __attribute__((reqd_work_group_size(WG, 1, 1))) \n"
+    "void vec_sum_fixed(__global const long *partials, \n"
+    "                   __global const float *max_partials, \n"
+    "                   __global float *result, \n"
+    "                   unsigned int result_index, \n"
+    "                   unsigned int N) \n"
+    "{ \n"
+    "  __local float shared_array[WG]; \n"
+    "  __local long  shared_sum[WG]; \n"
+    "  __local long  sum; \n"
+    "  int shift = fixed_shift(max_partials, LENGTH, shared_array); \n"
+    "  long thread_sum = 0; \n"
+    "  for (unsigned int i = get_local_id(0); i < GROUPS; i += WG) \n"
+    "    thread_sum += partials[i]; \n"
+    "  FIXED_SUM(thread_sum, sum) \n"
+    "  if (get_local_id(0) == 0) \n"
+    "    result[result_index] = ldexp(convert_float_rte(sum), -shift); \n"
+    "} \n"
+    ""
+    "// Sums the GROUPS partial results of vec_dot. Launched with a single work group. \n"
+    "__kernel __attribute__((reqd_work_group_size(WG, 1, 1))) \n"
+    "void vec_sum(__global const float *partials, \n"
+    "             __global float *result, \n"
+    "             unsigned int result_index) \n"
+    "{ \n"
+    "  __local float shared_array[WG]; \n"
+    "  float thread_result = 0; \n"
+    "  for (unsigned int i = get_local_id(0); i < GROUPS; i += WG) \n"
+    "    thread_result += partials[i]; \n"
+    ""
+    "  WORK_GROUP_SUM(thread_result, result[result_index]) \n"
+    "} \n";
+
+
+    /** @brief Launches the tunable vector kernels for a given parameter_set. Programs are built on demand through the program cache. */
+    class blas1_tuned_kernels
+    {
+      typedef std::map<std::string, cl_kernel>  kernel_map;
+
+    public:
+      explicit blas1_tuned_kernels(program_cache & cache)
+        : cache_(cache), ctx_(cache.ctx()), partials_(NULL), partials_size_(0), fixed_partials_(NULL), fixed_partials_size_(0), scratch_(NULL), specialize_(false), tuned_(defaults()), fallback_(defaults())
+      {
+        cl_int err = clGetDeviceInfo(ctx_.device(), CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), &max_work_group_size_, NULL); OPENCL_ERR_CHECK(err);
+
+        // cl_intel_subgroups works with the default OpenCL C 1.x, the cl_khr_subgroups builtins need OpenCL C 2.0 or 3.0:
+        has_subgroups_ = ctx_.has_extension("cl_intel_subgroups");
+        if (!has_subgroups_ && ctx_.has_extension("cl_khr_subgroups"))
+        {
+          if (version_number(ctx_.device_version(), "OpenCL ") >= 3.0)
+            subgroup_options_ = "-cl-std=CL3.0";
+          else if (version_number(ctx_.opencl_c_version(), "OpenCL C ") >= 2.0)
+            subgroup_options_ = "-cl-std=CL2.0";
+          has_subgroups_ = !subgroup_options_.empty();
+        }
+
+        if (ctx_.device_type() & CL_DEVICE_TYPE_CPU)
+        {
+          fallback_.set("BLOCKED", 1);
+          tuned_ = fallback_;
+        }
+        prepare(fallback_);
+      }
+
+      ~blas1_tuned_kernels()
+      {
+        for (kernel_map::iterator it = kernels_.begin(); it != kernels_.end(); ++it)
+          clReleaseKernel(it->second);
+        if (partials_)
+          clReleaseMemObject(partials_);
+        if (fixed_partials_)
+          clReleaseMemObject(fixed_partials_);
+        if (scratch_)
+          clReleaseMemObject(scratch_);
+      }
+
+      /** @brief Launch configurations for a parameter sweep, all with the strict build profile (144 with with_reduction = false, 288 otherwise).
+      *
+      *  Every configuration is a separate program build, so the build profiles are not part of the cartesian product.
+      *  Sweep them over a few of the fastest launch configurations with build_profile_variants().
+      *
+      *  @param with_reduction   Whether to sweep SUBGROUPS. vec_add has no reduction, so it does not depend on it.
+      */
+      static parameter_space space(bool with_reduction = true)
+      {
+        parameter_space space;
+        space.add("WG",            std::vector<int>{64, 128, 256});
+        space.add("GROUPS",        std::vector<int>{64, 128, 512});
+        space.add("UNROLL",        std::vector<int>{1, 2, 4, 8});
+        space.add("VW",            std::vector<int>{1, 4});
+        space.add("BLOCKED",       std::vector<int>{0, 1});
+        space.add("SUBGROUPS",     with_reduction ? std::vector<int>{0, 1} : std::vector<int>{0});
+        space.add("BUILD_PROFILE", std::vector<std::string>{"strict"});
+        return space;
+      }
+
+      /** @brief 'p' with each of the build_profiles() other than its own */
+      static std::vector<parameter_set> build_profile_variants(parameter_set const & p)
+      {
+        std::vector<parameter_set> result;
+        std::vector<std::string> profiles = build_profiles();
+        for (std::size_t i=0; i<profiles.size(); ++i)
+          if (!p.has("BUILD_PROFILE") || p.str("BUILD_PROFILE") != profiles[i])
+          {
+            result.push_back(p);
+            result.back().set("BUILD_PROFILE", profiles[i]);
+          }
+        return result;
+      }
+
+      /** @brief The launch configuration of the tutorials, built without options */
+      static parameter_set defaults()
+      {
+        parameter_set p;
+        p.set("WG", 128); p.set("GROUPS", 128); p.set("UNROLL", 1); p.set("VW", 1); p.set("BLOCKED", 0); p.set("SUBGROUPS", 0);
+        p.set("BUILD_PROFILE", "strict");
+        return p;
+      }
+
+      /** @brief Whether the configuration fits the device limits (WG must be a power of two up to 1024 for the reduction tree) */
+      bool valid(parameter_set const & p) const
+      {
+        int wg = p.value("WG");
+        int vw = p.has("VW") ? p.value("VW") : 1;
+        int blocked = p.has("BLOCKED") ? p.value("BLOCKED") : 0;
+        int subgroups = p.has("SUBGROUPS") ? p.value("SUBGROUPS") : 0;
+        return wg > 0 && wg <= 1024 && (wg & (wg - 1)) == 0 && size_t(wg) <= max_work_group_size_
+            && p.value("GROUPS") > 0 && p.value("UNROLL") > 0
+            && (vw == 1 || vw == 2 || vw == 4 || vw == 8 || vw == 16)
+            && (blocked == 0 || blocked == 1)
+            && (subgroups == 0 || (subgroups == 1 && has_subgroups_));
+      }
+
+      /** @brief 'p' specialized for vectors of length N: N becomes a compile-time constant, EXACT is set if no remainder is left */
+      static parameter_set specialized(parameter_set const & p, cl_uint N)
+      {
+        parameter_set result = p;
+        result.set("SPEC_N", std::to_string(N) + "u");
+        cl_ulong chunk = cl_ulong(p.has("VW") ? p.value("VW") : 1) * cl_ulong(p.value("UNROLL")) * cl_ulong(p.value("GROUPS")) * cl_ulong(p.value("WG"));
+        result.set("EXACT", (N % chunk == 0) ? 1 : 0);
+        return result;
+      }
+
+      /** @brief If enabled, add() and dot() launch programs specialized for the vector length of each call */
+      void specialize(bool enabled) { specialize_ = enabled; }
+      bool specialize() const { return specialize_; }
+
+      /** @brief Starts building the program for 'p' in the background */
+      void prepare(parameter_set const & p)
+      {
+        if (valid(p))
+          cache_.build_async(blas1_tuned_program_source, build_options(p));
+      }
+
+      void prepare(std::vector<parameter_set> const & configurations)
+      {
+        for (std::size_t i=0; i<configurations.size(); ++i)
+          prepare(configurations[i]);
+      }
+
+      /** @brief Whether the program for 'p' is built, i.e. launching 'p' does not wait for the compiler */
+      bool ready(parameter_set const & p) const { return cache_.ready(blas1_tuned_program_source, build_options(p)); }
+
+      /** @brief Options of the program for 'p' in the program cache: its parameters, plus the OpenCL C version for sub-groups if needed */
+      std::string build_options(parameter_set const & p) const
+      {
+        std::string options = p.build_options();
+        if (p.has("SUBGROUPS") && p.value("SUBGROUPS") == 1 && !subgroup_options_.empty())
+          options += " " + subgroup_options_;
+        return options;
+      }
+
+      /** @brief Whether the background build for 'p' has failed, i.e. add() and dot() without parameter_set never switch to it */
+      bool failed(parameter_set const & p) const { return cache_.failed(blas1_tuned_program_source, build_options(p)); }
+
+      /** @brief Sets the configuration used by add() and dot() without parameter_set as soon as it is built */
+      void prefer(parameter_set const & tuned)
+      {
+        if (!valid(tuned))
+          throw std::runtime_error("Invalid configuration for blas1_tuned_kernels: " + tuned.to_string());
+        tuned_ = tuned;
+        prepare(tuned_);
+      }
+
+      /** @brief The configuration add() and dot() without parameter_set launch for length N at this moment */
+      parameter_set const & current(cl_uint N)
+      {
+        if (specialize_)
+        {
+          specialized_ = specialized(tuned_, N);
+          if (ready(specialized_))
+            return specialized_;
+          prepare(specialized_);
+        }
+        if (ready(tuned_))
+          return tuned_;
+        return fallback_;
+      }
+
+      /** @brief x += y, with the best configuration built so far */
+      void add(cl_mem x, cl_mem y, cl_uint N, cl_event * event = NULL)
+      {
+        launch_add(x, y, N, current(N), event);
+      }
+
+      /** @brief result[result_index] = x^T y, with the best configuration built so far */
+      void dot(cl_mem x, cl_mem y, cl_mem result, cl_uint result_index, cl_uint N, cl_event * event = NULL)
+      {
+        launch_dot(x, y, result, result_index, N, current(N), event);
+      }
+
+      /** @brief x += y */
+      void add(cl_mem x, cl_mem y, cl_uint N, parameter_set const & p, cl_event * event = NULL)
+      {
+        launch_add(x, y, N, launch_parameters(p, N), event);
+      }
+
+      /** @brief result[result_index] = x^T y, reduced on the device in two kernels */
+      void dot(cl_mem x, cl_mem y, cl_mem result, cl_uint result_index, cl_uint N, parameter_set const & p, cl_event * event = NULL)
+      {
+        launch_dot(x, y, result, result_index, N, launch_parameters(p, N), event);
+      }
+
+      /** @brief Writes one partial result per work group of x^T y to 'partials' (GROUPS entries), to be summed by the caller */
+      void dot_partials(cl_mem x, cl_mem y, cl_mem partials, cl_uint N, parameter_set const & p, cl_event * event = NULL)
+      {
+        launch_dot_partials(x, y, partials, N, launch_parameters(p, N), event);
+      }
+
+      /** @brief result[result_index] = x^T y in a single kernel, work groups accumulate atomically (order and rounding vary between runs) */
+      void dot_atomic(cl_mem x, cl_mem y, cl_mem result, cl_uint result_index, cl_uint N, parameter_set const & p, cl_event * event = NULL)
+      {
+        if (!atomics_supported(ctx_))
+          throw std::runtime_error("dot_atomic() requires global int32 atomics");
+        if (!scratch_)
+        {
+          cl_uint zeros[2] = { 0, 0 };
+          scratch_ = ctx_.create_buffer(sizeof(zeros), zeros);
+        }
+
+        cl_int err;
+        parameter_set const & q = launch_parameters(p, N);
+        cl_kernel k = get_kernel(q, "vec_dot_atomic");
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&result); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 3, sizeof(cl_uint), (void*)&result_index); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 4, sizeof(cl_mem),  (void*)&scratch_); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 5, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        enqueue(k, size_t(q.value("GROUPS")) * size_t(q.value("WG")), q, event);
+      }
+
+      /** @brief result[result_index] = x^T y with the same bits for every parameter_set, see vec_dot_fixed. Two passes over x and y.
+      *
+      *  The products are rounded to multiples of 2^-(62 - log2(N)) times the largest |x_i * y_i|, which is more accurate than
+      *  a float accumulator unless the products differ by many orders of magnitude. x and y must be finite.
+      *
+      *  The scale follows from the whole vector of this call. Dot products of slices, e.g. on several devices, use their
+      *  own scales, and their sum is not reproducible; the fixed-point partials are not exposed for combining them.
+      */
+      void dot_reproducible(cl_mem x, cl_mem y, cl_mem result, cl_uint result_index, cl_uint N, parameter_set const & p, cl_event * event = NULL)
+      {
+        cl_int err;
+        parameter_set const & q = launch_parameters(p, N);
+        size_t groups = size_t(q.value("GROUPS"));
+        cl_mem max_partials   = partials_buffer(groups);
+        cl_mem fixed_partials = grow(fixed_partials_, fixed_partials_size_, groups * sizeof(cl_long));
+
+        cl_kernel k = get_kernel(q, "vec_dot_max");
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&max_partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 3, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        enqueue(k, groups * size_t(q.value("WG")), q, NULL);
+
+        k = get_kernel(q, "vec_dot_fixed");
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&max_partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 3, sizeof(cl_mem),  (void*)&fixed_partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 4, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        enqueue(k, groups * size_t(q.value("WG")), q, NULL);
+
+        k = get_kernel(q, "vec_sum_fixed");
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&fixed_partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&max_partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&result); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 3, sizeof(cl_uint), (void*)&result_index); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 4, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        enqueue(k, size_t(q.value("WG")), q, event);
+      }
+
+      /** @brief dot_atomic() requires global atomics (core since OpenCL 1.1, an extension in 1.0, where the kernel uses the atom_* names) */
+      static bool atomics_supported(context const & ctx)
+      {
+        return ctx.device_version().find("OpenCL 1.0") == std::string::npos
+            || ctx.has_extension("cl_khr_global_int32_base_atomics");
+      }
+
+    private:
+      blas1_tuned_kernels(blas1_tuned_kernels const &);
+      blas1_tuned_kernels & operator=(blas1_tuned_kernels const &);
+
+      void launch_add(cl_mem x, cl_mem y, cl_uint N, parameter_set const & p, cl_event * event)
+      {
+        cl_int err;
+        cl_kernel k = get_kernel(p, "vec_add");
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        enqueue(k, size_t(p.value("GROUPS")) * size_t(p.value("WG")), p, event);
+      }
+
+      void launch_dot_partials(cl_mem x, cl_mem y, cl_mem partials, cl_uint N, parameter_set const & p, cl_event * event)
+      {
+        cl_int err;
+        cl_kernel k = get_kernel(p, "vec_dot");
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 3, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        enqueue(k, size_t(p.value("GROUPS")) * size_t(p.value("WG")), p, event);
+      }
+
+      void launch_dot(cl_mem x, cl_mem y, cl_mem result, cl_uint result_index, cl_uint N, parameter_set const & p, cl_event * event)
+      {
+        cl_int err;
+        cl_mem partials = partials_buffer(size_t(p.value("GROUPS")));
+        launch_dot_partials(x, y, partials, N, p, NULL);
+
+        cl_kernel k = get_kernel(p, "vec_sum");
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&result); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_uint), (void*)&result_index); OPENCL_ERR_CHECK(err);
+        enqueue(k, size_t(p.value("WG")), p, event);
+      }
+
+      parameter_set const & launch_parameters(parameter_set const & p, cl_uint N)
+      {
+        if (!specialize_)
+          return p;
+        specialized_ = specialized(p, N);
+        return specialized_;
+      }
+
+      cl_kernel get_kernel(parameter_set const & p, const char * name)
+      {
+        std::string options = build_options(p);
+        std::string key = std::string(name) + " " + options;
+        kernel_map::iterator it = kernels_.find(key);
+        if (it != kernels_.end())
+          return it->second;
+        cl_kernel k = cache_.create_kernel(blas1_tuned_program_source, options, name);
+        kernels_[key] = k;
+        return k;
+      }
+
+      /** @brief x.y from a version string 'prefix x.y ...', e.g. CL_DEVICE_VERSION, or 0 if it does not start with 'prefix' */
+      static double version_number(std::string const & version, std::string const & prefix)
+      {
+        if (version.compare(0, prefix.size(), prefix) != 0)
+          return 0;
+        return std::atof(version.c_str() + prefix.size());
+      }
+
+      cl_mem partials_buffer(size_t groups) { return grow(partials_, partials_size_, groups * sizeof(float)); }
+
+      /** @brief Reallocates 'buffer' if it holds less than 'bytes' */
+      cl_mem grow(cl_mem & buffer, size_t & size, size_t bytes)
+      {
+        if (bytes > size)
+        {
+          if (buffer)
+            clReleaseMemObject(buffer);
+          buffer = ctx_.create_buffer(bytes);
+          size   = bytes;
+        }
+        return buffer;
+      }
+
+      void enqueue(cl_kernel k, size_t global_size, parameter_set const & p, cl_event * event)
+      {
+        size_t local_size = size_t(p.value("WG"));
+        cl_int err = clEnqueueNDRangeKernel(ctx_.queue(), k, 1, NULL, &global_size, &local_size, 0, NULL, event); OPENCL_ERR_CHECK(err);
+      }
+
+      program_cache & cache_;
+      context const & ctx_;
+      size_t     max_work_group_size_;
+      bool       has_subgroups_;
+      std::string subgroup_options_;   // -cl-std for cl_khr_subgroups, empty for cl_intel_subgroups
+      kernel_map kernels_;
+      cl_mem     partials_;
+      size_t     partials_size_;    // in bytes
+      cl_mem     fixed_partials_;   // fixed-point partials of dot_reproducible()
+      size_t     fixed_partials_size_;
+      cl_mem     scratch_;    // accumulator and work group counter of dot_atomic()
+      bool       specialize_;
+      parameter_set specialized_;
+      parameter_set tuned_;
+      parameter_set fallback_;
+    };
+
+  } //namespace ocl
+
+
+#endif
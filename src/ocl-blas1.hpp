@@ -0,0 +1,252 @@
+#ifndef OPENCL_BLAS1_HPP_
+#define OPENCL_BLAS1_HPP_
+
+
+/** @file ocl-blas1.hpp
+    @brief Vector operations on device vectors: vec_add and vec_dot from the tutorials, plus axpy-type updates
+
+    In contrast to vector_dot.cpp the dot product is reduced to a single value on the device (second kernel vec_sum),
+    so that iterative solvers can keep all scalars on the device. The scalars in axpy() and xpay() are read from a
+    device buffer for the same reason.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+
+  namespace ocl
+  {
+
+    // Launch configuration of the tutorials:
+    static const size_t blas1_local_size  = 128;
+    static const size_t blas1_global_size = 128*128;
+
+    static const char * blas1_program_source = ""
+    "__kernel void vec_add(__global float *x, \n"
+    "                      __global float *y, \n"
+    "                      unsigned int N) \n"
+    "{ \n"
+    "  for (unsigned int i  = get_global_id(0); \n"
+    "                    i  < N; \n"
+    "                    i += get_global_size(0)) \n"
+    "    x[i] += y[i]; \n"
+    "} \n"
+    ""
+    "__kernel void vec_dot(__global float *x, \n"
+    "                      __global float *y, \n"
+    "                      __global float *result, \n"
+    "                      unsigned int N, \n"
+    "                      __local float *shared_array) \n"
+    "{ \n"
+    "  float thread_result = 0; \n"
+    "  for (unsigned int i  = get_global_id(0); \n"
+    "                    i  < N; \n"
+    "                    i += get_global_size(0)) \n"
+    "    thread_result += x[i] * y[i]; \n"
+    ""
+    "  shared_array[get_local_id(0)] = thread_result; \n"
+    "  for (uint stride=get_local_size(0)/2; stride > 0; stride /= 2) \n"
+    "  { \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "    if (get_local_id(0) < stride) \n"
+    "      shared_array[get_local_id(0)] += shared_array[get_local_id(0) + stride]; \n"
+    "  } \n"
+    ""
+    "  if (get_local_id(0) == 0) \n"
+    "    result[get_group_id(0)] = shared_array[0]; \n"
+    "} \n"
+    ""
+    "// Sums the partial results of vec_dot. Launched with a single work group. \n"
+    "__kernel void vec_sum(__global float *partials, \n"
+    "                      unsigned int num_partials, \n"
+    "                      __global float *result, \n"
+    "                      unsigned int result_index, \n"
+    "                      __local float *shared_array) \n"
+    "{ \n"
+    "  float thread_result = 0; \n"
+    "  for (unsigned int i = get_local_id(0); i < num_partials; i += get_local_size(0)) \n"
+    "    thread_result += partials[i]; \n"
+    ""
+    "  shared_array[get_local_id(0)] = thread_result; \n"
+    "  for (uint stride=get_local_size(0)/2; stride > 0; stride /= 2) \n"
+    "  { \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "    if (get_local_id(0) < stride) \n"
+    "      shared_array[get_local_id(0)] += shared_array[get_local_id(0) + stride]; \n"
+    "  } \n"
+    ""
+    "  if (get_local_id(0) == 0) \n"
+    "    result[result_index] = shared_array[0]; \n"
+    "} \n"
+    ""
+    "// alpha = sign * scalars[num] / scalars[den], zero if the denominator vanishes \n"
+    "float device_scalar(__global const float *scalars, unsigned int num, unsigned int den, float sign) \n"
+    "{ \n"
+    "  float d = scalars[den]; \n"
+    "  return (d != 0) ? sign * scalars[num] / d : 0; \n"
+    "} \n"
+    ""
+    "// y += alpha * x \n"
+    "__kernel void axpy(__global float *y, \n"
+    "                   __global const float *x, \n"
+    "                   __global const float *scalars, \n"
+    "                   unsigned int num, \n"
+    "                   unsigned int den, \n"
+    "                   float sign, \n"
+    "                   unsigned int N) \n"
+    "{ \n"
+    "  float alpha = device_scalar(scalars, num, den, sign); \n"
+    "  for (unsigned int i  = get_global_id(0); \n"
+    "                    i  < N; \n"
+    "                    i += get_global_size(0)) \n"
+    "    y[i] += alpha * x[i]; \n"
+    "} \n"
+    ""
+    "// y = x + alpha * y \n"
+    "__kernel void xpay(__global float *y, \n"
+    "                   __global const float *x, \n"
+    "                   __global const float *scalars, \n"
+    "                   unsigned int num, \n"
+    "                   unsigned int den, \n"
+    "                   float sign, \n"
+    "                   unsigned int N) \n"
+    "{ \n"
+    "  float alpha = device_scalar(scalars, num, den, sign); \n"
+    "  for (unsigned int i  = get_global_id(0); \n"
+    "                    i  < N; \n"
+    "                    i += get_global_size(0)) \n"
+    "    y[i] = x[i] + alpha * y[i]; \n"
+    "} \n";
+
+
+    /** @brief Holds the compiled vector kernels and launches them with the tutorial launch configuration.
+    *
+    *  All member functions only enqueue work. If 'event' is non-NULL, it receives the event of the (last) kernel launched.
+    */
+    class blas1_kernels
+    {
+    public:
+      explicit blas1_kernels(context const & ctx) : ctx_(ctx)
+      {
+        cl_int err;
+        prog_     = ctx_.build_program(blas1_program_source);
+        vec_add_  = clCreateKernel(prog_, "vec_add", &err); OPENCL_ERR_CHECK(err);
+        vec_dot_  = clCreateKernel(prog_, "vec_dot", &err); OPENCL_ERR_CHECK(err);
+        vec_sum_  = clCreateKernel(prog_, "vec_sum", &err); OPENCL_ERR_CHECK(err);
+        axpy_     = clCreateKernel(prog_, "axpy", &err); OPENCL_ERR_CHECK(err);
+        xpay_     = clCreateKernel(prog_, "xpay", &err); OPENCL_ERR_CHECK(err);
+        partials_ = ctx_.create_buffer(num_partials() * sizeof(float));
+      }
+
+      ~blas1_kernels()
+      {
+        clReleaseMemObject(partials_);
+        clReleaseKernel(vec_add_);
+        clReleaseKernel(vec_dot_);
+        clReleaseKernel(vec_sum_);
+        clReleaseKernel(axpy_);
+        clReleaseKernel(xpay_);
+        clReleaseProgram(prog_);
+      }
+
+      static cl_uint num_partials() { return cl_uint(blas1_global_size / blas1_local_size); }
+
+      /** @brief x += y */
+      void add(cl_mem x, cl_mem y, cl_uint N, cl_event * event = NULL)
+      {
+        cl_int err;
+        err = clSetKernelArg(vec_add_, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_add_, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_add_, 2, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        enqueue(vec_add_, blas1_global_size, event);
+      }
+
+      /** @brief Writes one partial result per work group of x^T y to 'partials' (num_partials() entries) */
+      void dot_partials(cl_mem x, cl_mem y, cl_mem partials, cl_uint N, cl_event * event = NULL)
+      {
+        cl_int err;
+        err = clSetKernelArg(vec_dot_, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_dot_, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_dot_, 2, sizeof(cl_mem),  (void*)&partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_dot_, 3, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_dot_, 4, sizeof(float) * blas1_local_size, NULL); OPENCL_ERR_CHECK(err);
+        enqueue(vec_dot_, blas1_global_size, event);
+      }
+
+      /** @brief result[result_index] = sum of the first 'n' entries of 'partials'. Launched with a single work group. */
+      void sum(cl_mem partials, cl_uint n, cl_mem result, cl_uint result_index, cl_event * event = NULL)
+      {
+        cl_int err;
+        err = clSetKernelArg(vec_sum_, 0, sizeof(cl_mem),  (void*)&partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_sum_, 1, sizeof(cl_uint), (void*)&n); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_sum_, 2, sizeof(cl_mem),  (void*)&result); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_sum_, 3, sizeof(cl_uint), (void*)&result_index); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_sum_, 4, sizeof(float) * blas1_local_size, NULL); OPENCL_ERR_CHECK(err);
+        enqueue(vec_sum_, blas1_local_size, event);
+      }
+
+      /** @brief result[result_index] = x^T y, computed entirely on the device */
+      void dot(cl_mem x, cl_mem y, cl_mem result, cl_uint result_index, cl_uint N, cl_event * event = NULL)
+      {
+        dot_partials(x, y, partials_, N);
+        sum(partials_, num_partials(), result, result_index, event);
+      }
+
+      /** @brief y += sign * scalars[num] / scalars[den] * x */
+      void axpy(cl_mem y, cl_mem x, cl_mem scalars, cl_uint num, cl_uint den, float sign, cl_uint N, cl_event * event = NULL)
+      {
+        set_update_args(axpy_, y, x, scalars, num, den, sign, N);
+        enqueue(axpy_, blas1_global_size, event);
+      }
+
+      /** @brief y = x + sign * scalars[num] / scalars[den] * y */
+      void xpay(cl_mem y, cl_mem x, cl_mem scalars, cl_uint num, cl_uint den, float sign, cl_uint N, cl_event * event = NULL)
+      {
+        set_update_args(xpay_, y, x, scalars, num, den, sign, N);
+        enqueue(xpay_, blas1_global_size, event);
+      }
+
+    private:
+      blas1_kernels(blas1_kernels const &);
+      blas1_kernels & operator=(blas1_kernels const &);
+
+      void set_update_args(cl_kernel k, cl_mem y, cl_mem x, cl_mem scalars, cl_uint num, cl_uint den, float sign, cl_uint N)
+      {
+        cl_int err;
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&scalars); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 3, sizeof(cl_uint), (void*)&num); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 4, sizeof(cl_uint), (void*)&den); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 5, sizeof(float),   (void*)&sign); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 6, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+      }
+
+      void enqueue(cl_kernel k, size_t global_size, cl_event * event)
+      {
+        size_t local_size = blas1_local_size;
+        cl_int err = clEnqueueNDRangeKernel(ctx_.queue(), k, 1, NULL, &global_size, &local_size, 0, NULL, event); OPENCL_ERR_CHECK(err);
+      }
+
+      context const & ctx_;
+      cl_program prog_;
+      cl_kernel  vec_add_;
+      cl_kernel  vec_dot_;
+      cl_kernel  vec_sum_;
+      cl_kernel  axpy_;
+      cl_kernel  xpay_;
+      cl_mem     partials_;
+    };
+
+  } //namespace ocl
+
+
+#endif
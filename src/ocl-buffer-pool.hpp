@@ -0,0 +1,197 @@
+#ifndef OPENCL_BUFFER_POOL_HPP_
+#define OPENCL_BUFFER_POOL_HPP_
+
+
+/** @file ocl-buffer-pool.hpp
+    @brief Caching allocator for device buffers, avoiding a clCreateBuffer/clReleaseMemObject pair per temporary
+
+    Requests are rounded up to power-of-two size classes. Released buffers are kept in a free list per size class
+    and handed out again for the next request of the same class. Optionally, small buffers are carved out of large
+    arena buffers with clCreateSubBuffer, so that many small vectors share one device allocation.
+
+    Buffers released to the pool may be handed out again right away, even if commands using them are still
+    enqueued. This is safe as long as all users enqueue to the same in-order command queue. The pool is not thread-safe.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <map>
+#include <algorithm>
+#include <vector>
+#include <iostream>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+
+  namespace ocl
+  {
+
+    struct buffer_pool_statistics
+    {
+      buffer_pool_statistics() : hits(0), misses(0), device_allocations(0), bytes_in_use(0), peak_bytes_in_use(0), bytes_allocated(0) {}
+
+      std::size_t hits;                // requests served from a free list
+      std::size_t misses;              // requests that needed a new buffer or sub-buffer
+      std::size_t device_allocations;  // calls to clCreateBuffer
+      std::size_t bytes_in_use;        // size classes currently handed out
+      std::size_t peak_bytes_in_use;
+      std::size_t bytes_allocated;     // total device memory held by the pool (in use + cached + arenas)
+
+      void print(std::ostream & os) const
+      {
+        os << "hits: " << hits << ", misses: " << misses << ", clCreateBuffer calls: " << device_allocations
+           << ", in use: " << bytes_in_use << " B, peak: " << peak_bytes_in_use << " B, held: " << bytes_allocated << " B";
+      }
+    };
+
+
+    class buffer_pool
+    {
+      typedef std::map<std::size_t, std::vector<cl_mem> >  free_list_map;
+      typedef std::map<cl_mem, std::size_t>                size_map;
+
+    public:
+      /** @param sub_buffer_limit   Requests up to this size are carved out of arenas with clCreateSubBuffer. 0 disables sub-buffers.
+      *   @param arena_size         Size of each arena buffer.
+      */
+      explicit buffer_pool(context const & ctx, std::size_t sub_buffer_limit = 0, std::size_t arena_size = 16*1024*1024)
+        : ctx_(ctx), sub_buffer_limit_(sub_buffer_limit), arena_size_(arena_size), arena_offset_(0)
+      {
+        cl_uint align_bits;
+        cl_int err = clGetDeviceInfo(ctx_.device(), CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &align_bits, NULL); OPENCL_ERR_CHECK(err);
+        alignment_ = std::max<std::size_t>(align_bits / 8, 1);
+        if (sub_buffer_limit_ > arena_size_)
+          sub_buffer_limit_ = arena_size_;
+      }
+
+      ~buffer_pool()
+      {
+        for (free_list_map::iterator it = free_lists_.begin(); it != free_lists_.end(); ++it)
+          for (std::size_t i=0; i<it->second.size(); ++i)
+            clReleaseMemObject(it->second[i]);
+        for (size_map::iterator it = in_use_.begin(); it != in_use_.end(); ++it)
+          clReleaseMemObject(it->first);
+        for (std::size_t i=0; i<arenas_.size(); ++i)
+          clReleaseMemObject(arenas_[i]);
+      }
+
+      /** @brief Returns a buffer of at least 'num_bytes' bytes. Its contents are undefined. */
+      cl_mem allocate(std::size_t num_bytes)
+      {
+        std::size_t size_class = round_up(num_bytes);
+
+        cl_mem buf;
+        std::vector<cl_mem> & free_list = free_lists_[size_class];
+        if (free_list.size())
+        {
+          buf = free_list.back();
+          free_list.pop_back();
+          ++stats_.hits;
+        }
+        else
+        {
+          buf = (size_class <= sub_buffer_limit_) ? create_sub_buffer(size_class) : create_buffer(size_class);
+          ++stats_.misses;
+        }
+
+        in_use_[buf] = size_class;
+        stats_.bytes_in_use += size_class;
+        stats_.peak_bytes_in_use = std::max(stats_.peak_bytes_in_use, stats_.bytes_in_use);
+        return buf;
+      }
+
+      /** @brief Returns a buffer obtained from allocate() to the pool */
+      void release(cl_mem buf)
+      {
+        size_map::iterator it = in_use_.find(buf);
+        if (it == in_use_.end())
+        {
+          std::cerr << "buffer_pool: release of a buffer not owned by the pool" << std::endl;
+          return;
+        }
+        free_lists_[it->second].push_back(buf);
+        stats_.bytes_in_use -= it->second;
+        in_use_.erase(it);
+      }
+
+      /** @brief Releases all cached whole buffers to the OpenCL runtime.
+      *
+      *  Cached sub-buffers stay on their free lists: they hold no device memory besides their arena, and arena regions
+      *  are never handed out twice, so releasing them would only make later requests carve new regions and arenas.
+      */
+      void trim()
+      {
+        for (free_list_map::iterator it = free_lists_.begin(); it != free_lists_.end(); ++it)
+        {
+          if (it->first <= sub_buffer_limit_)
+            continue;
+          for (std::size_t i=0; i<it->second.size(); ++i)
+          {
+            clReleaseMemObject(it->second[i]);
+            stats_.bytes_allocated -= it->first;
+          }
+          it->second.clear();
+        }
+      }
+
+      buffer_pool_statistics const & statistics() const { return stats_; }
+
+      /** @brief The size class a request of 'num_bytes' is rounded up to: the next power of two, at least the device base address alignment */
+      std::size_t round_up(std::size_t num_bytes) const
+      {
+        std::size_t size_class = alignment_;
+        while (size_class < num_bytes)
+          size_class *= 2;
+        return size_class;
+      }
+
+    private:
+      buffer_pool(buffer_pool const &);
+      buffer_pool & operator=(buffer_pool const &);
+
+      cl_mem create_buffer(std::size_t num_bytes)
+      {
+        ++stats_.device_allocations;
+        stats_.bytes_allocated += num_bytes;
+        return ctx_.create_buffer(num_bytes);
+      }
+
+      cl_mem create_sub_buffer(std::size_t size_class)
+      {
+        if (arenas_.empty() || arena_offset_ + size_class > arena_size_)
+        {
+          arenas_.push_back(create_buffer(arena_size_));
+          arena_offset_ = 0;
+        }
+
+        // size classes are multiples of the base address alignment, hence all offsets are properly aligned:
+        cl_buffer_region region;
+        region.origin = arena_offset_;
+        region.size   = size_class;
+        arena_offset_ += size_class;
+
+        cl_int err;
+        cl_mem buf = clCreateSubBuffer(arenas_.back(), CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &err); OPENCL_ERR_CHECK(err);
+        return buf;
+      }
+
+      context const & ctx_;
+      std::size_t     alignment_;
+      std::size_t     sub_buffer_limit_;
+      std::size_t     arena_size_;
+      std::size_t     arena_offset_;
+      std::vector<cl_mem> arenas_;
+      free_list_map   free_lists_;
+      size_map        in_use_;
+      buffer_pool_statistics stats_;
+    };
+
+  } //namespace ocl
+
+
+#endif
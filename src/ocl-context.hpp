@@ -0,0 +1,139 @@
+#ifndef OPENCL_CONTEXT_HPP_
+#define OPENCL_CONTEXT_HPP_
+
+
+/** @file ocl-context.hpp
+    @brief Bundles platform, device, context and command queue setup (Part 1 of the tutorials) into one object
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "ocl-error.hpp"
+
+  namespace ocl
+  {
+
+    /** @brief Sets up an OpenCL context with one device and one in-order command queue.
+    *
+    *  Equivalent to 'Part 1' of vector_add.cpp and vector_dot.cpp. All resources are released in the destructor.
+    */
+    class context
+    {
+    public:
+      explicit context(cl_command_queue_properties queue_properties = 0,
+                       cl_uint platform_index = 0,
+                       cl_uint device_index = 0)
+      {
+        cl_int err;
+
+        cl_uint num_platforms;
+        cl_platform_id platform_ids[42];   //no more than 42 platforms supported...
+        err = clGetPlatformIDs(42, platform_ids, &num_platforms); OPENCL_ERR_CHECK(err);
+        if (platform_index >= num_platforms)
+          platform_index = 0;
+        platform_ = platform_ids[platform_index];
+
+        cl_device_id device_ids[42];
+        cl_uint num_devices;
+        err = clGetDeviceIDs(platform_, CL_DEVICE_TYPE_ALL, 42, device_ids, &num_devices); OPENCL_ERR_CHECK(err);
+        if (device_index >= num_devices)
+          device_index = 0;
+        device_ = device_ids[device_index];
+
+        context_ = clCreateContext(0, 1, &device_, NULL, NULL, &err); OPENCL_ERR_CHECK(err);
+        queue_   = clCreateCommandQueue(context_, device_, queue_properties, &err); OPENCL_ERR_CHECK(err);
+      }
+
+      ~context()
+      {
+        clReleaseCommandQueue(queue_);
+        clReleaseContext(context_);
+      }
+
+      cl_platform_id   platform() const { return platform_; }
+      cl_device_id     device()   const { return device_; }
+      cl_context       handle()   const { return context_; }
+      cl_command_queue queue()    const { return queue_; }
+
+      /** @brief Builds the supplied sources for the device. Prints the build log and throws on failure. */
+      cl_program build_program(const char * source, std::string const & options = std::string()) const
+      {
+        cl_int err;
+        size_t source_len = std::string(source).length();
+        cl_program prog = clCreateProgramWithSource(context_, 1, &source, &source_len, &err); OPENCL_ERR_CHECK(err);
+        err = clBuildProgram(prog, 1, &device_, options.c_str(), NULL, NULL);
+        if (err != CL_SUCCESS)
+        {
+          char buffer[8192];
+          cl_build_status status;
+          clGetProgramBuildInfo(prog, device_, CL_PROGRAM_BUILD_STATUS, sizeof(cl_build_status), &status, NULL);
+          clGetProgramBuildInfo(prog, device_, CL_PROGRAM_BUILD_LOG,    sizeof(char)*8192, &buffer, NULL);
+          std::cout << "Build Scalar: Err = " << err << " Status = " << status << std::endl;
+          std::cout << "Options: " << options << std::endl;
+          std::cout << "Log: " << buffer << std::endl;
+          std::cout << "Sources: " << source << std::endl;
+        }
+        OPENCL_ERR_CHECK(err);
+        return prog;
+      }
+
+      /** @brief Creates a device buffer of the given size in bytes. If 'host_ptr' is non-NULL, its contents are copied over (unless 'flags' contains CL_MEM_USE_HOST_PTR). */
+      cl_mem create_buffer(size_t num_bytes, void * host_ptr = NULL, cl_mem_flags flags = CL_MEM_READ_WRITE) const
+      {
+        cl_int err;
+        if (host_ptr && !(flags & CL_MEM_USE_HOST_PTR))
+          flags |= CL_MEM_COPY_HOST_PTR;
+        cl_mem buf = clCreateBuffer(context_, flags, num_bytes, host_ptr, &err); OPENCL_ERR_CHECK(err);
+        return buf;
+      }
+
+      std::string device_name()       const { return device_info_string(CL_DEVICE_NAME); }
+      std::string device_version()    const { return device_info_string(CL_DEVICE_VERSION); }
+      std::string opencl_c_version()  const { return device_info_string(CL_DEVICE_OPENCL_C_VERSION); }
+      std::string device_extensions() const { return device_info_string(CL_DEVICE_EXTENSIONS); }
+      std::string driver_version()    const { return device_info_string(CL_DRIVER_VERSION); }
+
+      bool has_extension(std::string const & name) const
+      {
+        return (" " + device_extensions() + " ").find(" " + name + " ") != std::string::npos;
+      }
+
+      cl_device_type device_type() const
+      {
+        cl_device_type type;
+        cl_int err = clGetDeviceInfo(device_, CL_DEVICE_TYPE, sizeof(cl_device_type), &type, NULL); OPENCL_ERR_CHECK(err);
+        return type;
+      }
+
+    private:
+      context(context const &);
+      context & operator=(context const &);
+
+      std::string device_info_string(cl_device_info param) const
+      {
+        size_t len = 0;
+        cl_int err = clGetDeviceInfo(device_, param, 0, NULL, &len); OPENCL_ERR_CHECK(err);
+        std::vector<char> buffer(len + 1, '\0');
+        err = clGetDeviceInfo(device_, param, len, &(buffer[0]), NULL); OPENCL_ERR_CHECK(err);
+        return std::string(&(buffer[0]));
+      }
+
+      cl_platform_id   platform_;
+      cl_device_id     device_;
+      cl_context       context_;
+      cl_command_queue queue_;
+    };
+
+  } //namespace ocl
+
+
+#endif
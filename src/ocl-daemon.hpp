@@ -0,0 +1,458 @@
+#ifndef OPENCL_DAEMON_HPP_
+#define OPENCL_DAEMON_HPP_
+
+
+/** @file ocl-daemon.hpp
+    @brief Persistent compute server for vec_add/vec_dot: context, queue, programs and buffer pool are set up once
+
+    Clients connect through a Unix domain socket. The vectors of a request live in a memfd created by the client
+    (see shared_vectors), whose file descriptor is passed along with the request (SCM_RIGHTS), so no payload is copied
+    through the socket. If the device shares memory with the host, the server uses the mapped memfd as storage of its
+    buffers (CL_MEM_USE_HOST_PTR), otherwise it copies to and from pooled device buffers.
+
+    The server only maps a memfd that is sealed against shrinking (F_SEAL_SHRINK) and large enough for the N in the
+    request, so a client cannot make it access pages past the end of the file (SIGBUS).
+
+    Requests are handled one at a time in the order they arrive. Linux only (memfd_create).
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <stdexcept>
+#include <stdint.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-buffer-pool.hpp"
+
+  namespace ocl
+  {
+
+    static const char * daemon_default_socket = "/tmp/ocl-compute-daemon.sock";
+
+    enum daemon_operation
+    {
+      daemon_add      = 1,   // x += y, result written to the x part of the memfd
+      daemon_dot      = 2,   // returns x^T y
+      daemon_shutdown = 3
+    };
+
+    struct daemon_request
+    {
+      uint32_t operation;
+      uint32_t reserved;
+      uint64_t N;
+    };
+
+    struct daemon_response
+    {
+      int32_t status;     // 0 on success
+      float   value;      // result of daemon_dot
+    };
+
+
+    namespace detail
+    {
+      inline void throw_errno(std::string const & what)
+      {
+        throw std::runtime_error(what + ": " + std::strerror(errno));
+      }
+
+      /** @brief Sends 'num_bytes' from 'msg' over a Unix domain socket, along with file descriptor 'fd' if it is non-negative */
+      inline void send_message(int sock, void const * msg, std::size_t num_bytes, int fd = -1)
+      {
+        struct iovec iov;
+        iov.iov_base = const_cast<void *>(msg);
+        iov.iov_len  = num_bytes;
+
+        char control[CMSG_SPACE(sizeof(int))];
+        struct msghdr header;
+        std::memset(&header, 0, sizeof(header));
+        header.msg_iov    = &iov;
+        header.msg_iovlen = 1;
+        if (fd >= 0)
+        {
+          std::memset(control, 0, sizeof(control));
+          header.msg_control    = control;
+          header.msg_controllen = sizeof(control);
+          struct cmsghdr * cmsg = CMSG_FIRSTHDR(&header);
+          cmsg->cmsg_level = SOL_SOCKET;
+          cmsg->cmsg_type  = SCM_RIGHTS;
+          cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+          std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        }
+
+        if (sendmsg(sock, &header, MSG_NOSIGNAL) != ssize_t(num_bytes))   // no SIGPIPE if the peer is gone
+          throw_errno("sendmsg failed");
+      }
+
+      /** @brief Receives 'num_bytes' into 'msg'. Returns false if the peer closed the connection. A passed file descriptor is stored in 'fd', otherwise 'fd' is set to -1. */
+      inline bool receive_message(int sock, void * msg, std::size_t num_bytes, int & fd)
+      {
+        struct iovec iov;
+        iov.iov_base = msg;
+        iov.iov_len  = num_bytes;
+
+        char control[CMSG_SPACE(sizeof(int))];
+        struct msghdr header;
+        std::memset(&header, 0, sizeof(header));
+        header.msg_iov        = &iov;
+        header.msg_iovlen     = 1;
+        header.msg_control    = control;
+        header.msg_controllen = sizeof(control);
+
+        fd = -1;
+        ssize_t received = recvmsg(sock, &header, MSG_WAITALL);
+        if (received == 0)
+          return false;
+        if (received != ssize_t(num_bytes))
+          throw_errno("recvmsg failed");
+
+        for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(&header); cmsg; cmsg = CMSG_NXTHDR(&header, cmsg))
+          if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        return true;
+      }
+
+      inline sockaddr_un socket_address(std::string const & path)
+      {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+          throw std::runtime_error("Socket path too long: " + path);
+        std::strcpy(address.sun_path, path.c_str());
+        return address;
+      }
+    }
+
+
+    /** @brief Two vectors x and y of N floats in one memfd, shared between client and server. y starts at a page boundary.
+    *
+    *  The size of the memfd is sealed, as required by compute_daemon.
+    */
+    class shared_vectors
+    {
+    public:
+      explicit shared_vectors(std::size_t N) : N_(N), bytes_(total_bytes(N))
+      {
+        fd_ = memfd_create("ocl-shared-vectors", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd_ < 0)
+          detail::throw_errno("memfd_create failed");
+        if (ftruncate(fd_, off_t(bytes_)) != 0)
+          detail::throw_errno("ftruncate failed");
+        if (fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)
+          detail::throw_errno("sealing the memfd failed");
+        mapping_ = mmap(NULL, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (mapping_ == MAP_FAILED)
+          detail::throw_errno("mmap failed");
+      }
+
+      ~shared_vectors()
+      {
+        munmap(mapping_, bytes_);
+        close(fd_);
+      }
+
+      std::size_t size() const { return N_; }
+      int         fd()   const { return fd_; }
+
+      float * x() { return static_cast<float *>(mapping_); }
+      float * y() { return reinterpret_cast<float *>(static_cast<char *>(mapping_) + y_offset(N_)); }
+
+      static std::size_t y_offset(std::size_t N)    { return (N * sizeof(float) + 4095) / 4096 * 4096; }
+      static std::size_t total_bytes(std::size_t N) { return y_offset(N) + std::max<std::size_t>(N * sizeof(float), 1); }
+
+    private:
+      shared_vectors(shared_vectors const &);
+      shared_vectors & operator=(shared_vectors const &);
+
+      std::size_t N_;
+      std::size_t bytes_;
+      int         fd_;
+      void *      mapping_;
+    };
+
+
+    /** @brief The server. run() blocks until a client sends daemon_shutdown. */
+    class compute_daemon
+    {
+    public:
+      compute_daemon(context const & ctx, std::string const & socket_path = daemon_default_socket)
+        : ctx_(ctx), kernels_(ctx), pool_(ctx, 64*1024), socket_path_(socket_path), requests_(0)
+      {
+        cl_bool unified;
+        cl_int err = clGetDeviceInfo(ctx_.device(), CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool), &unified, NULL); OPENCL_ERR_CHECK(err);
+        zero_copy_ = (unified == CL_TRUE);
+
+        sockaddr_un address = detail::socket_address(socket_path_);
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0)
+          detail::throw_errno("socket failed");
+        unlink(socket_path_.c_str());
+        if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+          detail::throw_errno("bind to " + socket_path_ + " failed");
+        if (listen(listen_fd_, 16) != 0)
+          detail::throw_errno("listen failed");
+      }
+
+      ~compute_daemon()
+      {
+        close(listen_fd_);
+        unlink(socket_path_.c_str());
+      }
+
+      bool zero_copy() const { return zero_copy_; }
+      std::size_t requests() const { return requests_; }
+      buffer_pool const & pool() const { return pool_; }
+
+      void run()
+      {
+        bool shutdown = false;
+        while (!shutdown)
+        {
+          int connection = accept(listen_fd_, NULL, NULL);
+          if (connection < 0)
+          {
+            if (errno == EINTR)
+              continue;
+            detail::throw_errno("accept failed");
+          }
+
+          daemon_request request;
+          int fd;
+          try
+          {
+            while (!shutdown && detail::receive_message(connection, &request, sizeof(request), fd))
+            {
+              daemon_response response = handle(request, fd);
+              if (fd >= 0)
+                close(fd);
+              detail::send_message(connection, &response, sizeof(response));
+              shutdown = (request.operation == daemon_shutdown);
+            }
+          }
+          catch (std::exception const & e)
+          {
+            std::cerr << "compute_daemon: dropping connection: " << e.what() << std::endl;
+          }
+          close(connection);
+        }
+      }
+
+    private:
+      compute_daemon(compute_daemon const &);
+      compute_daemon & operator=(compute_daemon const &);
+
+      daemon_response handle(daemon_request const & request, int fd)
+      {
+        daemon_response response;
+        response.status = 0;
+        response.value  = 0;
+        ++requests_;
+
+        if (request.operation == daemon_shutdown)
+          return response;
+
+        if (fd < 0 || (request.operation != daemon_add && request.operation != daemon_dot) || request.N > 0xFFFFFFFFul)
+        {
+          response.status = -1;
+          return response;
+        }
+
+        // the file must not be able to shrink below the mapped range while the request is processed:
+        std::size_t bytes = shared_vectors::total_bytes(request.N);
+        int seals = fcntl(fd, F_GET_SEALS);
+        struct stat file_status;
+        if (seals < 0 || !(seals & F_SEAL_SHRINK) || fstat(fd, &file_status) != 0 || file_status.st_size < 0
+            || std::size_t(file_status.st_size) < bytes)
+        {
+          response.status = -1;
+          return response;
+        }
+
+        void * mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+          response.status = -1;
+          return response;
+        }
+
+        try
+        {
+          response.value = compute(request, static_cast<char *>(mapping));
+        }
+        catch (std::exception const & e)
+        {
+          std::cerr << "compute_daemon: request failed: " << e.what() << std::endl;
+          response.status = -1;
+        }
+        munmap(mapping, bytes);   // compute() has waited for all commands accessing the mapping, also on failure
+        return response;
+      }
+
+      /** @brief Device buffers of one request. Waits for the queue before releasing them, also if the request failed. */
+      struct request_buffers
+      {
+        explicit request_buffers(compute_daemon & d) : daemon(d), x(NULL), y(NULL), result(NULL) {}
+
+        ~request_buffers()
+        {
+          clFinish(daemon.ctx_.queue());   // no command may still access the buffers or the mapped memfd
+          if (daemon.zero_copy_)
+          {
+            if (x) clReleaseMemObject(x);
+            if (y) clReleaseMemObject(y);
+          }
+          else
+          {
+            if (x) daemon.pool_.release(x);
+            if (y) daemon.pool_.release(y);
+          }
+          if (result)
+            daemon.pool_.release(result);
+        }
+
+        compute_daemon & daemon;
+        cl_mem x;
+        cl_mem y;
+        cl_mem result;
+
+      private:
+        request_buffers(request_buffers const &);
+        request_buffers & operator=(request_buffers const &);
+      };
+
+      float compute(daemon_request const & request, char * mapping)
+      {
+        cl_int err;
+        cl_uint N = cl_uint(request.N);
+        std::size_t vector_bytes = std::max<std::size_t>(N * sizeof(float), 1);
+        char * x_ptr = mapping;
+        char * y_ptr = mapping + shared_vectors::y_offset(N);
+
+        float value = 0;   // declared before 'buffers', so it outlives a pending read into it
+        request_buffers buffers(*this);
+        cl_mem & x = buffers.x;
+        cl_mem & y = buffers.y;
+        if (zero_copy_)
+        {
+          x = ctx_.create_buffer(vector_bytes, x_ptr, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR);
+          y = ctx_.create_buffer(vector_bytes, y_ptr, CL_MEM_READ_ONLY  | CL_MEM_USE_HOST_PTR);
+        }
+        else
+        {
+          x = pool_.allocate(vector_bytes);
+          y = pool_.allocate(vector_bytes);
+          err = clEnqueueWriteBuffer(ctx_.queue(), x, CL_FALSE, 0, vector_bytes, x_ptr, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+          err = clEnqueueWriteBuffer(ctx_.queue(), y, CL_FALSE, 0, vector_bytes, y_ptr, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+        }
+
+        if (request.operation == daemon_add)
+        {
+          kernels_.add(x, y, N);
+          if (zero_copy_)
+          {
+            // mapping makes the host pages (i.e. the memfd) up to date:
+            void * ptr = clEnqueueMapBuffer(ctx_.queue(), x, CL_TRUE, CL_MAP_READ, 0, vector_bytes, 0, NULL, NULL, &err); OPENCL_ERR_CHECK(err);
+            err = clEnqueueUnmapMemObject(ctx_.queue(), x, ptr, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+          }
+          else
+          {
+            err = clEnqueueReadBuffer(ctx_.queue(), x, CL_FALSE, 0, vector_bytes, x_ptr, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+          }
+        }
+        else
+        {
+          buffers.result = pool_.allocate(sizeof(float));
+          kernels_.dot(x, y, buffers.result, 0, N);
+          err = clEnqueueReadBuffer(ctx_.queue(), buffers.result, CL_FALSE, 0, sizeof(float), &value, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+        }
+        err = clFinish(ctx_.queue()); OPENCL_ERR_CHECK(err);
+        return value;
+      }
+
+      context const & ctx_;
+      blas1_kernels   kernels_;
+      buffer_pool     pool_;
+      std::string     socket_path_;
+      int             listen_fd_;
+      bool            zero_copy_;
+      std::size_t     requests_;
+    };
+
+
+    /** @brief Connection to a compute_daemon. All calls block until the server has answered. */
+    class daemon_client
+    {
+    public:
+      explicit daemon_client(std::string const & socket_path = daemon_default_socket)
+      {
+        sockaddr_un address = detail::socket_address(socket_path);
+        fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd_ < 0)
+          detail::throw_errno("socket failed");
+        if (connect(fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        {
+          close(fd_);
+          detail::throw_errno("Cannot connect to compute daemon at " + socket_path);
+        }
+      }
+
+      ~daemon_client() { close(fd_); }
+
+      /** @brief v.x() += v.y() */
+      void add(shared_vectors & v) { call(daemon_add, v.size(), v.fd()); }
+
+      /** @brief Returns v.x()^T v.y() */
+      float dot(shared_vectors & v) { return call(daemon_dot, v.size(), v.fd()).value; }
+
+      /** @brief Stops the server after this request */
+      void shutdown() { call(daemon_shutdown, 0, -1); }
+
+    private:
+      daemon_client(daemon_client const &);
+      daemon_client & operator=(daemon_client const &);
+
+      daemon_response call(uint32_t operation, std::size_t N, int fd)
+      {
+        daemon_request request;
+        request.operation = operation;
+        request.reserved  = 0;
+        request.N         = N;
+        detail::send_message(fd_, &request, sizeof(request), fd);
+
+        daemon_response response;
+        int unused_fd;
+        if (!detail::receive_message(fd_, &response, sizeof(response), unused_fd))
+          throw std::runtime_error("Compute daemon closed the connection");
+        if (response.status != 0)
+          throw std::runtime_error("Compute daemon failed to process the request");
+        return response;
+      }
+
+      int fd_;
+    };
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,303 @@
+#ifndef OPENCL_DENSE_HPP_
+#define OPENCL_DENSE_HPP_
+
+
+/** @file ocl-dense.hpp
+    @brief Dense matrix-vector (GEMV) and matrix-matrix (GEMM) products with tunable kernel parameters
+
+    GEMV is bandwidth-bound like vec_add/vec_dot, while the local-memory tiled, register-blocked GEMM is compute-bound.
+    The kernel parameters are macros supplied through a parameter_set (see ocl-tuner.hpp):
+     - GEMV:  GEMV_WG   work group size
+     - GEMM:  TILE_M, TILE_N, TILE_K  tile of C computed by a work group and the depth of the tiles kept in local memory
+              WPT_M, WPT_N            entries of C computed per work item (register blocking)
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-program-cache.hpp"
+#include "ocl-tuner.hpp"
+
+  namespace ocl
+  {
+
+    static const char * gemv_program_source = ""
+    "// y = A*x with A stored row-major (M rows, N columns). One work group per row, reduced as in vec_dot. \n"
+    "__kernel __attribute__((reqd_work_group_size(GEMV_WG, 1, 1))) \n"
+    "void gemv_row_major(__global const float *A, \n"
+    "                    __global const float *x, \n"
+    "                    __global float *y, \n"
+    "                    unsigned int M, \n"
+    "                    unsigned int N) \n"
+    "{ \n"
+    "  __local float shared_array[GEMV_WG]; \n"
+    "  for (unsigned int row = get_group_id(0); row < M; row += get_num_groups(0)) \n"
+    "  { \n"
+    "    float thread_result = 0; \n"
+    "    for (unsigned int j = get_local_id(0); j < N; j += GEMV_WG) \n"
+    "      thread_result += A[row * N + j] * x[j]; \n"
+    ""
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "    shared_array[get_local_id(0)] = thread_result; \n"
+    "    for (uint stride=GEMV_WG/2; stride > 0; stride /= 2) \n"
+    "    { \n"
+    "      barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "      if (get_local_id(0) < stride) \n"
+    "        shared_array[get_local_id(0)] += shared_array[get_local_id(0) + stride]; \n"
+    "    } \n"
+    "    if (get_local_id(0) == 0) \n"
+    "      y[row] = shared_array[0]; \n"
+    "  } \n"
+    "} \n"
+    ""
+    "// y = A*x with A stored column-major. One work item per row, x is staged through local memory in chunks of GEMV_WG. \n"
+    "__kernel __attribute__((reqd_work_group_size(GEMV_WG, 1, 1))) \n"
+    "void gemv_col_major(__global const float *A, \n"
+    "                    __global const float *x, \n"
+    "                    __global float *y, \n"
+    "                    unsigned int M, \n"
+    "                    unsigned int N) \n"
+    "{ \n"
+    "  __local float x_chunk[GEMV_WG]; \n"
+    "  unsigned int row = get_global_id(0); \n"
+    "  float sum = 0; \n"
+    "  for (unsigned int j0 = 0; j0 < N; j0 += GEMV_WG) \n"
+    "  { \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "    x_chunk[get_local_id(0)] = (j0 + get_local_id(0) < N) ? x[j0 + get_local_id(0)] : 0; \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "    if (row < M) \n"
+    "    { \n"
+    "      unsigned int chunk_size = min((unsigned int)GEMV_WG, N - j0); \n"
+    "      for (unsigned int j = 0; j < chunk_size; ++j) \n"
+    "        sum += A[row + (j0 + j) * M] * x_chunk[j]; \n"
+    "    } \n"
+    "  } \n"
+    "  if (row < M) \n"
+    "    y[row] = sum; \n"
+    "} \n";
+
+    static const char * gemm_program_source = ""
+    "#define LX (TILE_N / WPT_N) \n"
+    "#define LY (TILE_M / WPT_M) \n"
+    ""
+    "// C = A*B, all row-major. A is M x K, B is K x N. \n"
+    "__kernel __attribute__((reqd_work_group_size(LX, LY, 1))) \n"
+    "void gemm_tiled(__global const float *A, \n"
+    "                __global const float *B, \n"
+    "                __global float *C, \n"
+    "                unsigned int M, \n"
+    "                unsigned int N, \n"
+    "                unsigned int K) \n"
+    "{ \n"
+    "  __local float As[TILE_M][TILE_K]; \n"
+    "  __local float Bs[TILE_K][TILE_N]; \n"
+    ""
+    "  unsigned int lx  = get_local_id(0); \n"
+    "  unsigned int ly  = get_local_id(1); \n"
+    "  unsigned int lid = ly * LX + lx; \n"
+    "  unsigned int row0 = get_group_id(1) * TILE_M; \n"
+    "  unsigned int col0 = get_group_id(0) * TILE_N; \n"
+    ""
+    "  float acc[WPT_M][WPT_N]; \n"
+    "  for (unsigned int wm = 0; wm < WPT_M; ++wm) \n"
+    "    for (unsigned int wn = 0; wn < WPT_N; ++wn) \n"
+    "      acc[wm][wn] = 0; \n"
+    ""
+    "  for (unsigned int k0 = 0; k0 < K; k0 += TILE_K) \n"
+    "  { \n"
+    "    // cooperative loads of the tiles, padded with zeros at the matrix boundary: \n"
+    "    for (unsigned int i = lid; i < TILE_M * TILE_K; i += LX * LY) \n"
+    "    { \n"
+    "      unsigned int r = i / TILE_K, c = i % TILE_K; \n"
+    "      As[r][c] = (row0 + r < M && k0 + c < K) ? A[(row0 + r) * K + k0 + c] : 0; \n"
+    "    } \n"
+    "    for (unsigned int i = lid; i < TILE_K * TILE_N; i += LX * LY) \n"
+    "    { \n"
+    "      unsigned int r = i / TILE_N, c = i % TILE_N; \n"
+    "      Bs[r][c] = (k0 + r < K && col0 + c < N) ? B[(k0 + r) * N + col0 + c] : 0; \n"
+    "    } \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    ""
+    "    for (unsigned int k = 0; k < TILE_K; ++k) \n"
+    "    { \n"
+    "      float b_reg[WPT_N]; \n"
+    "      for (unsigned int wn = 0; wn < WPT_N; ++wn) \n"
+    "        b_reg[wn] = Bs[k][lx + wn * LX]; \n"
+    "      for (unsigned int wm = 0; wm < WPT_M; ++wm) \n"
+    "      { \n"
+    "        float a_reg = As[ly + wm * LY][k]; \n"
+    "        for (unsigned int wn = 0; wn < WPT_N; ++wn) \n"
+    "          acc[wm][wn] += a_reg * b_reg[wn]; \n"
+    "      } \n"
+    "    } \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  } \n"
+    ""
+    "  for (unsigned int wm = 0; wm < WPT_M; ++wm) \n"
+    "    for (unsigned int wn = 0; wn < WPT_N; ++wn) \n"
+    "    { \n"
+    "      unsigned int r = row0 + ly + wm * LY; \n"
+    "      unsigned int c = col0 + lx + wn * LX; \n"
+    "      if (r < M && c < N) \n"
+    "        C[r * N + c] = acc[wm][wn]; \n"
+    "    } \n"
+    "} \n";
+
+
+    /** @brief Launches the dense kernels for a given parameter_set. Programs are built on demand through the program cache. */
+    class dense_kernels
+    {
+      typedef std::map<std::string, cl_kernel>  kernel_map;
+
+    public:
+      explicit dense_kernels(program_cache & cache) : cache_(cache), ctx_(cache.ctx())
+      {
+        cl_int err;
+        err = clGetDeviceInfo(ctx_.device(), CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t),   &max_work_group_size_, NULL); OPENCL_ERR_CHECK(err);
+        err = clGetDeviceInfo(ctx_.device(), CL_DEVICE_LOCAL_MEM_SIZE,      sizeof(cl_ulong), &local_mem_size_,      NULL); OPENCL_ERR_CHECK(err);
+      }
+
+      ~dense_kernels()
+      {
+        for (kernel_map::iterator it = kernels_.begin(); it != kernels_.end(); ++it)
+          clReleaseKernel(it->second);
+      }
+
+      static parameter_space gemv_space()
+      {
+        parameter_space space;
+        space.add("GEMV_WG", std::vector<int>{32, 64, 128, 256, 512});
+        return space;
+      }
+
+      static parameter_space gemm_space()
+      {
+        parameter_space space;
+        space.add("TILE_M", std::vector<int>{16, 32, 64, 128});
+        space.add("TILE_N", std::vector<int>{16, 32, 64, 128});
+        space.add("TILE_K", std::vector<int>{8, 16, 32});
+        space.add("WPT_M",  std::vector<int>{1, 2, 4, 8});
+        space.add("WPT_N",  std::vector<int>{1, 2, 4, 8});
+        return space;
+      }
+
+      static parameter_set gemv_defaults()
+      {
+        parameter_set p;
+        p.set("GEMV_WG", 128);
+        return p;
+      }
+
+      static parameter_set gemm_defaults()
+      {
+        parameter_set p;
+        p.set("TILE_M", 32); p.set("TILE_N", 32); p.set("TILE_K", 16);
+        p.set("WPT_M", 2);   p.set("WPT_N", 2);
+        return p;
+      }
+
+      /** @brief Whether the configuration fits the device limits */
+      bool gemv_valid(parameter_set const & p) const
+      {
+        return p.value("GEMV_WG") > 0 && size_t(p.value("GEMV_WG")) <= max_work_group_size_;
+      }
+
+      bool gemm_valid(parameter_set const & p) const
+      {
+        int tm = p.value("TILE_M"), tn = p.value("TILE_N"), tk = p.value("TILE_K");
+        int wm = p.value("WPT_M"),  wn = p.value("WPT_N");
+        if (tm <= 0 || tn <= 0 || tk <= 0 || wm <= 0 || wn <= 0 || tm % wm || tn % wn)
+          return false;
+        size_t threads = size_t(tm / wm) * size_t(tn / wn);
+        cl_ulong local_bytes = cl_ulong(tm * tk + tk * tn) * sizeof(float);
+        return threads >= 16 && threads <= max_work_group_size_ && local_bytes <= local_mem_size_;
+      }
+
+      /** @brief y = A*x, A row-major with M rows and N columns */
+      void gemv_row_major(cl_mem A, cl_mem x, cl_mem y, cl_uint M, cl_uint N, parameter_set const & p, cl_event * event = NULL)
+      {
+        cl_kernel k = get_kernel(gemv_program_source, p, "gemv_row_major");
+        set_args(k, A, x, y, M, N);
+        size_t local_size  = size_t(p.value("GEMV_WG"));
+        size_t global_size = std::min<size_t>(M, 4096) * local_size;
+        enqueue(k, 1, &global_size, &local_size, event);
+      }
+
+      /** @brief y = A*x, A column-major with M rows and N columns */
+      void gemv_col_major(cl_mem A, cl_mem x, cl_mem y, cl_uint M, cl_uint N, parameter_set const & p, cl_event * event = NULL)
+      {
+        cl_kernel k = get_kernel(gemv_program_source, p, "gemv_col_major");
+        set_args(k, A, x, y, M, N);
+        size_t local_size  = size_t(p.value("GEMV_WG"));
+        size_t global_size = (M + local_size - 1) / local_size * local_size;
+        enqueue(k, 1, &global_size, &local_size, event);
+      }
+
+      /** @brief C = A*B, all row-major. A is M x K, B is K x N. */
+      void gemm(cl_mem A, cl_mem B, cl_mem C, cl_uint M, cl_uint N, cl_uint K, parameter_set const & p, cl_event * event = NULL)
+      {
+        cl_int err;
+        cl_kernel k = get_kernel(gemm_program_source, p, "gemm_tiled");
+        set_args(k, A, B, C, M, N);
+        err = clSetKernelArg(k, 5, sizeof(cl_uint), (void*)&K); OPENCL_ERR_CHECK(err);
+
+        size_t tile_m = size_t(p.value("TILE_M")), tile_n = size_t(p.value("TILE_N"));
+        size_t local_size[2]  = { tile_n / size_t(p.value("WPT_N")), tile_m / size_t(p.value("WPT_M")) };
+        size_t global_size[2] = { (N + tile_n - 1) / tile_n * local_size[0], (M + tile_m - 1) / tile_m * local_size[1] };
+        enqueue(k, 2, global_size, local_size, event);
+      }
+
+    private:
+      dense_kernels(dense_kernels const &);
+      dense_kernels & operator=(dense_kernels const &);
+
+      cl_kernel get_kernel(const char * source, parameter_set const & p, const char * name)
+      {
+        std::string options = p.build_options();
+        std::string key = std::string(name) + " " + options;
+        kernel_map::iterator it = kernels_.find(key);
+        if (it != kernels_.end())
+          return it->second;
+        cl_kernel k = cache_.create_kernel(source, options, name);
+        kernels_[key] = k;
+        return k;
+      }
+
+      static void set_args(cl_kernel k, cl_mem a, cl_mem b, cl_mem c, cl_uint M, cl_uint N)
+      {
+        cl_int err;
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&a); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&b); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&c); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 3, sizeof(cl_uint), (void*)&M); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 4, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+      }
+
+      void enqueue(cl_kernel k, cl_uint dim, size_t * global_size, size_t * local_size, cl_event * event)
+      {
+        cl_int err = clEnqueueNDRangeKernel(ctx_.queue(), k, dim, NULL, global_size, local_size, 0, NULL, event); OPENCL_ERR_CHECK(err);
+      }
+
+      program_cache & cache_;
+      context const & ctx_;
+      size_t     max_work_group_size_;
+      cl_ulong   local_mem_size_;
+      kernel_map kernels_;
+    };
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef OPENCL_HOST_ALLOCATOR_HPP_
+#define OPENCL_HOST_ALLOCATOR_HPP_
+
+
+/** @file ocl-host-allocator.hpp
+    @brief Page-aligned host allocator for std::vector, with optional huge pages and parallel first-touch initialization
+
+    Zero-copy buffers (CL_MEM_USE_HOST_PTR) on CPUs and integrated GPUs require page-aligned host memory,
+    otherwise the runtime silently falls back to a copy. The allocator does not initialize elements on
+    construction, so that the pages of a host_vector are only placed once first_touch_fill() writes them:
+    each thread touches its own contiguous chunk, so on NUMA systems the pages end up on the node of the thread that
+    later processes them (assuming the usual first-touch policy of the operating system).
+*/
+
+
+#include <vector>
+#include <thread>
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <cstdlib>
+#include <cstddef>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+  namespace ocl
+  {
+
+    /** @brief Default alignment of host allocations: one page */
+    static const std::size_t host_page_size = 4096;
+
+    /** @brief Size and alignment of transparent huge pages on x86-64 Linux */
+    static const std::size_t host_huge_page_size = 2*1024*1024;
+
+    /** @brief Global switch for huge pages: allocations of at least one huge page are then aligned to huge pages and madvise(MADV_HUGEPAGE)'d. Linux only. */
+    inline bool & use_huge_pages()
+    {
+      static bool flag = false;
+      return flag;
+    }
+
+    /** @brief Allocates at least 'num_bytes' bytes aligned to 'alignment' (a power of two). Free with free_aligned(). */
+    inline void * allocate_aligned(std::size_t num_bytes, std::size_t alignment)
+    {
+#if defined(__linux__)
+      if (use_huge_pages() && num_bytes >= host_huge_page_size)
+      {
+        alignment = host_huge_page_size;
+        num_bytes = (num_bytes + host_huge_page_size - 1) / host_huge_page_size * host_huge_page_size;
+      }
+#endif
+
+      void * ptr = NULL;
+#if defined(_WIN32)
+      ptr = _aligned_malloc(num_bytes, alignment);
+#else
+      if (posix_memalign(&ptr, alignment, num_bytes) != 0)
+        ptr = NULL;
+#endif
+      if (!ptr)
+        throw std::bad_alloc();
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+      if (use_huge_pages() && num_bytes >= host_huge_page_size)
+        madvise(ptr, num_bytes, MADV_HUGEPAGE);    // only a hint, failure is not an error
+#endif
+      return ptr;
+    }
+
+    inline void free_aligned(void * ptr)
+    {
+#if defined(_WIN32)
+      _aligned_free(ptr);
+#else
+      std::free(ptr);
+#endif
+    }
+
+
+    /** @brief Stateless allocator returning 'Alignment'-aligned memory. Elements are default-initialized, i.e. left uninitialized for scalar types. */
+    template<typename T, std::size_t Alignment = host_page_size>
+    class aligned_allocator
+    {
+    public:
+      typedef T            value_type;
+      typedef T *          pointer;
+      typedef T const *    const_pointer;
+      typedef std::size_t  size_type;
+
+      template<typename U>
+      struct rebind { typedef aligned_allocator<U, Alignment> other; };
+
+      aligned_allocator() {}
+      template<typename U>
+      aligned_allocator(aligned_allocator<U, Alignment> const &) {}
+
+      T * allocate(std::size_t n) { return static_cast<T *>(allocate_aligned(n * sizeof(T), Alignment)); }
+      void deallocate(T * ptr, std::size_t) { free_aligned(ptr); }
+
+      // default-initialization instead of value-initialization, so that no page is touched by the constructor of std::vector:
+      template<typename U>
+      void construct(U * ptr) { ::new(static_cast<void *>(ptr)) U; }
+
+      template<typename U, typename... Args>
+      void construct(U * ptr, Args &&... args) { ::new(static_cast<void *>(ptr)) U(std::forward<Args>(args)...); }
+    };
+
+    template<typename T, typename U, std::size_t A>
+    bool operator==(aligned_allocator<T, A> const &, aligned_allocator<U, A> const &) { return true; }
+
+    template<typename T, typename U, std::size_t A>
+    bool operator!=(aligned_allocator<T, A> const &, aligned_allocator<U, A> const &) { return false; }
+
+
+    /** @brief Host vector suitable for CL_MEM_USE_HOST_PTR. Entries are uninitialized after construction with a size only. */
+    template<typename T>
+    using host_vector = std::vector<T, aligned_allocator<T> >;
+
+
+    /** @brief Sets data[0..n) to 'value', using 'num_threads' threads (0: all hardware threads) each writing one contiguous chunk of whole pages */
+    template<typename T>
+    void first_touch_fill(T * data, std::size_t n, T const & value, unsigned int num_threads = 0)
+    {
+      if (num_threads == 0)
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+      std::size_t entries_per_page = std::max<std::size_t>(host_page_size / sizeof(T), 1);
+      std::size_t num_pages        = (n + entries_per_page - 1) / entries_per_page;
+      if (num_pages < num_threads)
+        num_threads = unsigned(std::max<std::size_t>(num_pages, 1));
+
+      std::vector<std::thread> threads;
+      for (unsigned int t=0; t<num_threads; ++t)
+      {
+        std::size_t begin = std::min(n, num_pages *  t      / num_threads * entries_per_page);
+        std::size_t end   = std::min(n, num_pages * (t + 1) / num_threads * entries_per_page);
+        threads.push_back(std::thread([data, begin, end, &value]() {
+          for (std::size_t i=begin; i<end; ++i)
+            data[i] = value;
+        }));
+      }
+      for (std::size_t t=0; t<threads.size(); ++t)
+        threads[t].join();
+    }
+
+    template<typename T>
+    void first_touch_fill(host_vector<T> & v, T const & value, unsigned int num_threads = 0)
+    {
+      if (v.size())
+        first_touch_fill(&(v[0]), v.size(), value, num_threads);
+    }
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef OPENCL_KERNEL_ARGS_HPP_
+#define OPENCL_KERNEL_ARGS_HPP_
+
+
+/** @file ocl-kernel-args.hpp
+    @brief Kernel handle that remembers its arguments and skips clSetKernelArg if a value has not changed
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "ocl-error.hpp"
+
+  namespace ocl
+  {
+
+    /** @brief Wraps a cl_kernel (without taking ownership) and memoizes the argument values set through it.
+    *
+    *  Arguments set directly with clSetKernelArg() on the same cl_kernel bypass the memo, so all arguments of a kernel
+    *  should be set through one memoized_kernel.
+    *
+    *  Values are compared by their bytes. A buffer passed to arg() is therefore retained as long as it is memoized:
+    *  otherwise a buffer released by its owner and a new buffer created afterwards could have the same handle, and the
+    *  kernel would keep using the released one. The buffer is released once another value is set for its argument or
+    *  the memoized_kernel is destroyed.
+    */
+    class memoized_kernel
+    {
+    public:
+      explicit memoized_kernel(cl_kernel k = NULL) : kernel_(k), calls_(0), skipped_(0) {}
+
+      memoized_kernel(memoized_kernel const & other)
+        : kernel_(other.kernel_), args_(other.args_), buffers_(other.buffers_), calls_(other.calls_), skipped_(other.skipped_)
+      {
+        retain_buffers();
+      }
+
+      memoized_kernel & operator=(memoized_kernel const & other)
+      {
+        if (this != &other)
+        {
+          release_buffers();
+          kernel_   = other.kernel_;
+          args_     = other.args_;
+          buffers_  = other.buffers_;
+          calls_    = other.calls_;
+          skipped_  = other.skipped_;
+          retain_buffers();
+        }
+        return *this;
+      }
+
+      ~memoized_kernel() { release_buffers(); }
+
+      template <typename T>
+      void arg(cl_uint index, T const & value) { set(index, sizeof(T), &value); }
+
+      /** @brief Buffer argument, retained while it is memoized */
+      void arg(cl_uint index, cl_mem value)
+      {
+        if (set(index, sizeof(cl_mem), &value) && value)
+        {
+          cl_int err = clRetainMemObject(value); OPENCL_ERR_CHECK(err);
+          buffers_[index] = value;
+        }
+      }
+
+      /** @brief Local memory argument of 'num_bytes' */
+      void local(cl_uint index, size_t num_bytes) { set(index, num_bytes, NULL); }
+
+      /** @brief Returns whether clSetKernelArg was called, i.e. the value differs from the memoized one */
+      bool set(cl_uint index, size_t size, const void * value)
+      {
+        ++calls_;
+        std::string bytes = value ? std::string(static_cast<const char *>(value), size)
+                                  : std::string("local:") + std::to_string(size);
+        if (index < args_.size() && args_[index] == bytes)
+        {
+          ++skipped_;
+          return false;
+        }
+
+        cl_int err = clSetKernelArg(kernel_, index, size, value); OPENCL_ERR_CHECK(err);
+        if (index >= args_.size())
+        {
+          args_.resize(index + 1);   // empty: not set yet, real values have at least one byte
+          buffers_.resize(index + 1, NULL);
+        }
+        args_[index] = bytes;
+        if (buffers_[index])
+        {
+          clReleaseMemObject(buffers_[index]);
+          buffers_[index] = NULL;
+        }
+        return true;
+      }
+
+      cl_kernel handle() const { return kernel_; }
+
+      std::size_t calls()   const { return calls_; }     // set() requests
+      std::size_t skipped() const { return skipped_; }   // requests that did not reach clSetKernelArg
+
+    private:
+      void retain_buffers()
+      {
+        for (std::size_t i=0; i<buffers_.size(); ++i)
+          if (buffers_[i])
+            clRetainMemObject(buffers_[i]);
+      }
+
+      void release_buffers()
+      {
+        for (std::size_t i=0; i<buffers_.size(); ++i)
+          if (buffers_[i])
+            clReleaseMemObject(buffers_[i]);
+        buffers_.clear();
+      }
+
+      cl_kernel                kernel_;
+      std::vector<std::string> args_;
+      std::vector<cl_mem>      buffers_;   // memoized buffer arguments (retained), NULL for other arguments
+      std::size_t              calls_;
+      std::size_t              skipped_;
+    };
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef OPENCL_KERNEL_CACHE_HPP_
+#define OPENCL_KERNEL_CACHE_HPP_
+
+
+/** @file ocl-kernel-cache.hpp
+    @brief cl_kernel objects and scratch buffers per host thread, so that threads launch the same kernels without locking
+
+    A cl_kernel holds its arguments, so two threads setting arguments of the same cl_kernel race with each other.
+    thread_kernel_cache hands out one memoized_kernel per (program, kernel name) and thread: it is created on first use
+    by a thread, and afterwards neither clCreateKernel nor unchanged arguments cost anything. The per-thread state is
+    found through a thread_local table, the mutex is only taken the first time a thread uses a cache.
+
+    Handles are only compared while the objects behind them are alive: the cache retains each program it holds kernels
+    for, memoized_kernel retains its buffer arguments, and a grown scratch buffer is created before the old one is
+    released. A released handle can therefore never be mistaken for a new object with the same address.
+
+    concurrent_blas1 uses it for vec_add and vec_dot callable from any number of threads.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <utility>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-kernel-args.hpp"
+#include "ocl-blas1.hpp"
+
+  namespace ocl
+  {
+
+    class thread_kernel_cache
+    {
+      struct thread_state
+      {
+        std::map<std::pair<cl_program, std::string>, memoized_kernel>  kernels;
+        std::map<std::string, std::pair<cl_mem, size_t> >              buffers;
+      };
+
+    public:
+      explicit thread_kernel_cache(context const & ctx) : ctx_(ctx), id_(next_id()) {}
+
+      ~thread_kernel_cache()
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::size_t i=0; i<threads_.size(); ++i)
+        {
+          thread_state & t = *threads_[i];
+          for (std::map<std::pair<cl_program, std::string>, memoized_kernel>::iterator it = t.kernels.begin(); it != t.kernels.end(); ++it)
+          {
+            clReleaseKernel(it->second.handle());
+            clReleaseProgram(it->first.first);
+          }
+          for (std::map<std::string, std::pair<cl_mem, size_t> >::iterator it = t.buffers.begin(); it != t.buffers.end(); ++it)
+            clReleaseMemObject(it->second.first);
+        }
+      }
+
+      /** @brief The calling thread's instance of kernel 'name' in 'prog'. Only use it from this thread. */
+      memoized_kernel & get(cl_program prog, std::string const & name)
+      {
+        thread_state & t = local();
+        std::pair<cl_program, std::string> key(prog, name);
+        std::map<std::pair<cl_program, std::string>, memoized_kernel>::iterator it = t.kernels.find(key);
+        if (it != t.kernels.end())
+          return it->second;
+
+        cl_int err;
+        cl_kernel k = clCreateKernel(prog, name.c_str(), &err); OPENCL_ERR_CHECK(err);
+        err = clRetainProgram(prog); OPENCL_ERR_CHECK(err);   // 'prog' stays a valid key while the entry exists
+        return t.kernels.insert(std::make_pair(key, memoized_kernel(k))).first->second;
+      }
+
+      /** @brief A buffer of at least 'num_bytes' owned by the calling thread, e.g. for partial results */
+      cl_mem scratch(std::string const & name, size_t num_bytes)
+      {
+        std::pair<cl_mem, size_t> & buffer = local().buffers[name];
+        if (buffer.second < num_bytes)
+        {
+          // allocate before releasing, so that the new buffer cannot get the handle of the old one:
+          cl_mem old_buffer = buffer.first;
+          buffer.first  = ctx_.create_buffer(num_bytes);
+          buffer.second = num_bytes;
+          if (old_buffer)
+            clReleaseMemObject(old_buffer);
+        }
+        return buffer.first;
+      }
+
+      /** @brief Number of threads that have used the cache */
+      std::size_t threads() const
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return threads_.size();
+      }
+
+      context const & ctx() const { return ctx_; }
+
+    private:
+      thread_kernel_cache(thread_kernel_cache const &);
+      thread_kernel_cache & operator=(thread_kernel_cache const &);
+
+      // ids instead of 'this' as key of the thread_local table: a new cache may reuse the address of a destroyed one
+      static std::size_t next_id()
+      {
+        static std::atomic<std::size_t> counter(0);
+        return ++counter;
+      }
+
+      thread_state & local()
+      {
+        thread_local std::map<std::size_t, thread_state *> table;
+        std::map<std::size_t, thread_state *>::iterator it = table.find(id_);
+        if (it != table.end())
+          return *(it->second);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        threads_.push_back(std::unique_ptr<thread_state>(new thread_state()));
+        table[id_] = threads_.back().get();
+        return *threads_.back();
+      }
+
+      context const &                             ctx_;
+      std::size_t                                 id_;
+      mutable std::mutex                          mutex_;
+      std::vector<std::unique_ptr<thread_state> > threads_;
+    };
+
+
+    /** @brief vec_add and vec_dot with the tutorial launch configuration, callable concurrently from several threads */
+    class concurrent_blas1
+    {
+    public:
+      explicit concurrent_blas1(context const & ctx) : ctx_(ctx), kernels_(ctx)
+      {
+        prog_ = ctx_.build_program(blas1_program_source);
+      }
+
+      ~concurrent_blas1() { clReleaseProgram(prog_); }
+
+      /** @brief x += y */
+      void add(cl_mem x, cl_mem y, cl_uint N, cl_event * event = NULL)
+      {
+        memoized_kernel & k = kernels_.get(prog_, "vec_add");
+        k.arg(0, x);
+        k.arg(1, y);
+        k.arg(2, N);
+        enqueue(k.handle(), blas1_global_size, event);
+      }
+
+      /** @brief result[result_index] = x^T y, reduced on the device. The partial results are per thread. */
+      void dot(cl_mem x, cl_mem y, cl_mem result, cl_uint result_index, cl_uint N, cl_event * event = NULL)
+      {
+        cl_uint num_partials = blas1_kernels::num_partials();
+        cl_mem partials = kernels_.scratch("partials", num_partials * sizeof(float));
+
+        memoized_kernel & k = kernels_.get(prog_, "vec_dot");
+        k.arg(0, x);
+        k.arg(1, y);
+        k.arg(2, partials);
+        k.arg(3, N);
+        k.local(4, sizeof(float) * blas1_local_size);
+        enqueue(k.handle(), blas1_global_size, NULL);
+
+        memoized_kernel & s = kernels_.get(prog_, "vec_sum");
+        s.arg(0, partials);
+        s.arg(1, num_partials);
+        s.arg(2, result);
+        s.arg(3, result_index);
+        s.local(4, sizeof(float) * blas1_local_size);
+        enqueue(s.handle(), blas1_local_size, event);
+      }
+
+      thread_kernel_cache const & kernels() const { return kernels_; }
+
+    private:
+      concurrent_blas1(concurrent_blas1 const &);
+      concurrent_blas1 & operator=(concurrent_blas1 const &);
+
+      void enqueue(cl_kernel k, size_t global_size, cl_event * event)
+      {
+        size_t local_size = blas1_local_size;
+        cl_int err = clEnqueueNDRangeKernel(ctx_.queue(), k, 1, NULL, &global_size, &local_size, 0, NULL, event); OPENCL_ERR_CHECK(err);
+      }
+
+      context const &     ctx_;
+      thread_kernel_cache kernels_;
+      cl_program          prog_;
+    };
+
+  } //namespace ocl
+
+
+#endif
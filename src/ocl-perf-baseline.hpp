@@ -0,0 +1,181 @@
+#ifndef OPENCL_PERF_BASELINE_HPP_
+#define OPENCL_PERF_BASELINE_HPP_
+
+
+/** @file ocl-perf-baseline.hpp
+    @brief Stored throughput baselines per device class for the performance regression suite (perf_check)
+
+    A baseline is a small JSON file, one per device class ('cpu', 'gpu', 'accelerator'):
+
+      {
+        "device_class": "cpu",
+        "device": "<name of the device the numbers were recorded on>",
+        "tolerance": 0.25,
+        "throughput_gbs": {
+          "vec_add/1048576": 10.2,
+          ...
+        }
+      }
+
+    Only this layout is understood, it is not a general JSON parser.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "ocl-context.hpp"
+
+  namespace ocl
+  {
+
+    /** @brief 'cpu', 'gpu', 'accelerator' or 'default', used to pick the baseline file */
+    inline std::string device_class(context const & ctx)
+    {
+      cl_device_type type = ctx.device_type();
+      if (type & CL_DEVICE_TYPE_GPU)         return "gpu";
+      if (type & CL_DEVICE_TYPE_CPU)         return "cpu";
+      if (type & CL_DEVICE_TYPE_ACCELERATOR) return "accelerator";
+      return "default";
+    }
+
+
+    class perf_baseline
+    {
+    public:
+      typedef std::map<std::string, double>::const_iterator  const_iterator;
+
+      perf_baseline() : tolerance_(0.25) {}
+
+      /** @brief Reads a baseline file. Returns false if it does not exist. Throws if it cannot be parsed. */
+      bool load(std::string const & filename)
+      {
+        std::ifstream file(filename.c_str());
+        if (!file)
+          return false;
+        std::stringstream ss;
+        ss << file.rdbuf();
+        std::string json = ss.str();
+
+        device_class_ = string_value(json, "device_class");
+        device_       = string_value(json, "device");
+        std::string tolerance = number_after(json, key_position(json, "tolerance"));
+        if (!tolerance.empty())
+          tolerance_ = std::atof(tolerance.c_str());
+
+        throughput_.clear();
+        std::size_t pos = key_position(json, "throughput_gbs");
+        if (pos == std::string::npos || (pos = json.find('{', pos)) == std::string::npos)
+          throw std::runtime_error("No throughput_gbs object in " + filename);
+        std::size_t end = json.find('}', pos);
+        while (true)
+        {
+          std::size_t key_begin = json.find('"', pos + 1);
+          if (key_begin == std::string::npos || key_begin > end)
+            break;
+          std::size_t key_end = json.find('"', key_begin + 1);
+          std::string value = number_after(json, key_end + 1);
+          if (value.empty())
+            throw std::runtime_error("Malformed entry in " + filename);
+          throughput_[json.substr(key_begin + 1, key_end - key_begin - 1)] = std::atof(value.c_str());
+          pos = key_end + 1;
+        }
+        return true;
+      }
+
+      void save(std::string const & filename) const
+      {
+        std::ofstream file(filename.c_str());
+        if (!file)
+          throw std::runtime_error("Cannot write baseline file " + filename);
+        file << "{" << std::endl;
+        file << "  \"device_class\": \"" << escape(device_class_) << "\"," << std::endl;
+        file << "  \"device\": \"" << escape(device_) << "\"," << std::endl;
+        file << "  \"tolerance\": " << tolerance_ << "," << std::endl;
+        file << "  \"throughput_gbs\": {";
+        for (const_iterator it = throughput_.begin(); it != throughput_.end(); ++it)
+          file << (it == throughput_.begin() ? "\n" : ",\n") << "    \"" << escape(it->first) << "\": " << std::setprecision(4) << it->second;
+        file << std::endl << "  }" << std::endl << "}" << std::endl;
+      }
+
+      std::string const & device_class() const { return device_class_; }
+      std::string const & device()       const { return device_; }
+      double              tolerance()    const { return tolerance_; }
+
+      void device_class(std::string const & c) { device_class_ = c; }
+      void device(std::string const & d)       { device_ = d; }
+      void tolerance(double t)                 { tolerance_ = t; }
+
+      bool   has(std::string const & name) const { return throughput_.find(name) != throughput_.end(); }
+      double get(std::string const & name) const { return has(name) ? throughput_.find(name)->second : 0; }
+      void   set(std::string const & name, double gbs) { throughput_[name] = gbs; }
+
+      const_iterator begin() const { return throughput_.begin(); }
+      const_iterator end()   const { return throughput_.end(); }
+
+    private:
+      /** @brief Position right after the quoted key, npos if missing */
+      static std::size_t key_position(std::string const & json, std::string const & key)
+      {
+        std::size_t pos = json.find("\"" + key + "\"");
+        return (pos == std::string::npos) ? pos : pos + key.size() + 2;
+      }
+
+      /** @brief The number following the next ':' after 'pos', empty if there is none */
+      static std::string number_after(std::string const & json, std::size_t pos)
+      {
+        if (pos == std::string::npos || (pos = json.find(':', pos)) == std::string::npos)
+          return std::string();
+        pos = json.find_first_not_of(" \t\r\n", pos + 1);
+        std::size_t end = json.find_first_not_of("0123456789+-.eE", pos);
+        return (pos == std::string::npos || end == pos) ? std::string() : json.substr(pos, end - pos);
+      }
+
+      static std::string string_value(std::string const & json, std::string const & key)
+      {
+        std::size_t pos = key_position(json, key);
+        if (pos == std::string::npos || (pos = json.find(':', pos)) == std::string::npos || (pos = json.find('"', pos)) == std::string::npos)
+          return std::string();
+        std::string result;
+        for (++pos; pos < json.size() && json[pos] != '"'; ++pos)
+        {
+          if (json[pos] == '\\' && pos + 1 < json.size())
+            ++pos;
+          result += json[pos];
+        }
+        return result;
+      }
+
+      static std::string escape(std::string const & str)
+      {
+        std::string result;
+        for (std::size_t i=0; i<str.size(); ++i)
+        {
+          if (str[i] == '"' || str[i] == '\\')
+            result += '\\';
+          result += str[i];
+        }
+        return result;
+      }
+
+      std::string device_class_;
+      std::string device_;
+      double      tolerance_;
+      std::map<std::string, double> throughput_;
+    };
+
+  } //namespace ocl
+
+
+#endif
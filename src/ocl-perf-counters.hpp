@@ -0,0 +1,228 @@
+#ifndef OPENCL_PERF_COUNTERS_HPP_
+#define OPENCL_PERF_COUNTERS_HPP_
+
+
+/** @file ocl-perf-counters.hpp
+    @brief Hardware performance counters (Linux perf_event_open) around kernels running on a CPU OpenCL device
+
+    Core counters (cycles, instructions, last-level cache misses) are attached to every thread of the process that exists
+    when the perf_counters object is created, which includes the worker threads of a CPU OpenCL runtime. Hence create it
+    after the first kernel has run. Memory traffic is taken from the uncore memory controller counters
+    (uncore_imc_*, CAS counts times 64 bytes) if the system exposes them and perf_event_paranoid permits system-wide counting.
+
+    Everything is optional: available() and uncore_available() report what could be opened. On other systems nothing is.
+*/
+
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+  namespace ocl
+  {
+
+    /** @brief Counter values of one measurement, summed over all threads (core counters) or memory controllers (DRAM bytes) */
+    struct perf_sample
+    {
+      perf_sample() : cycles(0), instructions(0), llc_misses(0), dram_bytes(0), has_core(false), has_dram(false) {}
+
+      double cycles;
+      double instructions;
+      double llc_misses;
+      double dram_bytes;
+      bool   has_core;
+      bool   has_dram;
+
+      double ipc() const { return cycles > 0 ? instructions / cycles : 0; }
+    };
+
+
+    class perf_counters
+    {
+    public:
+      perf_counters()
+      {
+#if defined(__linux__)
+        std::vector<int> threads = process_threads();
+        for (std::size_t i=0; i<threads.size(); ++i)
+        {
+          open_counter(cycles_,       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,   threads[i], -1);
+          open_counter(instructions_, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, threads[i], -1);
+          open_counter(llc_misses_,   PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, threads[i], -1);
+        }
+
+        // one memory controller counter per uncore_imc_<N> PMU, counting on CPU 0 (uncore counters are per socket):
+        for (int imc=0; imc<16; ++imc)
+        {
+          std::ostringstream dir;
+          dir << "/sys/bus/event_source/devices/uncore_imc_" << imc;
+          int type = read_int(dir.str() + "/type");
+          if (type < 0)
+            continue;
+          open_counter(dram_, uint32_t(type), event_config(dir.str() + "/events/cas_count_read"),  -1, 0);
+          open_counter(dram_, uint32_t(type), event_config(dir.str() + "/events/cas_count_write"), -1, 0);
+        }
+#endif
+      }
+
+      ~perf_counters()
+      {
+#if defined(__linux__)
+        close_all(cycles_);
+        close_all(instructions_);
+        close_all(llc_misses_);
+        close_all(dram_);
+#endif
+      }
+
+      bool available()        const { return cycles_.size() > 0; }
+      bool uncore_available() const { return dram_.size() > 0; }
+      std::size_t threads()   const { return cycles_.size(); }
+
+      /** @brief Resets and starts all counters */
+      void start()
+      {
+#if defined(__linux__)
+        control(PERF_EVENT_IOC_RESET);
+        control(PERF_EVENT_IOC_ENABLE);
+#endif
+      }
+
+      /** @brief Stops all counters and returns their values since start() */
+      perf_sample stop()
+      {
+        perf_sample sample;
+#if defined(__linux__)
+        control(PERF_EVENT_IOC_DISABLE);
+        sample.cycles       = sum(cycles_);
+        sample.instructions = sum(instructions_);
+        sample.llc_misses   = sum(llc_misses_);
+        sample.dram_bytes   = 64.0 * sum(dram_);
+        sample.has_core     = available();
+        sample.has_dram     = uncore_available();
+#endif
+        return sample;
+      }
+
+    private:
+      perf_counters(perf_counters const &);
+      perf_counters & operator=(perf_counters const &);
+
+#if defined(__linux__)
+      static void open_counter(std::vector<int> & fds, uint32_t type, uint64_t config, int tid, int cpu)
+      {
+        if (config == uint64_t(-1))
+          return;
+
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = type;
+        attr.config         = config;
+        attr.disabled       = 1;
+        attr.exclude_kernel = (cpu < 0) ? 1 : 0;   // unprivileged users may only count user space of their threads
+        attr.exclude_hv     = 1;
+
+        int fd = int(syscall(__NR_perf_event_open, &attr, tid, cpu, -1, 0));
+        if (fd >= 0)
+          fds.push_back(fd);
+      }
+
+      static std::vector<int> process_threads()
+      {
+        std::vector<int> result;
+        DIR * dir = opendir("/proc/self/task");
+        if (!dir)
+          return result;
+        while (struct dirent * entry = readdir(dir))
+          if (entry->d_name[0] != '.')
+            result.push_back(std::atoi(entry->d_name));
+        closedir(dir);
+        return result;
+      }
+
+      static int read_int(std::string const & filename)
+      {
+        std::ifstream file(filename.c_str());
+        int value = -1;
+        if (!(file >> value))
+          return -1;
+        return value;
+      }
+
+      /** @brief Parses an event description such as "event=0x04,umask=0x03" into a perf_event_attr config */
+      static uint64_t event_config(std::string const & filename)
+      {
+        std::ifstream file(filename.c_str());
+        std::string description;
+        if (!std::getline(file, description))
+          return uint64_t(-1);
+
+        uint64_t config = 0;
+        std::istringstream fields(description);
+        std::string field;
+        while (std::getline(fields, field, ','))
+        {
+          std::size_t pos = field.find('=');
+          if (pos == std::string::npos)
+            continue;
+          uint64_t value = std::strtoull(field.c_str() + pos + 1, NULL, 0);
+          std::string name = field.substr(0, pos);
+          if (name == "event")
+            config |= value;
+          else if (name == "umask")
+            config |= value << 8;
+        }
+        return config;
+      }
+
+      void control(unsigned long request)
+      {
+        std::vector<int> * groups[4] = { &cycles_, &instructions_, &llc_misses_, &dram_ };
+        for (int g=0; g<4; ++g)
+          for (std::size_t i=0; i<groups[g]->size(); ++i)
+            ioctl((*groups[g])[i], request, 0);
+      }
+
+      static double sum(std::vector<int> const & fds)
+      {
+        double result = 0;
+        for (std::size_t i=0; i<fds.size(); ++i)
+        {
+          uint64_t value = 0;
+          if (read(fds[i], &value, sizeof(value)) == ssize_t(sizeof(value)))
+            result += double(value);
+        }
+        return result;
+      }
+
+      static void close_all(std::vector<int> & fds)
+      {
+        for (std::size_t i=0; i<fds.size(); ++i)
+          close(fds[i]);
+        fds.clear();
+      }
+#endif
+
+      std::vector<int> cycles_;
+      std::vector<int> instructions_;
+      std::vector<int> llc_misses_;
+      std::vector<int> dram_;
+    };
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef OPENCL_PROGRAM_CACHE_HPP_
+#define OPENCL_PROGRAM_CACHE_HPP_
+
+
+/** @file ocl-program-cache.hpp
+    @brief Builds each (source, build options) combination only once per context, optionally in the background
+
+    build_async() hands a build to a small pool of worker threads and returns immediately, ready() tells whether it
+    has completed and failed() whether it has failed. Worker threads are used instead of the pfn_notify callback of
+    clBuildProgram, because many implementations only return from clBuildProgram once the build is done even if a
+    callback is given.
+    get() waits for a pending background build of the same program instead of starting a second one.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+
+  namespace ocl
+  {
+
+    /** @brief Cache of compiled programs, keyed by the program source and the build options.
+    *
+    *  get(), ready(), failed() and build_async() may be called from one thread at a time, the background builds run concurrently.
+    */
+    class program_cache
+    {
+      typedef std::pair<std::string, std::string>  key_type;
+      typedef std::map<key_type, cl_program>       map_type;
+
+      enum build_status { build_pending, build_failed };
+
+    public:
+      explicit program_cache(context const & ctx, std::size_t max_workers = 4)
+        : ctx_(ctx), builds_(0), max_workers_(std::max<std::size_t>(max_workers, 1)), stop_(false) {}
+
+      ~program_cache()
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          stop_ = true;
+        }
+        work_available_.notify_all();
+        for (std::size_t i=0; i<workers_.size(); ++i)
+          workers_[i].join();
+
+        for (std::size_t i=0; i<queue_.size(); ++i)
+          clReleaseProgram(queue_[i].second);
+        for (map_type::iterator it = programs_.begin(); it != programs_.end(); ++it)
+          clReleaseProgram(it->second);
+      }
+
+      /** @brief Returns the program built with the given options. Builds it on first request (or waits for its background build). The cache keeps ownership. */
+      cl_program get(std::string const & source, std::string const & options = std::string())
+      {
+        key_type key(source, options);
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          build_finished_.wait(lock, [&]() { return pending_.find(key) == pending_.end() || pending_[key] != build_pending; });
+
+          map_type::iterator it = programs_.find(key);
+          if (it != programs_.end())
+            return it->second;
+          pending_.erase(key);   // a failed background build is repeated below, which prints the build log and throws
+        }
+
+        cl_program prog = ctx_.build_program(source.c_str(), options);
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++builds_;
+        programs_[key] = prog;
+        return prog;
+      }
+
+      /** @brief Starts building the program in the background, unless it is already built or being built */
+      void build_async(std::string const & source, std::string const & options = std::string())
+      {
+        key_type key(source, options);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (programs_.find(key) != programs_.end() || pending_.find(key) != pending_.end())
+          return;
+
+        cl_int err;
+        const char * source_ptr = source.c_str();
+        size_t source_len = source.length();
+        cl_program prog = clCreateProgramWithSource(ctx_.handle(), 1, &source_ptr, &source_len, &err); OPENCL_ERR_CHECK(err);
+        queue_.push_back(std::make_pair(key, prog));
+        pending_[key] = build_pending;
+
+        if (workers_.size() < max_workers_)
+          workers_.push_back(std::thread(&program_cache::worker, this));
+        work_available_.notify_one();
+      }
+
+      /** @brief Whether the program is built and get() returns without building or waiting */
+      bool ready(std::string const & source, std::string const & options = std::string()) const
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return programs_.find(key_type(source, options)) != programs_.end();
+      }
+
+      /** @brief Whether the background build of the program has failed. It is not started again by build_async(), get() repeats it and throws. */
+      bool failed(std::string const & source, std::string const & options = std::string()) const
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<key_type, build_status>::const_iterator it = pending_.find(key_type(source, options));
+        return it != pending_.end() && it->second == build_failed;
+      }
+
+      /** @brief Creates a kernel from the cached program. The caller owns the kernel. */
+      cl_kernel create_kernel(std::string const & source, std::string const & options, const char * name)
+      {
+        cl_int err;
+        cl_kernel k = clCreateKernel(get(source, options), name, &err); OPENCL_ERR_CHECK(err);
+        return k;
+      }
+
+      std::size_t size()   const { std::lock_guard<std::mutex> lock(mutex_); return programs_.size(); }
+      std::size_t builds() const { std::lock_guard<std::mutex> lock(mutex_); return builds_; }
+
+      /** @brief Number of background builds queued or running */
+      std::size_t pending() const
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::size_t count = 0;
+        for (std::map<key_type, build_status>::const_iterator it = pending_.begin(); it != pending_.end(); ++it)
+          count += (it->second == build_pending) ? 1 : 0;
+        return count;
+      }
+
+      context const & ctx() const { return ctx_; }
+
+    private:
+      program_cache(program_cache const &);
+      program_cache & operator=(program_cache const &);
+
+      void worker()
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+          work_available_.wait(lock, [&]() { return stop_ || !queue_.empty(); });
+          if (stop_)
+            return;
+
+          std::pair<key_type, cl_program> job = queue_.front();
+          queue_.pop_front();
+          lock.unlock();
+
+          cl_device_id device = ctx_.device();
+          cl_int err = clBuildProgram(job.second, 1, &device, job.first.second.c_str(), NULL, NULL);
+
+          lock.lock();
+          if (err == CL_SUCCESS)
+          {
+            ++builds_;
+            programs_[job.first] = job.second;
+            pending_.erase(job.first);
+          }
+          else
+          {
+            clReleaseProgram(job.second);
+            pending_[job.first] = build_failed;
+          }
+          build_finished_.notify_all();
+        }
+      }
+
+      context const & ctx_;
+      map_type    programs_;
+      std::size_t builds_;
+
+      std::size_t                              max_workers_;
+      std::map<key_type, build_status>         pending_;   // queued, running or failed background builds
+      std::deque<std::pair<key_type, cl_program> > queue_;
+      std::vector<std::thread>                 workers_;
+      mutable std::mutex                       mutex_;
+      std::condition_variable                  work_available_;
+      std::condition_variable                  build_finished_;
+      bool                                     stop_;
+    };
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef OPENCL_ROOFLINE_HPP_
+#define OPENCL_ROOFLINE_HPP_
+
+
+/** @file ocl-roofline.hpp
+    @brief Measured peak memory bandwidth and peak FLOP/s of a device, and kernel performance relative to this roofline
+
+    The bandwidth peak comes from a STREAM-like copy of a large buffer (read + write), the FLOP/s peak from independent
+    chains of multiply-adds. Both are the best of several runs, timed with profiling events on a separate queue.
+    Measuring takes a few seconds, so the results are stored in a small text file keyed by device name and driver version.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+
+  namespace ocl
+  {
+
+    static const char * roofline_program_source = ""
+    "__kernel void stream_copy(__global const float4 *x, \n"
+    "                          __global float4 *y) \n"
+    "{ \n"
+    "  y[get_global_id(0)] = x[get_global_id(0)]; \n"
+    "} \n"
+    ""
+    "// 8 independent float4 chains, i.e. 32 multiply-adds (64 flops) per work item and iteration \n"
+    "__kernel void mad_chain(__global float *result, \n"
+    "                        float a, \n"
+    "                        float b, \n"
+    "                        unsigned int iterations) \n"
+    "{ \n"
+    "  float4 s0 = (float4)(get_global_id(0)); \n"
+    "  float4 s1 = s0 + 1.0f, s2 = s0 + 2.0f, s3 = s0 + 3.0f; \n"
+    "  float4 s4 = s0 + 4.0f, s5 = s0 + 5.0f, s6 = s0 + 6.0f, s7 = s0 + 7.0f; \n"
+    "  for (unsigned int i = 0; i < iterations; ++i) \n"
+    "  { \n"
+    "    s0 = mad(s0, a, b); s1 = mad(s1, a, b); s2 = mad(s2, a, b); s3 = mad(s3, a, b); \n"
+    "    s4 = mad(s4, a, b); s5 = mad(s5, a, b); s6 = mad(s6, a, b); s7 = mad(s7, a, b); \n"
+    "  } \n"
+    "  float4 s = (s0 + s1) + (s2 + s3) + (s4 + s5) + (s6 + s7); \n"
+    "  result[get_global_id(0)] = s.x + s.y + s.z + s.w; \n"
+    "} \n";
+
+
+    /** @brief Default file for the measured peaks: $OCL_ROOFLINE_CACHE if set, otherwise 'ocl-roofline.cache' in the working directory */
+    inline std::string roofline_cache_file()
+    {
+      const char * env = std::getenv("OCL_ROOFLINE_CACHE");
+      return env ? std::string(env) : std::string("ocl-roofline.cache");
+    }
+
+
+    /** @brief Peak bandwidth and FLOP/s of the device of a context, measured on first use and cached on disk */
+    class roofline
+    {
+    public:
+      /** @brief Loads the peaks of the device from 'cache_file', or measures and appends them. 'remeasure' ignores the cache. */
+      explicit roofline(context const & ctx, std::string const & cache_file = roofline_cache_file(), bool remeasure = false)
+        : bandwidth_(0), flops_(0), cached_(false)
+      {
+        std::string key = ctx.device_name() + " | " + ctx.driver_version();
+
+        if (!remeasure)
+          cached_ = load(cache_file, key);
+
+        if (!cached_)
+        {
+          measure(ctx);
+          std::ofstream file(cache_file.c_str(), std::ios::app);
+          if (file)   // a read-only working directory only costs the next run a measurement
+            file << bandwidth_ << " " << flops_ << " " << key << std::endl;
+        }
+      }
+
+      double bandwidth() const { return bandwidth_; }   // bytes per second
+      double flops()     const { return flops_; }       // floating point operations per second
+      bool   cached()    const { return cached_; }
+
+      /** @brief Arithmetic intensity (flops per byte) above which a kernel is compute bound */
+      double ridge_point() const { return flops_ / bandwidth_; }
+
+      /** @brief Attainable FLOP/s for a kernel with the given arithmetic intensity */
+      double attainable(double intensity) const { return std::min(flops_, intensity * bandwidth_); }
+
+      /** @brief Fraction of the roofline reached by a kernel moving 'bytes' and executing 'flop' operations in 'seconds' */
+      double efficiency(double bytes, double flop, double seconds) const
+      {
+        return std::max(bytes / bandwidth_, flop / flops_) / seconds;
+      }
+
+    private:
+      bool load(std::string const & cache_file, std::string const & key)
+      {
+        std::ifstream file(cache_file.c_str());
+        std::string line;
+        while (std::getline(file, line))
+        {
+          std::istringstream ss(line);
+          double bandwidth, flops;
+          std::string device;
+          if (!(ss >> bandwidth >> flops) || !std::getline(ss >> std::ws, device))
+            continue;
+          if (device == key && bandwidth > 0 && flops > 0)
+          {
+            bandwidth_ = bandwidth;
+            flops_     = flops;
+          }
+        }
+        return bandwidth_ > 0;   // the last matching line wins, so re-measured values replace older ones
+      }
+
+      void measure(context const & ctx)
+      {
+        cl_int err;
+        cl_command_queue queue = clCreateCommandQueue(ctx.handle(), ctx.device(), CL_QUEUE_PROFILING_ENABLE, &err); OPENCL_ERR_CHECK(err);
+        cl_program prog = ctx.build_program(roofline_program_source);
+        cl_kernel copy  = clCreateKernel(prog, "stream_copy", &err); OPENCL_ERR_CHECK(err);
+        cl_kernel chain = clCreateKernel(prog, "mad_chain", &err); OPENCL_ERR_CHECK(err);
+
+        //
+        // Bandwidth: copy 64 MB (or a quarter of the largest allocation), far beyond any cache
+        //
+        cl_ulong max_alloc;
+        err = clGetDeviceInfo(ctx.device(), CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &max_alloc, NULL); OPENCL_ERR_CHECK(err);
+        size_t bytes = std::min<size_t>(64*1024*1024, size_t(max_alloc / 4));
+        bytes -= bytes % (16 * 128);
+        cl_mem x = ctx.create_buffer(bytes);
+        cl_mem y = ctx.create_buffer(bytes);
+        err = clSetKernelArg(copy, 0, sizeof(cl_mem), (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(copy, 1, sizeof(cl_mem), (void*)&y); OPENCL_ERR_CHECK(err);
+        bandwidth_ = 2.0 * bytes / best_time(queue, copy, bytes / 16);
+
+        //
+        // FLOP/s: enough work items to fill every compute unit several times over
+        //
+        cl_uint compute_units;
+        err = clGetDeviceInfo(ctx.device(), CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &compute_units, NULL); OPENCL_ERR_CHECK(err);
+        size_t work_items = std::max<size_t>(compute_units, 1) * 8192;
+        cl_uint iterations = 1024;
+        float a = 0.999f, b = 0.001f;
+        cl_mem result = ctx.create_buffer(work_items * sizeof(float));
+        err = clSetKernelArg(chain, 0, sizeof(cl_mem),  (void*)&result); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(chain, 1, sizeof(float),   (void*)&a); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(chain, 2, sizeof(float),   (void*)&b); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(chain, 3, sizeof(cl_uint), (void*)&iterations); OPENCL_ERR_CHECK(err);
+        flops_ = 64.0 * iterations * work_items / best_time(queue, chain, work_items);
+
+        clReleaseMemObject(x);
+        clReleaseMemObject(y);
+        clReleaseMemObject(result);
+        clReleaseKernel(copy);
+        clReleaseKernel(chain);
+        clReleaseProgram(prog);
+        clReleaseCommandQueue(queue);
+      }
+
+      /** @brief Shortest execution time (seconds) of five launches, after one warmup launch */
+      static double best_time(cl_command_queue queue, cl_kernel k, size_t global_size)
+      {
+        size_t local_size = 128;
+        double best = 0;
+        for (int run=0; run<6; ++run)
+        {
+          cl_event e;
+          cl_int err = clEnqueueNDRangeKernel(queue, k, 1, NULL, &global_size, &local_size, 0, NULL, &e); OPENCL_ERR_CHECK(err);
+          err = clWaitForEvents(1, &e); OPENCL_ERR_CHECK(err);
+
+          cl_ulong start, end;
+          err = clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL); OPENCL_ERR_CHECK(err);
+          err = clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &end,   NULL); OPENCL_ERR_CHECK(err);
+          clReleaseEvent(e);
+
+          double time = (end - start) * 1e-9;
+          if (run > 0 && (best == 0 || time < best))
+            best = time;
+        }
+        return best;
+      }
+
+      double bandwidth_;
+      double flops_;
+      bool   cached_;
+    };
+
+  } //namespace ocl
+
+
+#endif
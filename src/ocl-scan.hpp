@@ -0,0 +1,367 @@
+#ifndef OPENCL_SCAN_HPP_
+#define OPENCL_SCAN_HPP_
+
+
+/** @file ocl-scan.hpp
+    @brief Inclusive and exclusive prefix sums (scans) of device vectors
+
+    Two implementations are provided:
+     - a work-efficient multi-level scan: each work group scans a block of 2*WG_SIZE entries in local memory
+       (the up-sweep is the same reduction tree as in vec_dot), the block sums are scanned recursively and added back.
+     - a single-pass scan with decoupled look-back, where each work group obtains its prefix from its predecessors
+       through flags in global memory. Requires global 32-bit atomics.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <sstream>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-buffer-pool.hpp"
+
+  namespace ocl
+  {
+
+    // Local work-group size used by all scan kernels. Each work group scans 2*WG_SIZE entries.
+    static const cl_uint scan_work_group_size = 128;
+
+    static const char * scan_program_source = ""
+    "#ifndef SCAN_T \n"
+    "#define SCAN_T float \n"
+    "#endif \n"
+    ""
+    "// Blelloch scan of 2*WG_SIZE entries in local memory. Returns the block sum, shared_array holds the exclusive scan. \n"
+    "SCAN_T scan_local(__local SCAN_T *shared_array) \n"
+    "{ \n"
+    "  unsigned int lid = get_local_id(0); \n"
+    "  unsigned int offset = 1; \n"
+    ""
+    "  // up-sweep: same reduction tree as in vec_dot, but keeping the partial sums in place \n"
+    "  for (unsigned int stride = WG_SIZE; stride > 0; stride /= 2) \n"
+    "  { \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "    if (lid < stride) \n"
+    "      shared_array[offset*(2*lid+2)-1] += shared_array[offset*(2*lid+1)-1]; \n"
+    "    offset *= 2; \n"
+    "  } \n"
+    ""
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  SCAN_T block_sum = shared_array[2*WG_SIZE-1]; \n"
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  if (lid == 0) \n"
+    "    shared_array[2*WG_SIZE-1] = 0; \n"
+    ""
+    "  // down-sweep: \n"
+    "  for (unsigned int stride = 1; stride < 2*WG_SIZE; stride *= 2) \n"
+    "  { \n"
+    "    offset /= 2; \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "    if (lid < stride) \n"
+    "    { \n"
+    "      unsigned int ai = offset*(2*lid+1)-1; \n"
+    "      unsigned int bi = offset*(2*lid+2)-1; \n"
+    "      SCAN_T tmp = shared_array[ai]; \n"
+    "      shared_array[ai]  = shared_array[bi]; \n"
+    "      shared_array[bi] += tmp; \n"
+    "    } \n"
+    "  } \n"
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  return block_sum; \n"
+    "} \n"
+    ""
+    "__kernel void scan_block(__global const SCAN_T *x, \n"
+    "                         __global SCAN_T *y, \n"
+    "                         __global SCAN_T *block_sums, \n"
+    "                         unsigned int N, \n"
+    "                         unsigned int inclusive) \n"
+    "{ \n"
+    "  __local SCAN_T shared_array[2*WG_SIZE]; \n"
+    "  unsigned int i0 = get_group_id(0) * 2 * WG_SIZE + get_local_id(0); \n"
+    "  unsigned int i1 = i0 + WG_SIZE; \n"
+    "  SCAN_T x0 = (i0 < N) ? x[i0] : 0; \n"
+    "  SCAN_T x1 = (i1 < N) ? x[i1] : 0; \n"
+    "  shared_array[get_local_id(0)]           = x0; \n"
+    "  shared_array[get_local_id(0) + WG_SIZE] = x1; \n"
+    ""
+    "  SCAN_T block_sum = scan_local(shared_array); \n"
+    "  if (get_local_id(0) == 0) \n"
+    "    block_sums[get_group_id(0)] = block_sum; \n"
+    ""
+    "  if (i0 < N) y[i0] = shared_array[get_local_id(0)]           + (inclusive ? x0 : 0); \n"
+    "  if (i1 < N) y[i1] = shared_array[get_local_id(0) + WG_SIZE] + (inclusive ? x1 : 0); \n"
+    "} \n"
+    ""
+    "__kernel void scan_add_block_sums(__global SCAN_T *y, \n"
+    "                                  __global const SCAN_T *block_sums, \n"
+    "                                  unsigned int N) \n"
+    "{ \n"
+    "  SCAN_T offset = block_sums[get_group_id(0)]; \n"
+    "  unsigned int i0 = get_group_id(0) * 2 * WG_SIZE + get_local_id(0); \n"
+    "  if (i0 < N)           y[i0]           += offset; \n"
+    "  if (i0 + WG_SIZE < N) y[i0 + WG_SIZE] += offset; \n"
+    "} \n";
+
+
+    static const char * scan_single_pass_program_source = ""
+    "#pragma OPENCL EXTENSION cl_khr_global_int32_base_atomics : enable \n"
+    "#if __OPENCL_VERSION__ < 110 \n"   // OpenCL 1.0 spells the extension functions atom_*
+    "#define atomic_inc  atom_inc \n"
+    "#define atomic_add  atom_add \n"
+    "#define atomic_xchg atom_xchg \n"
+    "#endif \n"
+    "#define FLAG_NOT_READY 0 \n"
+    "#define FLAG_AGGREGATE 1 \n"
+    "#define FLAG_PREFIX    2 \n"
+    ""
+    "__kernel void scan_init_flags(__global uint *tile_flags, \n"
+    "                              __global uint *tile_counter, \n"
+    "                              unsigned int num_tiles) \n"
+    "{ \n"
+    "  for (unsigned int i = get_global_id(0); i < num_tiles; i += get_global_size(0)) \n"
+    "    tile_flags[i] = FLAG_NOT_READY; \n"
+    "  if (get_global_id(0) == 0) \n"
+    "    *tile_counter = 0; \n"
+    "} \n"
+    ""
+    "__kernel void scan_single_pass(__global const SCAN_T *x, \n"
+    "                               __global SCAN_T *y, \n"
+    "                               volatile __global SCAN_T *tile_aggregates, \n"
+    "                               volatile __global SCAN_T *tile_prefixes, \n"
+    "                               volatile __global uint *tile_flags, \n"
+    "                               volatile __global uint *tile_counter, \n"
+    "                               unsigned int N, \n"
+    "                               unsigned int inclusive) \n"
+    "{ \n"
+    "  __local SCAN_T shared_array[2*WG_SIZE]; \n"
+    "  __local uint   tile_id; \n"
+    "  __local SCAN_T tile_exclusive_prefix; \n"
+    ""
+    "  // tiles are numbered in the order work groups start, so a predecessor is always already running: \n"
+    "  if (get_local_id(0) == 0) \n"
+    "    tile_id = atomic_inc(tile_counter); \n"
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  uint tile = tile_id; \n"
+    ""
+    "  unsigned int i0 = tile * 2 * WG_SIZE + get_local_id(0); \n"
+    "  unsigned int i1 = i0 + WG_SIZE; \n"
+    "  SCAN_T x0 = (i0 < N) ? x[i0] : 0; \n"
+    "  SCAN_T x1 = (i1 < N) ? x[i1] : 0; \n"
+    "  shared_array[get_local_id(0)]           = x0; \n"
+    "  shared_array[get_local_id(0) + WG_SIZE] = x1; \n"
+    ""
+    "  SCAN_T aggregate = scan_local(shared_array); \n"
+    ""
+    "  // publish own aggregate, then look back until a predecessor with a known inclusive prefix is found: \n"
+    "  if (get_local_id(0) == 0) \n"
+    "  { \n"
+    "    SCAN_T prefix = 0; \n"
+    "    if (tile > 0) \n"
+    "    { \n"
+    "      tile_aggregates[tile] = aggregate; \n"
+    "      mem_fence(CLK_GLOBAL_MEM_FENCE); \n"
+    "      atomic_xchg(tile_flags + tile, FLAG_AGGREGATE); \n"
+    ""
+    "      int pred = (int)tile - 1; \n"
+    "      while (pred >= 0) \n"
+    "      { \n"
+    "        uint flag = atomic_add(tile_flags + pred, 0); \n"
+    "        if (flag == FLAG_NOT_READY) \n"
+    "          continue; \n"
+    "        mem_fence(CLK_GLOBAL_MEM_FENCE); \n"
+    "        if (flag == FLAG_PREFIX) \n"
+    "        { \n"
+    "          prefix += tile_prefixes[pred]; \n"
+    "          break; \n"
+    "        } \n"
+    "        prefix += tile_aggregates[pred]; \n"
+    "        --pred; \n"
+    "      } \n"
+    "    } \n"
+    "    tile_prefixes[tile] = prefix + aggregate; \n"
+    "    mem_fence(CLK_GLOBAL_MEM_FENCE); \n"
+    "    atomic_xchg(tile_flags + tile, FLAG_PREFIX); \n"
+    "    tile_exclusive_prefix = prefix; \n"
+    "  } \n"
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    ""
+    "  SCAN_T prefix = tile_exclusive_prefix; \n"
+    "  if (i0 < N) y[i0] = prefix + shared_array[get_local_id(0)]           + (inclusive ? x0 : 0); \n"
+    "  if (i1 < N) y[i1] = prefix + shared_array[get_local_id(0) + WG_SIZE] + (inclusive ? x1 : 0); \n"
+    "} \n";
+
+
+    /** @brief Holds the compiled scan kernels for one scalar type and launches them.
+    *
+    *  @param scalar_type   OpenCL C type name of the entries, e.g. "float" or "uint"
+    */
+    class scan_kernels
+    {
+    public:
+      scan_kernels(context const & ctx, std::string const & scalar_type = "float")
+        : ctx_(ctx), pool_(NULL), single_pass_prog_(NULL)
+      {
+        cl_int err;
+        std::ostringstream options;
+        options << "-DSCAN_T=" << scalar_type << " -DWG_SIZE=" << scan_work_group_size;
+        scalar_size_ = (scalar_type == "double" || scalar_type == "long" || scalar_type == "ulong") ? 8 : 4;
+
+        prog_ = ctx_.build_program(scan_program_source, options.str());
+        block_kernel_     = clCreateKernel(prog_, "scan_block", &err); OPENCL_ERR_CHECK(err);
+        add_back_kernel_  = clCreateKernel(prog_, "scan_add_block_sums", &err); OPENCL_ERR_CHECK(err);
+
+        if (single_pass_supported(ctx_))
+        {
+          std::string source = std::string(scan_program_source) + scan_single_pass_program_source;
+          single_pass_prog_ = ctx_.build_program(source.c_str(), options.str());
+          init_flags_kernel_  = clCreateKernel(single_pass_prog_, "scan_init_flags", &err); OPENCL_ERR_CHECK(err);
+          single_pass_kernel_ = clCreateKernel(single_pass_prog_, "scan_single_pass", &err); OPENCL_ERR_CHECK(err);
+        }
+      }
+
+      ~scan_kernels()
+      {
+        clReleaseKernel(block_kernel_);
+        clReleaseKernel(add_back_kernel_);
+        clReleaseProgram(prog_);
+        if (single_pass_prog_)
+        {
+          clReleaseKernel(init_flags_kernel_);
+          clReleaseKernel(single_pass_kernel_);
+          clReleaseProgram(single_pass_prog_);
+        }
+      }
+
+      /** @brief Decoupled look-back requires global atomics (core since OpenCL 1.1, an extension in 1.0).
+      *
+      *  The kernel only uses functions of cl_khr_global_int32_base_atomics (atomic reads are atomic_add(p, 0)),
+      *  which are renamed from atom_* for OpenCL C 1.0.
+      */
+      static bool single_pass_supported(context const & ctx)
+      {
+        return ctx.device_version().find("OpenCL 1.0") == std::string::npos
+            || ctx.has_extension("cl_khr_global_int32_base_atomics");
+      }
+
+      bool single_pass_available() const { return single_pass_prog_ != NULL; }
+
+      /** @brief Takes the temporaries for block sums and tile states from 'pool' instead of clCreateBuffer. Pass NULL to disable. */
+      void use_pool(buffer_pool * pool) { pool_ = pool; }
+
+      /** @brief y[i] = x[0] + ... + x[i]. x and y may be the same buffer. */
+      void inclusive(cl_mem x, cl_mem y, cl_uint N) { multi_level(x, y, N, 1); }
+
+      /** @brief y[i] = x[0] + ... + x[i-1], y[0] = 0. x and y may be the same buffer. */
+      void exclusive(cl_mem x, cl_mem y, cl_uint N) { multi_level(x, y, N, 0); }
+
+      /** @brief Same as inclusive(), but using the single-pass decoupled look-back kernel. Falls back to the multi-level scan if not available. */
+      void inclusive_single_pass(cl_mem x, cl_mem y, cl_uint N) { single_pass(x, y, N, 1); }
+
+      /** @brief Same as exclusive(), but using the single-pass decoupled look-back kernel. Falls back to the multi-level scan if not available. */
+      void exclusive_single_pass(cl_mem x, cl_mem y, cl_uint N) { single_pass(x, y, N, 0); }
+
+    private:
+      scan_kernels(scan_kernels const &);
+      scan_kernels & operator=(scan_kernels const &);
+
+      cl_mem temporary(size_t num_bytes) { return pool_ ? pool_->allocate(num_bytes) : ctx_.create_buffer(num_bytes); }
+
+      // all scan commands go to the in-order queue of the context, hence the pool may hand out the buffer again right away:
+      void release_temporary(cl_mem buf) { if (pool_) pool_->release(buf); else clReleaseMemObject(buf); }
+
+      static cl_uint num_blocks(cl_uint N) { return (N + 2 * scan_work_group_size - 1) / (2 * scan_work_group_size); }
+
+      void multi_level(cl_mem x, cl_mem y, cl_uint N, cl_uint inclusive)
+      {
+        if (N == 0)
+          return;
+
+        cl_int err;
+        cl_uint num_groups = num_blocks(N);
+        cl_mem block_sums = temporary(num_groups * scalar_size_);
+
+        size_t  local_size = scan_work_group_size;
+        size_t global_size = num_groups * local_size;
+
+        err = clSetKernelArg(block_kernel_, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(block_kernel_, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(block_kernel_, 2, sizeof(cl_mem),  (void*)&block_sums); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(block_kernel_, 3, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(block_kernel_, 4, sizeof(cl_uint), (void*)&inclusive); OPENCL_ERR_CHECK(err);
+        err = clEnqueueNDRangeKernel(ctx_.queue(), block_kernel_, 1, NULL, &global_size, &local_size, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+
+        if (num_groups > 1)
+        {
+          // offsets of each block are the exclusive scan of the block sums:
+          multi_level(block_sums, block_sums, num_groups, 0);
+
+          err = clSetKernelArg(add_back_kernel_, 0, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+          err = clSetKernelArg(add_back_kernel_, 1, sizeof(cl_mem),  (void*)&block_sums); OPENCL_ERR_CHECK(err);
+          err = clSetKernelArg(add_back_kernel_, 2, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+          err = clEnqueueNDRangeKernel(ctx_.queue(), add_back_kernel_, 1, NULL, &global_size, &local_size, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+        }
+
+        // the OpenCL runtime defers the release until all enqueued commands using the buffer have finished (same for reuse by the pool, see above):
+        release_temporary(block_sums);
+      }
+
+      void single_pass(cl_mem x, cl_mem y, cl_uint N, cl_uint inclusive)
+      {
+        if (!single_pass_prog_)
+          return multi_level(x, y, N, inclusive);
+        if (N == 0)
+          return;
+
+        cl_int err;
+        cl_uint num_tiles = num_blocks(N);
+        cl_mem tile_aggregates = temporary(num_tiles * scalar_size_);
+        cl_mem tile_prefixes   = temporary(num_tiles * scalar_size_);
+        cl_mem tile_flags      = temporary(num_tiles * sizeof(cl_uint));
+        cl_mem tile_counter    = temporary(sizeof(cl_uint));
+
+        size_t  local_size = scan_work_group_size;
+        size_t global_size = num_tiles * local_size;
+        size_t  init_global_size = 128*128;
+
+        err = clSetKernelArg(init_flags_kernel_, 0, sizeof(cl_mem),  (void*)&tile_flags); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(init_flags_kernel_, 1, sizeof(cl_mem),  (void*)&tile_counter); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(init_flags_kernel_, 2, sizeof(cl_uint), (void*)&num_tiles); OPENCL_ERR_CHECK(err);
+        err = clEnqueueNDRangeKernel(ctx_.queue(), init_flags_kernel_, 1, NULL, &init_global_size, &local_size, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+
+        err = clSetKernelArg(single_pass_kernel_, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(single_pass_kernel_, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(single_pass_kernel_, 2, sizeof(cl_mem),  (void*)&tile_aggregates); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(single_pass_kernel_, 3, sizeof(cl_mem),  (void*)&tile_prefixes); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(single_pass_kernel_, 4, sizeof(cl_mem),  (void*)&tile_flags); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(single_pass_kernel_, 5, sizeof(cl_mem),  (void*)&tile_counter); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(single_pass_kernel_, 6, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(single_pass_kernel_, 7, sizeof(cl_uint), (void*)&inclusive); OPENCL_ERR_CHECK(err);
+        err = clEnqueueNDRangeKernel(ctx_.queue(), single_pass_kernel_, 1, NULL, &global_size, &local_size, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+
+        release_temporary(tile_aggregates);
+        release_temporary(tile_prefixes);
+        release_temporary(tile_flags);
+        release_temporary(tile_counter);
+      }
+
+      context const & ctx_;
+      buffer_pool *   pool_;
+      size_t     scalar_size_;
+      cl_program prog_;
+      cl_kernel  block_kernel_;
+      cl_kernel  add_back_kernel_;
+      cl_program single_pass_prog_;
+      cl_kernel  init_flags_kernel_;
+      cl_kernel  single_pass_kernel_;
+    };
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,617 @@
+#ifndef OPENCL_SPMV_HPP_
+#define OPENCL_SPMV_HPP_
+
+
+/** @file ocl-spmv.hpp
+    @brief Sparse matrix-vector products y = A*x on device vectors for CSR and SELL-C-sigma matrices
+
+    CSR kernels:
+     - scalar:   one work item per row
+     - vector:   one work group per row, reduced in local memory as in vec_dot
+     - adaptive: rows are grouped into row blocks of about one work group worth of nonzeros. Blocks with many short rows
+                 are streamed through local memory, blocks consisting of a single long row use the vector kernel.
+
+    The row blocks and the SELL-C-sigma format are computed from the CSR matrix on the device.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-scan.hpp"
+
+  namespace ocl
+  {
+
+    // Local work group size of the SpMV kernels. Also the target number of nonzeros per row block of CSR-adaptive.
+    static const cl_uint spmv_work_group_size = 128;
+
+    static const char * spmv_program_source = ""
+    "__kernel void csr_scalar(__global const uint  *row_ptr, \n"
+    "                         __global const uint  *col_idx, \n"
+    "                         __global const float *values, \n"
+    "                         __global const float *x, \n"
+    "                         __global float *y, \n"
+    "                         unsigned int rows) \n"
+    "{ \n"
+    "  for (unsigned int row  = get_global_id(0); \n"
+    "                    row  < rows; \n"
+    "                    row += get_global_size(0)) \n"
+    "  { \n"
+    "    float sum = 0; \n"
+    "    for (unsigned int j = row_ptr[row]; j < row_ptr[row+1]; ++j) \n"
+    "      sum += values[j] * x[col_idx[j]]; \n"
+    "    y[row] = sum; \n"
+    "  } \n"
+    "} \n"
+    ""
+    "// sum of the entries row_ptr[row]...row_ptr[row+1]-1, computed by the whole work group. Result valid in work item 0. \n"
+    "float csr_row_group(__global const uint  *row_ptr, \n"
+    "                    __global const uint  *col_idx, \n"
+    "                    __global const float *values, \n"
+    "                    __global const float *x, \n"
+    "                    unsigned int row, \n"
+    "                    __local float *shared_array) \n"
+    "{ \n"
+    "  float thread_result = 0; \n"
+    "  for (unsigned int j = row_ptr[row] + get_local_id(0); j < row_ptr[row+1]; j += get_local_size(0)) \n"
+    "    thread_result += values[j] * x[col_idx[j]]; \n"
+    ""
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  shared_array[get_local_id(0)] = thread_result; \n"
+    "  for (uint stride=get_local_size(0)/2; stride > 0; stride /= 2) \n"
+    "  { \n"
+    "    barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "    if (get_local_id(0) < stride) \n"
+    "      shared_array[get_local_id(0)] += shared_array[get_local_id(0) + stride]; \n"
+    "  } \n"
+    "  barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "  return shared_array[0]; \n"
+    "} \n"
+    ""
+    "__kernel void csr_vector(__global const uint  *row_ptr, \n"
+    "                         __global const uint  *col_idx, \n"
+    "                         __global const float *values, \n"
+    "                         __global const float *x, \n"
+    "                         __global float *y, \n"
+    "                         unsigned int rows, \n"
+    "                         __local float *shared_array) \n"
+    "{ \n"
+    "  for (unsigned int row = get_group_id(0); row < rows; row += get_num_groups(0)) \n"
+    "  { \n"
+    "    float sum = csr_row_group(row_ptr, col_idx, values, x, row, shared_array); \n"
+    "    if (get_local_id(0) == 0) \n"
+    "      y[row] = sum; \n"
+    "  } \n"
+    "} \n"
+    ""
+    "__kernel void csr_adaptive(__global const uint  *row_ptr, \n"
+    "                           __global const uint  *col_idx, \n"
+    "                           __global const float *values, \n"
+    "                           __global const float *x, \n"
+    "                           __global float *y, \n"
+    "                           __global const uint *row_blocks, \n"
+    "                           unsigned int num_blocks, \n"
+    "                           __local float *shared_array) \n"
+    "{ \n"
+    "  for (unsigned int block = get_group_id(0); block < num_blocks; block += get_num_groups(0)) \n"
+    "  { \n"
+    "    unsigned int first_row = row_blocks[block]; \n"
+    "    unsigned int last_row  = row_blocks[block+1]; \n"
+    ""
+    "    if (last_row - first_row == 1) // long row: CSR-vector \n"
+    "    { \n"
+    "      float sum = csr_row_group(row_ptr, col_idx, values, x, first_row, shared_array); \n"
+    "      if (get_local_id(0) == 0) \n"
+    "        y[first_row] = sum; \n"
+    "      continue; \n"
+    "    } \n"
+    ""
+    "    // many short rows: stream the products through local memory, then each work item sums up one row \n"
+    "    for (unsigned int pass_row = first_row; pass_row < last_row; pass_row += get_local_size(0)) \n"
+    "    { \n"
+    "      unsigned int pass_last_row = min(pass_row + (unsigned int)get_local_size(0), last_row); \n"
+    "      unsigned int row = pass_row + get_local_id(0); \n"
+    "      unsigned int row_start = (row < pass_last_row) ? row_ptr[row]   : 0; \n"
+    "      unsigned int row_stop  = (row < pass_last_row) ? row_ptr[row+1] : 0; \n"
+    "      float sum = 0; \n"
+    ""
+    "      for (unsigned int chunk = row_ptr[pass_row]; chunk < row_ptr[pass_last_row]; chunk += get_local_size(0)) \n"
+    "      { \n"
+    "        unsigned int j = chunk + get_local_id(0); \n"
+    "        barrier(CLK_LOCAL_MEM_FENCE); \n"
+    "        shared_array[get_local_id(0)] = (j < row_ptr[pass_last_row]) ? values[j] * x[col_idx[j]] : 0; \n"
+    "        barrier(CLK_LOCAL_MEM_FENCE); \n"
+    ""
+    "        unsigned int begin = max(row_start, chunk); \n"
+    "        unsigned int end   = min(row_stop,  chunk + (unsigned int)get_local_size(0)); \n"
+    "        for (unsigned int k = begin; k < end; ++k) \n"
+    "          sum += shared_array[k - chunk]; \n"
+    "      } \n"
+    ""
+    "      if (row < pass_last_row) \n"
+    "        y[row] = sum; \n"
+    "    } \n"
+    "  } \n"
+    "} \n"
+    ""
+    "// Sets flags[i] = 1 if row i starts a new row block \n"
+    "__kernel void csr_row_block_flags(__global const uint *row_ptr, \n"
+    "                                  __global uint *flags, \n"
+    "                                  unsigned int rows, \n"
+    "                                  unsigned int block_nnz) \n"
+    "{ \n"
+    "  for (unsigned int i  = get_global_id(0); \n"
+    "                    i  < rows; \n"
+    "                    i += get_global_size(0)) \n"
+    "  { \n"
+    "    uint flag = (i == 0) \n"
+    "             || (row_ptr[i] / block_nnz != row_ptr[i-1] / block_nnz)  // crossed a block boundary \n"
+    "             || (row_ptr[i+1] - row_ptr[i] > block_nnz);              // long rows form a block on their own \n"
+    "    flags[i] = flag ? 1 : 0; \n"
+    "  } \n"
+    "} \n"
+    ""
+    "__kernel void csr_row_block_scatter(__global const uint *flags, \n"
+    "                                    __global const uint *block_index, \n"
+    "                                    __global uint *row_blocks, \n"
+    "                                    unsigned int rows) \n"
+    "{ \n"
+    "  for (unsigned int i  = get_global_id(0); \n"
+    "                    i  < rows; \n"
+    "                    i += get_global_size(0)) \n"
+    "  { \n"
+    "    if (flags[i]) \n"
+    "      row_blocks[block_index[i]] = i; \n"
+    "    if (i == rows - 1) \n"
+    "      row_blocks[block_index[i] + flags[i]] = rows; \n"
+    "  } \n"
+    "} \n"
+    ""
+    "// SELL-C-sigma: sort rows by descending length within windows of sigma rows. One work group per window. \n"
+    "__kernel void sell_sort_window(__global const uint *row_ptr, \n"
+    "                               __global uint *permutation, \n"
+    "                               __global uint *sorted_lengths, \n"
+    "                               unsigned int rows, \n"
+    "                               unsigned int padded_rows, \n"
+    "                               unsigned int sigma) \n"
+    "{ \n"
+    "  unsigned int window_start = get_group_id(0) * sigma; \n"
+    "  unsigned int window_end   = min(window_start + sigma, padded_rows); \n"
+    "  for (unsigned int i = window_start + get_local_id(0); i < window_end; i += get_local_size(0)) \n"
+    "  { \n"
+    "    uint len_i = (i < rows) ? row_ptr[i+1] - row_ptr[i] : 0; \n"
+    "    unsigned int rank = window_start; \n"
+    "    for (unsigned int k = window_start; k < window_end; ++k) \n"
+    "    { \n"
+    "      uint len_k = (k < rows) ? row_ptr[k+1] - row_ptr[k] : 0; \n"
+    "      if (len_k > len_i || (len_k == len_i && k < i)) \n"
+    "        ++rank; \n"
+    "    } \n"
+    "    permutation[rank]    = i; \n"
+    "    sorted_lengths[rank] = len_i; \n"
+    "  } \n"
+    "} \n"
+    ""
+    "__kernel void sell_slice_sizes(__global const uint *sorted_lengths, \n"
+    "                               __global uint *slice_sizes, \n"
+    "                               unsigned int num_slices, \n"
+    "                               unsigned int C) \n"
+    "{ \n"
+    "  for (unsigned int s  = get_global_id(0); \n"
+    "                    s  < num_slices; \n"
+    "                    s += get_global_size(0)) \n"
+    "  { \n"
+    "    uint width = 0; \n"
+    "    for (unsigned int lane = 0; lane < C; ++lane) \n"
+    "      width = max(width, sorted_lengths[s*C + lane]); \n"
+    "    slice_sizes[s] = width * C; \n"
+    "  } \n"
+    "} \n"
+    ""
+    "// Entries of a slice are stored column by column, so that work items of consecutive rows access consecutive memory. \n"
+    "__kernel void sell_fill(__global const uint  *row_ptr, \n"
+    "                        __global const uint  *col_idx, \n"
+    "                        __global const float *values, \n"
+    "                        __global const uint  *permutation, \n"
+    "                        __global const uint  *slice_ptr, \n"
+    "                        __global uint  *sell_col_idx, \n"
+    "                        __global float *sell_values, \n"
+    "                        unsigned int rows, \n"
+    "                        unsigned int padded_rows, \n"
+    "                        unsigned int C) \n"
+    "{ \n"
+    "  for (unsigned int r  = get_global_id(0); \n"
+    "                    r  < padded_rows; \n"
+    "                    r += get_global_size(0)) \n"
+    "  { \n"
+    "    unsigned int slice = r / C; \n"
+    "    unsigned int lane  = r % C; \n"
+    "    unsigned int width = (slice_ptr[slice+1] - slice_ptr[slice]) / C; \n"
+    "    unsigned int row   = permutation[r]; \n"
+    "    unsigned int start = (row < rows) ? row_ptr[row]   : 0; \n"
+    "    unsigned int len   = (row < rows) ? row_ptr[row+1] - start : 0; \n"
+    "    for (unsigned int j = 0; j < width; ++j) \n"
+    "    { \n"
+    "      unsigned int idx = slice_ptr[slice] + j * C + lane; \n"
+    "      sell_col_idx[idx] = (j < len) ? col_idx[start + j] : 0; \n"
+    "      sell_values[idx]  = (j < len) ? values[start + j]  : 0; \n"
+    "    } \n"
+    "  } \n"
+    "} \n"
+    ""
+    "__kernel void sell_spmv(__global const uint  *slice_ptr, \n"
+    "                        __global const uint  *sell_col_idx, \n"
+    "                        __global const float *sell_values, \n"
+    "                        __global const uint  *permutation, \n"
+    "                        __global const float *x, \n"
+    "                        __global float *y, \n"
+    "                        unsigned int rows, \n"
+    "                        unsigned int padded_rows, \n"
+    "                        unsigned int C) \n"
+    "{ \n"
+    "  for (unsigned int r  = get_global_id(0); \n"
+    "                    r  < padded_rows; \n"
+    "                    r += get_global_size(0)) \n"
+    "  { \n"
+    "    unsigned int slice = r / C; \n"
+    "    unsigned int lane  = r % C; \n"
+    "    unsigned int begin = slice_ptr[slice] + lane; \n"
+    "    float sum = 0; \n"
+    "    for (unsigned int idx = begin; idx < slice_ptr[slice+1]; idx += C) \n"
+    "      sum += sell_values[idx] * x[sell_col_idx[idx]]; \n"
+    "    unsigned int row = permutation[r]; \n"
+    "    if (row < rows) \n"
+    "      y[row] = sum; \n"
+    "  } \n"
+    "} \n";
+
+
+    /** @brief A CSR matrix with 32-bit indices on the host. */
+    struct host_csr_matrix
+    {
+      host_csr_matrix() : rows(0), cols(0) {}
+
+      cl_uint rows;
+      cl_uint cols;
+      std::vector<unsigned int> row_ptr;
+      std::vector<unsigned int> col_idx;
+      std::vector<float>   values;
+
+      /** @brief y = A*x on the host, used as reference */
+      void apply(std::vector<float> const & x, std::vector<float> & y) const
+      {
+        for (cl_uint i=0; i<rows; ++i)
+        {
+          float sum = 0;
+          for (cl_uint j=row_ptr[i]; j<row_ptr[i+1]; ++j)
+            sum += values[j] * x[col_idx[j]];
+          y[i] = sum;
+        }
+      }
+    };
+
+    /** @brief 5-point finite difference discretization of the Laplace operator on an n-by-n grid (symmetric positive definite) */
+    inline host_csr_matrix poisson_2d(cl_uint n)
+    {
+      host_csr_matrix A;
+      A.rows = A.cols = n * n;
+      A.row_ptr.reserve(A.rows + 1);
+      A.row_ptr.push_back(0);
+      for (cl_uint i=0; i<n; ++i)
+        for (cl_uint j=0; j<n; ++j)
+        {
+          cl_uint row = i * n + j;
+          if (i > 0)   { A.col_idx.push_back(row - n); A.values.push_back(-1.0f); }
+          if (j > 0)   { A.col_idx.push_back(row - 1); A.values.push_back(-1.0f); }
+                         A.col_idx.push_back(row);     A.values.push_back( 4.0f);
+          if (j < n-1) { A.col_idx.push_back(row + 1); A.values.push_back(-1.0f); }
+          if (i < n-1) { A.col_idx.push_back(row + n); A.values.push_back(-1.0f); }
+          A.row_ptr.push_back(cl_uint(A.col_idx.size()));
+        }
+      return A;
+    }
+
+
+    /** @brief A CSR matrix in device memory. Row blocks for CSR-adaptive are computed by spmv_kernels::prepare_adaptive(). */
+    struct csr_matrix
+    {
+      csr_matrix(context const & ctx, host_csr_matrix const & A)
+        : rows(A.rows), cols(A.cols), nnz(cl_uint(A.values.size())), row_blocks(NULL), num_row_blocks(0)
+      {
+        row_ptr = ctx.create_buffer(sizeof(cl_uint) * A.row_ptr.size(), (void*)&(A.row_ptr[0]));
+        col_idx = ctx.create_buffer(sizeof(cl_uint) * std::max<size_t>(A.col_idx.size(), 1), A.col_idx.size() ? (void*)&(A.col_idx[0]) : NULL);
+        values  = ctx.create_buffer(sizeof(float)   * std::max<size_t>(A.values.size(), 1),  A.values.size()  ? (void*)&(A.values[0])  : NULL);
+      }
+
+      ~csr_matrix()
+      {
+        clReleaseMemObject(row_ptr);
+        clReleaseMemObject(col_idx);
+        clReleaseMemObject(values);
+        if (row_blocks)
+          clReleaseMemObject(row_blocks);
+      }
+
+      cl_uint rows;
+      cl_uint cols;
+      cl_uint nnz;
+      cl_mem  row_ptr;
+      cl_mem  col_idx;
+      cl_mem  values;
+
+      cl_mem  row_blocks;
+      cl_uint num_row_blocks;
+
+    private:
+      csr_matrix(csr_matrix const &);
+      csr_matrix & operator=(csr_matrix const &);
+    };
+
+
+    /** @brief A SELL-C-sigma matrix in device memory: rows are sorted by length within windows of sigma rows,
+    *          then stored in slices of C rows padded to the longest row in the slice. Created by spmv_kernels::convert().
+    */
+    struct sell_matrix
+    {
+      sell_matrix() : rows(0), padded_rows(0), C(0), sigma(0), num_slices(0), stored_entries(0),
+                      slice_ptr(NULL), col_idx(NULL), values(NULL), permutation(NULL) {}
+
+      ~sell_matrix()
+      {
+        if (slice_ptr)   clReleaseMemObject(slice_ptr);
+        if (col_idx)     clReleaseMemObject(col_idx);
+        if (values)      clReleaseMemObject(values);
+        if (permutation) clReleaseMemObject(permutation);
+      }
+
+      cl_uint rows;
+      cl_uint padded_rows;
+      cl_uint C;
+      cl_uint sigma;
+      cl_uint num_slices;
+      cl_uint stored_entries;   // including padding
+      cl_mem  slice_ptr;
+      cl_mem  col_idx;
+      cl_mem  values;
+      cl_mem  permutation;      // permutation[sorted row] = original row
+
+    private:
+      sell_matrix(sell_matrix const &);
+      sell_matrix & operator=(sell_matrix const &);
+    };
+
+
+    /** @brief Holds the compiled SpMV and format conversion kernels and launches them.
+    *
+    *  If 'event' is non-NULL, it receives the event of the SpMV kernel launch.
+    */
+    class spmv_kernels
+    {
+    public:
+      explicit spmv_kernels(context const & ctx)
+        : ctx_(ctx), uint_scan_(ctx, "uint")
+      {
+        cl_int err;
+        prog_ = ctx_.build_program(spmv_program_source);
+        csr_scalar_        = clCreateKernel(prog_, "csr_scalar", &err); OPENCL_ERR_CHECK(err);
+        csr_vector_        = clCreateKernel(prog_, "csr_vector", &err); OPENCL_ERR_CHECK(err);
+        csr_adaptive_      = clCreateKernel(prog_, "csr_adaptive", &err); OPENCL_ERR_CHECK(err);
+        row_block_flags_   = clCreateKernel(prog_, "csr_row_block_flags", &err); OPENCL_ERR_CHECK(err);
+        row_block_scatter_ = clCreateKernel(prog_, "csr_row_block_scatter", &err); OPENCL_ERR_CHECK(err);
+        sell_sort_window_  = clCreateKernel(prog_, "sell_sort_window", &err); OPENCL_ERR_CHECK(err);
+        sell_slice_sizes_  = clCreateKernel(prog_, "sell_slice_sizes", &err); OPENCL_ERR_CHECK(err);
+        sell_fill_         = clCreateKernel(prog_, "sell_fill", &err); OPENCL_ERR_CHECK(err);
+        sell_spmv_         = clCreateKernel(prog_, "sell_spmv", &err); OPENCL_ERR_CHECK(err);
+      }
+
+      ~spmv_kernels()
+      {
+        clReleaseKernel(csr_scalar_);
+        clReleaseKernel(csr_vector_);
+        clReleaseKernel(csr_adaptive_);
+        clReleaseKernel(row_block_flags_);
+        clReleaseKernel(row_block_scatter_);
+        clReleaseKernel(sell_sort_window_);
+        clReleaseKernel(sell_slice_sizes_);
+        clReleaseKernel(sell_fill_);
+        clReleaseKernel(sell_spmv_);
+        clReleaseProgram(prog_);
+      }
+
+      /** @brief y = A*x, one work item per row */
+      void csr_scalar(csr_matrix const & A, cl_mem x, cl_mem y, cl_event * event = NULL)
+      {
+        set_csr_args(csr_scalar_, A, x, y);
+        enqueue(csr_scalar_, 128*128, event);
+      }
+
+      /** @brief y = A*x, one work group per row */
+      void csr_vector(csr_matrix const & A, cl_mem x, cl_mem y, cl_event * event = NULL)
+      {
+        set_csr_args(csr_vector_, A, x, y);
+        cl_int err = clSetKernelArg(csr_vector_, 6, sizeof(float) * spmv_work_group_size, NULL); OPENCL_ERR_CHECK(err);
+        enqueue(csr_vector_, std::min<size_t>(A.rows, 1024) * spmv_work_group_size, event);
+      }
+
+      /** @brief y = A*x with CSR-adaptive. Computes the row blocks on first use. */
+      void csr_adaptive(csr_matrix & A, cl_mem x, cl_mem y, cl_event * event = NULL)
+      {
+        if (!A.row_blocks)
+          prepare_adaptive(A);
+
+        cl_int err;
+        set_csr_args(csr_adaptive_, A, x, y);
+        err = clSetKernelArg(csr_adaptive_, 5, sizeof(cl_mem),  (void*)&A.row_blocks); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(csr_adaptive_, 6, sizeof(cl_uint), (void*)&A.num_row_blocks); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(csr_adaptive_, 7, sizeof(float) * spmv_work_group_size, NULL); OPENCL_ERR_CHECK(err);
+        enqueue(csr_adaptive_, std::min<size_t>(A.num_row_blocks, 1024) * spmv_work_group_size, event);
+      }
+
+      /** @brief Computes the row blocks for CSR-adaptive on the device: flag rows that start a block, scan the flags, scatter. */
+      void prepare_adaptive(csr_matrix & A)
+      {
+        if (A.rows == 0)
+          return;
+
+        cl_int err;
+        cl_uint block_nnz = spmv_work_group_size;
+        cl_mem flags       = ctx_.create_buffer(sizeof(cl_uint) * A.rows);
+        cl_mem block_index = ctx_.create_buffer(sizeof(cl_uint) * A.rows);
+
+        err = clSetKernelArg(row_block_flags_, 0, sizeof(cl_mem),  (void*)&A.row_ptr); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(row_block_flags_, 1, sizeof(cl_mem),  (void*)&flags); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(row_block_flags_, 2, sizeof(cl_uint), (void*)&A.rows); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(row_block_flags_, 3, sizeof(cl_uint), (void*)&block_nnz); OPENCL_ERR_CHECK(err);
+        enqueue(row_block_flags_, 128*128);
+
+        uint_scan_.exclusive(flags, block_index, A.rows);
+
+        // the number of blocks determines the size of the row block array, so it needs to be known on the host:
+        cl_uint last_flag, last_index;
+        err = clEnqueueReadBuffer(ctx_.queue(), flags,       CL_FALSE, sizeof(cl_uint) * (A.rows - 1), sizeof(cl_uint), &last_flag,  0, NULL, NULL); OPENCL_ERR_CHECK(err);
+        err = clEnqueueReadBuffer(ctx_.queue(), block_index, CL_TRUE,  sizeof(cl_uint) * (A.rows - 1), sizeof(cl_uint), &last_index, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+        A.num_row_blocks = last_index + last_flag;
+        A.row_blocks = ctx_.create_buffer(sizeof(cl_uint) * (A.num_row_blocks + 1));
+
+        err = clSetKernelArg(row_block_scatter_, 0, sizeof(cl_mem),  (void*)&flags); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(row_block_scatter_, 1, sizeof(cl_mem),  (void*)&block_index); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(row_block_scatter_, 2, sizeof(cl_mem),  (void*)&A.row_blocks); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(row_block_scatter_, 3, sizeof(cl_uint), (void*)&A.rows); OPENCL_ERR_CHECK(err);
+        enqueue(row_block_scatter_, 128*128);
+
+        clReleaseMemObject(flags);
+        clReleaseMemObject(block_index);
+      }
+
+      /** @brief Converts a CSR matrix to SELL-C-sigma on the device. sigma must be a multiple of C. */
+      void convert(csr_matrix const & A, sell_matrix & B, cl_uint C = 32, cl_uint sigma = 256)
+      {
+        cl_int err;
+        if (sigma < C || sigma % C)
+          sigma = C;
+
+        B.rows        = A.rows;
+        B.C           = C;
+        B.sigma       = sigma;
+        B.num_slices  = (A.rows + C - 1) / C;
+        B.padded_rows = B.num_slices * C;
+        if (B.padded_rows == 0)
+          return;
+
+        B.permutation         = ctx_.create_buffer(sizeof(cl_uint) * B.padded_rows);
+        cl_mem sorted_lengths = ctx_.create_buffer(sizeof(cl_uint) * B.padded_rows);
+        cl_mem slice_sizes    = ctx_.create_buffer(sizeof(cl_uint) * (B.num_slices + 1));
+        B.slice_ptr           = ctx_.create_buffer(sizeof(cl_uint) * (B.num_slices + 1));
+
+        // sort within windows of sigma rows:
+        cl_uint num_windows = (B.padded_rows + sigma - 1) / sigma;
+        err = clSetKernelArg(sell_sort_window_, 0, sizeof(cl_mem),  (void*)&A.row_ptr); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_sort_window_, 1, sizeof(cl_mem),  (void*)&B.permutation); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_sort_window_, 2, sizeof(cl_mem),  (void*)&sorted_lengths); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_sort_window_, 3, sizeof(cl_uint), (void*)&A.rows); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_sort_window_, 4, sizeof(cl_uint), (void*)&B.padded_rows); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_sort_window_, 5, sizeof(cl_uint), (void*)&sigma); OPENCL_ERR_CHECK(err);
+        enqueue(sell_sort_window_, num_windows * spmv_work_group_size);
+
+        // slice sizes (with one trailing zero entry), scanned to slice offsets:
+        cl_uint num_slices_plus_one = B.num_slices + 1;
+        err = clSetKernelArg(sell_slice_sizes_, 0, sizeof(cl_mem),  (void*)&sorted_lengths); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_slice_sizes_, 1, sizeof(cl_mem),  (void*)&slice_sizes); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_slice_sizes_, 2, sizeof(cl_uint), (void*)&B.num_slices); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_slice_sizes_, 3, sizeof(cl_uint), (void*)&C); OPENCL_ERR_CHECK(err);
+        enqueue(sell_slice_sizes_, 128*128);
+
+        cl_uint zero = 0;
+        err = clEnqueueWriteBuffer(ctx_.queue(), slice_sizes, CL_TRUE, sizeof(cl_uint) * B.num_slices, sizeof(cl_uint), &zero, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+        uint_scan_.exclusive(slice_sizes, B.slice_ptr, num_slices_plus_one);
+
+        err = clEnqueueReadBuffer(ctx_.queue(), B.slice_ptr, CL_TRUE, sizeof(cl_uint) * B.num_slices, sizeof(cl_uint), &B.stored_entries, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+        B.col_idx = ctx_.create_buffer(sizeof(cl_uint) * std::max<size_t>(B.stored_entries, 1));
+        B.values  = ctx_.create_buffer(sizeof(float)   * std::max<size_t>(B.stored_entries, 1));
+
+        err = clSetKernelArg(sell_fill_, 0, sizeof(cl_mem),  (void*)&A.row_ptr); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_fill_, 1, sizeof(cl_mem),  (void*)&A.col_idx); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_fill_, 2, sizeof(cl_mem),  (void*)&A.values); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_fill_, 3, sizeof(cl_mem),  (void*)&B.permutation); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_fill_, 4, sizeof(cl_mem),  (void*)&B.slice_ptr); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_fill_, 5, sizeof(cl_mem),  (void*)&B.col_idx); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_fill_, 6, sizeof(cl_mem),  (void*)&B.values); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_fill_, 7, sizeof(cl_uint), (void*)&B.rows); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_fill_, 8, sizeof(cl_uint), (void*)&B.padded_rows); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_fill_, 9, sizeof(cl_uint), (void*)&C); OPENCL_ERR_CHECK(err);
+        enqueue(sell_fill_, 128*128);
+
+        clReleaseMemObject(sorted_lengths);
+        clReleaseMemObject(slice_sizes);
+      }
+
+      /** @brief y = A*x for a SELL-C-sigma matrix, one work item per row */
+      void sell(sell_matrix const & A, cl_mem x, cl_mem y, cl_event * event = NULL)
+      {
+        cl_int err;
+        err = clSetKernelArg(sell_spmv_, 0, sizeof(cl_mem),  (void*)&A.slice_ptr); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_spmv_, 1, sizeof(cl_mem),  (void*)&A.col_idx); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_spmv_, 2, sizeof(cl_mem),  (void*)&A.values); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_spmv_, 3, sizeof(cl_mem),  (void*)&A.permutation); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_spmv_, 4, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_spmv_, 5, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_spmv_, 6, sizeof(cl_uint), (void*)&A.rows); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_spmv_, 7, sizeof(cl_uint), (void*)&A.padded_rows); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(sell_spmv_, 8, sizeof(cl_uint), (void*)&A.C); OPENCL_ERR_CHECK(err);
+        enqueue(sell_spmv_, 128*128, event);
+      }
+
+    private:
+      spmv_kernels(spmv_kernels const &);
+      spmv_kernels & operator=(spmv_kernels const &);
+
+      void set_csr_args(cl_kernel k, csr_matrix const & A, cl_mem x, cl_mem y)
+      {
+        cl_int err;
+        err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&A.row_ptr); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&A.col_idx); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&A.values); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 3, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(k, 4, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        if (k != csr_adaptive_)
+        {
+          err = clSetKernelArg(k, 5, sizeof(cl_uint), (void*)&A.rows); OPENCL_ERR_CHECK(err);
+        }
+      }
+
+      void enqueue(cl_kernel k, size_t global_size, cl_event * event = NULL)
+      {
+        size_t local_size = spmv_work_group_size;
+        if (global_size == 0)
+          global_size = local_size;  // still launch, so that 'event' is valid. All kernels check their bounds.
+        cl_int err = clEnqueueNDRangeKernel(ctx_.queue(), k, 1, NULL, &global_size, &local_size, 0, NULL, event); OPENCL_ERR_CHECK(err);
+      }
+
+      context const & ctx_;
+      scan_kernels uint_scan_;
+      cl_program prog_;
+      cl_kernel  csr_scalar_;
+      cl_kernel  csr_vector_;
+      cl_kernel  csr_adaptive_;
+      cl_kernel  row_block_flags_;
+      cl_kernel  row_block_scatter_;
+      cl_kernel  sell_sort_window_;
+      cl_kernel  sell_slice_sizes_;
+      cl_kernel  sell_fill_;
+      cl_kernel  sell_spmv_;
+    };
+
+  } //namespace ocl
+
+
+#endif
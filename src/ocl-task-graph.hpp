@@ -0,0 +1,284 @@
+#ifndef OPENCL_TASK_GRAPH_HPP_
+#define OPENCL_TASK_GRAPH_HPP_
+
+
+/** @file ocl-task-graph.hpp
+    @brief Task graph of uploads, vec_add, vec_dot, reads and host callbacks with explicit dependencies
+
+    Each task is enqueued right away with the events of its dependencies as wait list. If the device supports
+    out-of-order queues, all tasks go to one CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE queue and the runtime is free to run
+    independent tasks concurrently. Otherwise tasks are distributed round-robin over several in-order queues.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-buffer-pool.hpp"
+
+  namespace ocl
+  {
+
+    class task_graph
+    {
+    public:
+      typedef std::size_t               task_id;
+      typedef std::vector<task_id>      dependency_list;
+
+      /** @brief Creates the queues for the graph.
+      *
+      *  @param num_in_order_queues   Number of in-order queues used if the device does not support out-of-order execution.
+      *  @param prefer_out_of_order   Set to false to always use in-order queues (e.g. for comparisons)
+      *  @param pool                  If not NULL, the partial results of dot tasks are taken from the pool and returned in clear(). Must outlive the graph.
+      */
+      explicit task_graph(context const & ctx, cl_uint num_in_order_queues = 4, bool prefer_out_of_order = true,
+                          cl_command_queue_properties extra_properties = 0, buffer_pool * pool = NULL)
+        : ctx_(ctx), pool_(pool), next_queue_(0), out_of_order_(false)
+      {
+        cl_int err;
+        cl_command_queue_properties supported;
+        err = clGetDeviceInfo(ctx_.device(), CL_DEVICE_QUEUE_PROPERTIES, sizeof(supported), &supported, NULL); OPENCL_ERR_CHECK(err);
+
+        if (prefer_out_of_order && (supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE))
+        {
+          out_of_order_ = true;
+          num_in_order_queues = 1;
+        }
+        if (num_in_order_queues == 0)
+          num_in_order_queues = 1;
+
+        for (cl_uint i=0; i<num_in_order_queues; ++i)
+        {
+          cl_command_queue q = clCreateCommandQueue(ctx_.handle(), ctx_.device(),
+                                                    (out_of_order_ ? CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE : 0) | extra_properties, &err); OPENCL_ERR_CHECK(err);
+          queues_.push_back(q);
+        }
+
+        prog_    = ctx_.build_program(blas1_program_source);
+        vec_add_ = clCreateKernel(prog_, "vec_add", &err); OPENCL_ERR_CHECK(err);
+        vec_dot_ = clCreateKernel(prog_, "vec_dot", &err); OPENCL_ERR_CHECK(err);
+        vec_sum_ = clCreateKernel(prog_, "vec_sum", &err); OPENCL_ERR_CHECK(err);
+      }
+
+      ~task_graph()
+      {
+        wait();
+        clear();
+        clReleaseKernel(vec_add_);
+        clReleaseKernel(vec_dot_);
+        clReleaseKernel(vec_sum_);
+        clReleaseProgram(prog_);
+        for (std::size_t i=0; i<queues_.size(); ++i)
+          clReleaseCommandQueue(queues_[i]);
+      }
+
+      bool out_of_order() const { return out_of_order_; }
+      std::size_t num_queues() const { return queues_.size(); }
+
+      /** @brief Copies 'num_bytes' from 'host_ptr' to 'buffer'. 'host_ptr' must stay valid until the task has completed. */
+      task_id upload(cl_mem buffer, size_t num_bytes, const void * host_ptr, dependency_list const & deps = dependency_list())
+      {
+        std::vector<cl_event> wait_list = events_of(deps);
+        cl_event e;
+        cl_int err = clEnqueueWriteBuffer(next_queue(), buffer, CL_FALSE, 0, num_bytes, host_ptr,
+                                          cl_uint(wait_list.size()), wait_list.size() ? &(wait_list[0]) : NULL, &e); OPENCL_ERR_CHECK(err);
+        return add_task(e);
+      }
+
+      /** @brief Copies 'num_bytes' from 'buffer' to 'host_ptr' without blocking. */
+      task_id read(cl_mem buffer, size_t num_bytes, void * host_ptr, dependency_list const & deps = dependency_list())
+      {
+        std::vector<cl_event> wait_list = events_of(deps);
+        cl_event e;
+        cl_int err = clEnqueueReadBuffer(next_queue(), buffer, CL_FALSE, 0, num_bytes, host_ptr,
+                                         cl_uint(wait_list.size()), wait_list.size() ? &(wait_list[0]) : NULL, &e); OPENCL_ERR_CHECK(err);
+        return add_task(e);
+      }
+
+      /** @brief x += y */
+      task_id add(cl_mem x, cl_mem y, cl_uint N, dependency_list const & deps = dependency_list())
+      {
+        cl_int err;
+        err = clSetKernelArg(vec_add_, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_add_, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_add_, 2, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        return add_task(enqueue(vec_add_, next_queue(), blas1_global_size, events_of(deps)));
+      }
+
+      /** @brief result[result_index] = x^T y. Each dot task gets its own buffer for the partial results, so that dot tasks can run concurrently. */
+      task_id dot(cl_mem x, cl_mem y, cl_mem result, cl_uint result_index, cl_uint N, dependency_list const & deps = dependency_list())
+      {
+        cl_int err;
+        cl_uint num_partials = cl_uint(blas1_global_size / blas1_local_size);
+        cl_mem partials = pool_ ? pool_->allocate(num_partials * sizeof(float)) : ctx_.create_buffer(num_partials * sizeof(float));
+        temporaries_.push_back(partials);
+
+        // both kernels go to the same queue, the second one waits for the first:
+        cl_command_queue q = next_queue();
+        err = clSetKernelArg(vec_dot_, 0, sizeof(cl_mem),  (void*)&x); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_dot_, 1, sizeof(cl_mem),  (void*)&y); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_dot_, 2, sizeof(cl_mem),  (void*)&partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_dot_, 3, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_dot_, 4, sizeof(float) * blas1_local_size, NULL); OPENCL_ERR_CHECK(err);
+        cl_event partials_done = enqueue(vec_dot_, q, blas1_global_size, events_of(deps));
+
+        err = clSetKernelArg(vec_sum_, 0, sizeof(cl_mem),  (void*)&partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_sum_, 1, sizeof(cl_uint), (void*)&num_partials); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_sum_, 2, sizeof(cl_mem),  (void*)&result); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_sum_, 3, sizeof(cl_uint), (void*)&result_index); OPENCL_ERR_CHECK(err);
+        err = clSetKernelArg(vec_sum_, 4, sizeof(float) * blas1_local_size, NULL); OPENCL_ERR_CHECK(err);
+        cl_event sum_done = enqueue(vec_sum_, q, blas1_local_size, std::vector<cl_event>(1, partials_done));
+        clReleaseEvent(partials_done);
+        return add_task(sum_done);
+      }
+
+      /** @brief Runs 'f' on the host once all dependencies have completed. 'f' runs on a thread of the OpenCL runtime. */
+      task_id host(std::function<void()> f, dependency_list const & deps = dependency_list())
+      {
+        cl_int err;
+        cl_event done = clCreateUserEvent(ctx_.handle(), &err); OPENCL_ERR_CHECK(err);
+        if (deps.empty())
+        {
+          f();
+          err = clSetUserEventStatus(done, CL_COMPLETE); OPENCL_ERR_CHECK(err);
+          return add_task(done);
+        }
+
+        std::shared_ptr<host_task> task(new host_task(f, done, deps.size()));
+        for (std::size_t i=0; i<deps.size(); ++i)
+        {
+          std::shared_ptr<host_task> * ref = new std::shared_ptr<host_task>(task);
+          err = clSetEventCallback(events_[deps[i]], CL_COMPLETE, &task_graph::host_task_callback, ref); OPENCL_ERR_CHECK(err);
+        }
+        return add_task(done);
+      }
+
+      /** @brief Submits all enqueued tasks to the device without waiting */
+      void flush()
+      {
+        for (std::size_t i=0; i<queues_.size(); ++i)
+        {
+          cl_int err = clFlush(queues_[i]); OPENCL_ERR_CHECK(err);
+        }
+      }
+
+      /** @brief Waits for a single task */
+      void wait(task_id id)
+      {
+        flush();
+        cl_int err = clWaitForEvents(1, &(events_[id])); OPENCL_ERR_CHECK(err);
+      }
+
+      /** @brief Waits for all tasks */
+      void wait()
+      {
+        flush();
+        if (events_.size())
+        {
+          cl_int err = clWaitForEvents(cl_uint(events_.size()), &(events_[0])); OPENCL_ERR_CHECK(err);
+        }
+      }
+
+      /** @brief Releases all tasks. Only call after wait(). Task ids are invalidated. */
+      void clear()
+      {
+        for (std::size_t i=0; i<events_.size(); ++i)
+          clReleaseEvent(events_[i]);
+        events_.clear();
+        // tasks may run in any order, hence temporaries only go back to the pool once everything has completed:
+        for (std::size_t i=0; i<temporaries_.size(); ++i)
+        {
+          if (pool_)
+            pool_->release(temporaries_[i]);
+          else
+            clReleaseMemObject(temporaries_[i]);
+        }
+        temporaries_.clear();
+      }
+
+      /** @brief The event of a task, e.g. for profiling. Owned by the graph. */
+      cl_event event(task_id id) const { return events_[id]; }
+
+    private:
+      task_graph(task_graph const &);
+      task_graph & operator=(task_graph const &);
+
+      struct host_task
+      {
+        host_task(std::function<void()> func, cl_event e, std::size_t n) : f(func), done(e), remaining(int(n)) {}
+
+        std::function<void()> f;
+        cl_event              done;
+        std::atomic<int>      remaining;
+      };
+
+      static void CL_CALLBACK host_task_callback(cl_event, cl_int, void * user_data)
+      {
+        std::shared_ptr<host_task> * ref = static_cast<std::shared_ptr<host_task> *>(user_data);
+        if (--((*ref)->remaining) == 0)
+        {
+          (*ref)->f();
+          clSetUserEventStatus((*ref)->done, CL_COMPLETE);
+        }
+        delete ref;
+      }
+
+      cl_command_queue next_queue()
+      {
+        cl_command_queue q = queues_[next_queue_];
+        next_queue_ = (next_queue_ + 1) % queues_.size();
+        return q;
+      }
+
+      std::vector<cl_event> events_of(dependency_list const & deps) const
+      {
+        std::vector<cl_event> result(deps.size());
+        for (std::size_t i=0; i<deps.size(); ++i)
+          result[i] = events_[deps[i]];
+        return result;
+      }
+
+      cl_event enqueue(cl_kernel k, cl_command_queue q, size_t global_size, std::vector<cl_event> const & wait_list)
+      {
+        size_t local_size = blas1_local_size;
+        cl_event e;
+        cl_int err = clEnqueueNDRangeKernel(q, k, 1, NULL, &global_size, &local_size,
+                                            cl_uint(wait_list.size()), wait_list.size() ? &(wait_list[0]) : NULL, &e); OPENCL_ERR_CHECK(err);
+        return e;
+      }
+
+      task_id add_task(cl_event e)
+      {
+        events_.push_back(e);
+        return events_.size() - 1;
+      }
+
+      context const &               ctx_;
+      buffer_pool *                 pool_;
+      std::vector<cl_command_queue> queues_;
+      std::size_t                   next_queue_;
+      bool                          out_of_order_;
+      std::vector<cl_event>         events_;
+      std::vector<cl_mem>           temporaries_;
+
+      cl_program prog_;
+      cl_kernel  vec_add_;
+      cl_kernel  vec_dot_;
+      cl_kernel  vec_sum_;
+    };
+
+  } //namespace ocl
+
+
+#endif
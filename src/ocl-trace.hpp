@@ -0,0 +1,303 @@
+#ifndef OPENCL_TRACE_HPP_
+#define OPENCL_TRACE_HPP_
+
+
+/** @file ocl-trace.hpp
+    @brief Tracing of host spans and OpenCL commands on one timeline, printed as a breakdown or exported as Chrome trace-event JSON
+
+    Host spans are opened with begin() and closed with end() in stack order. Device commands are added with record(),
+    right after they have been enqueued to a queue with CL_QUEUE_PROFILING_ENABLE. Their QUEUED/SUBMIT/START/END
+    timestamps are taken from the device clock, which is mapped to the host clock by the smallest observed difference
+    between the return of the enqueue call and CL_PROFILING_COMMAND_QUEUED (the QUEUED stamp is taken during the call).
+
+    The JSON written by write_chrome_trace() can be loaded in chrome://tracing or https://ui.perfetto.dev
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "ocl-error.hpp"
+
+  namespace ocl
+  {
+
+    class trace
+    {
+    public:
+      trace() : origin_(clock_type::now()), resolved_(0), have_offset_(false), offset_(0) {}
+
+      ~trace()
+      {
+        for (std::size_t i=0; i<commands_.size(); ++i)
+          clReleaseEvent(commands_[i].event);
+      }
+
+      /** @brief Opens a span nested in the currently open one */
+      void begin(std::string const & name, std::string const & category = "host")
+      {
+        span s;
+        s.name     = name;
+        s.category = category;
+        s.depth    = open_.size();
+        s.start    = now();
+        s.end      = s.start;
+        open_.push_back(spans_.size());
+        spans_.push_back(s);
+      }
+
+      /** @brief Closes the most recently opened span */
+      void end()
+      {
+        if (open_.empty())
+          throw std::runtime_error("trace::end() without matching begin()");
+        spans_[open_.back()].end = now();
+        open_.pop_back();
+      }
+
+      /** @brief Adds the device command behind 'e' (retained by the trace). Call right after the enqueue call returns. */
+      void record(cl_event e, std::string const & name)
+      {
+        command c;
+        c.name     = name;
+        c.event    = e;
+        c.recorded = now();
+        cl_int err = clRetainEvent(e); OPENCL_ERR_CHECK(err);
+        commands_.push_back(c);
+      }
+
+      /** @brief Waits for the recorded commands and fetches their timestamps. Call before releasing the queues and the context,
+      *         print_commands() and write_chrome_trace() then only fetch the timestamps of commands recorded afterwards.
+      */
+      void fetch_profiling_info() { resolve_commands(); }
+
+      /** @brief Prints the recorded device commands: time waiting in the queue, execution time, and idle gap of the device before the command */
+      void print_commands(std::ostream & os)
+      {
+        resolve_commands();
+        os << "# Device commands (queued -> start, start -> end, gap to previous end):" << std::endl;
+        bool   have_previous = false;
+        double previous_end  = 0;
+        for (std::size_t i=0; i<commands_.size(); ++i)
+        {
+          command const & c = commands_[i];
+          os << "#   " << std::left << std::setw(36) << c.name << std::right << std::fixed << std::setprecision(3);
+          if (!c.valid)
+          {
+            os << "  (no profiling information)" << std::endl;
+            continue;
+          }
+          os << std::setw(12) << (c.start - c.queued) * 1e-3 << " ms"
+             << std::setw(12) << (c.end - c.start) * 1e-3 << " ms";
+          if (have_previous)
+            os << std::setw(12) << (c.start - previous_end) * 1e-3 << " ms";
+          os << std::endl;
+          previous_end  = c.end;
+          have_previous = true;
+        }
+        os.unsetf(std::ios_base::floatfield);
+        os << std::setprecision(6);
+      }
+
+      /** @brief Prints all spans in the order they were opened, indented by nesting depth, with their share of the total time */
+      void print_phases(std::ostream & os) const
+      {
+        double total = 0;
+        for (std::size_t i=0; i<spans_.size(); ++i)
+          if (spans_[i].depth == 0)
+            total += spans_[i].end - spans_[i].start;
+
+        os << "# Phase breakdown (wall clock):" << std::endl;
+        for (std::size_t i=0; i<spans_.size(); ++i)
+        {
+          span const & s = spans_[i];
+          std::string label = std::string(2 * s.depth, ' ') + s.name;
+          os << "#   " << std::left << std::setw(48) << label << std::right
+             << std::setw(12) << std::fixed << std::setprecision(3) << (s.end - s.start) * 1e-3 << " ms"
+             << std::setw(8) << std::setprecision(1) << (total > 0 ? 100.0 * (s.end - s.start) / total : 0) << " %" << std::endl;
+        }
+        os << "#   " << std::left << std::setw(48) << "total" << std::right
+           << std::setw(12) << std::setprecision(3) << total * 1e-3 << " ms" << std::endl;
+        os.unsetf(std::ios_base::floatfield);
+        os << std::setprecision(6);
+      }
+
+      /** @brief Writes all spans and commands as Chrome trace-event JSON ("X" events, timestamps in microseconds since construction).
+      *
+      *  Host spans go to the row 'host'. Each command queue gets two rows: execution (START to END) and waiting (QUEUED to START).
+      *  Waits for all recorded commands.
+      */
+      void write_chrome_trace(std::string const & filename)
+      {
+        resolve_commands();
+
+        std::ofstream file(filename.c_str());
+        if (!file)
+          throw std::runtime_error("Cannot write trace file " + filename);
+
+        file << "{\"traceEvents\":[" << std::endl;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"host\"}}";
+        for (std::size_t q=0; q<queues_.size(); ++q)
+        {
+          file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << 2*q + 2 << ",\"args\":{\"name\":\"queue " << q << ": execution\"}}";
+          file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << 2*q + 3 << ",\"args\":{\"name\":\"queue " << q << ": waiting\"}}";
+        }
+
+        file << std::fixed << std::setprecision(3);
+        for (std::size_t i=0; i<spans_.size(); ++i)
+          write_event(file, spans_[i].name, spans_[i].category, 1, spans_[i].start, spans_[i].end);
+
+        for (std::size_t i=0; i<commands_.size(); ++i)
+        {
+          command const & c = commands_[i];
+          if (!c.valid)
+            continue;
+          write_event(file, c.name, c.category, 2 * c.queue_index + 2, c.start + offset_, c.end + offset_);
+          write_event(file, c.name + " (queued)", c.category, 2 * c.queue_index + 3, c.queued + offset_, c.start + offset_, c.submit - c.queued);
+        }
+        file << std::endl << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+        file.unsetf(std::ios_base::floatfield);
+      }
+
+    private:
+      typedef std::chrono::steady_clock  clock_type;
+
+      struct span
+      {
+        std::string name;
+        std::string category;
+        std::size_t depth;
+        double      start;   // microseconds since construction
+        double      end;
+      };
+
+      struct command
+      {
+        command() : event(NULL), queue_index(0), recorded(0), valid(false), queued(0), submit(0), start(0), end(0) {}
+
+        std::string name;
+        std::string category;
+        cl_event    event;
+        std::size_t queue_index;
+        double      recorded;   // host time right after the enqueue call
+        bool        valid;
+        double      queued;     // device time in microseconds, add offset_ for host time
+        double      submit;
+        double      start;
+        double      end;
+      };
+
+      trace(trace const &);
+      trace & operator=(trace const &);
+
+      /** @brief Fetches the profiling information of all commands recorded since the last call and updates the clock offset */
+      void resolve_commands()
+      {
+        if (resolved_ == commands_.size())
+          return;
+
+        std::vector<cl_event> events;
+        for (std::size_t i=resolved_; i<commands_.size(); ++i)
+          events.push_back(commands_[i].event);
+        cl_int err = clWaitForEvents(cl_uint(events.size()), &(events[0])); OPENCL_ERR_CHECK(err);
+
+        for (std::size_t i=resolved_; i<commands_.size(); ++i)
+        {
+          command & c = commands_[i];
+          cl_ulong stamps[4];
+          cl_int status = clGetEventProfilingInfo(c.event, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &(stamps[0]), NULL);
+          if (status != CL_SUCCESS)    // e.g. queue without CL_QUEUE_PROFILING_ENABLE, or a user event
+            continue;
+          err = clGetEventProfilingInfo(c.event, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &(stamps[1]), NULL); OPENCL_ERR_CHECK(err);
+          err = clGetEventProfilingInfo(c.event, CL_PROFILING_COMMAND_START,  sizeof(cl_ulong), &(stamps[2]), NULL); OPENCL_ERR_CHECK(err);
+          err = clGetEventProfilingInfo(c.event, CL_PROFILING_COMMAND_END,    sizeof(cl_ulong), &(stamps[3]), NULL); OPENCL_ERR_CHECK(err);
+          c.valid  = true;
+          c.queued = double(stamps[0]) * 1e-3;
+          c.submit = double(stamps[1]) * 1e-3;
+          c.start  = double(stamps[2]) * 1e-3;
+          c.end    = double(stamps[3]) * 1e-3;
+
+          cl_command_type type;
+          err = clGetEventInfo(c.event, CL_EVENT_COMMAND_TYPE, sizeof(cl_command_type), &type, NULL); OPENCL_ERR_CHECK(err);
+          c.category = command_category(type);
+
+          cl_command_queue q;
+          err = clGetEventInfo(c.event, CL_EVENT_COMMAND_QUEUE, sizeof(cl_command_queue), &q, NULL); OPENCL_ERR_CHECK(err);
+          c.queue_index = std::find(queues_.begin(), queues_.end(), q) - queues_.begin();
+          if (c.queue_index == queues_.size())
+            queues_.push_back(q);
+
+          if (!have_offset_ || c.recorded - c.queued < offset_)
+            offset_ = c.recorded - c.queued;
+          have_offset_ = true;
+        }
+        resolved_ = commands_.size();
+      }
+
+      static std::string command_category(cl_command_type type)
+      {
+        switch (type)
+        {
+        case CL_COMMAND_NDRANGE_KERNEL: return "kernel";
+        case CL_COMMAND_TASK:           return "kernel";
+        case CL_COMMAND_WRITE_BUFFER:   return "write";
+        case CL_COMMAND_READ_BUFFER:    return "read";
+        case CL_COMMAND_COPY_BUFFER:    return "copy";
+        case CL_COMMAND_MAP_BUFFER:     return "map";
+        case CL_COMMAND_UNMAP_MEM_OBJECT: return "unmap";
+        default:                        return "command";
+        }
+      }
+
+      void write_event(std::ostream & os, std::string const & name, std::string const & category, int tid, double start, double end, double queued_to_submit = -1) const
+      {
+        os << ",\n{\"name\":\"" << escape(name) << "\",\"cat\":\"" << escape(category)
+           << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << start << ",\"dur\":" << end - start;
+        if (queued_to_submit >= 0)
+          os << ",\"args\":{\"queued_to_submit_us\":" << queued_to_submit << "}";
+        os << "}";
+      }
+
+      double now() const { return std::chrono::duration<double, std::micro>(clock_type::now() - origin_).count(); }
+
+      static std::string escape(std::string const & str)
+      {
+        std::string result;
+        for (std::size_t i=0; i<str.size(); ++i)
+        {
+          if (str[i] == '"' || str[i] == '\\')
+            result += '\\';
+          if (str[i] == '\n')
+            result += "\\n";
+          else
+            result += str[i];
+        }
+        return result;
+      }
+
+      clock_type::time_point   origin_;
+      std::vector<span>        spans_;
+      std::vector<std::size_t> open_;
+      std::vector<command>     commands_;
+      std::vector<cl_command_queue> queues_;   // in order of first appearance, not retained
+      std::size_t              resolved_;       // number of commands with fetched timestamps
+      bool                     have_offset_;
+      double                   offset_;         // host time minus device time, in microseconds
+    };
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef OPENCL_TUNER_HPP_
+#define OPENCL_TUNER_HPP_
+
+
+/** @file ocl-tuner.hpp
+    @brief Parameter sweeps over kernel configurations (tile sizes, work group sizes, ...)
+
+    A kernel configuration is a parameter_set of named values, which enter the kernel sources as -D macros.
+    The reserved parameter BUILD_PROFILE selects compiler flags instead (see build_profile_options()), so that
+    floating-point build options are swept like any other parameter and end up in the program cache key.
+    tune() runs a user-supplied benchmark for every configuration of a parameter_space and keeps the fastest.
+*/
+
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <cstdlib>
+#include <iostream>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+
+  namespace ocl
+  {
+
+    /** @brief Compiler flags of a named build profile:
+    *
+    *   strict           no flags, IEEE-conforming rounding and no reassociation
+    *   mad              -cl-mad-enable (a * b + c may be computed with reduced accuracy)
+    *   no_signed_zeros  -cl-no-signed-zeros
+    *   unsafe           -cl-unsafe-math-optimizations (includes mad and no_signed_zeros, allows reassociation)
+    *   fast_relaxed     -cl-fast-relaxed-math (unsafe plus finite math only)
+    */
+    inline std::string build_profile_options(std::string const & profile)
+    {
+      if (profile == "strict")          return "";
+      if (profile == "mad")             return "-cl-mad-enable";
+      if (profile == "no_signed_zeros") return "-cl-no-signed-zeros";
+      if (profile == "unsafe")          return "-cl-unsafe-math-optimizations";
+      if (profile == "fast_relaxed")    return "-cl-fast-relaxed-math";
+      throw std::runtime_error("Unknown build profile " + profile);
+    }
+
+    /** @brief All build profiles, from strict to most relaxed */
+    inline std::vector<std::string> build_profiles()
+    {
+      return std::vector<std::string>{"strict", "mad", "no_signed_zeros", "unsafe", "fast_relaxed"};
+    }
+
+    /** @brief Named kernel parameters. Each entry is passed to the OpenCL compiler as -DNAME=value, except BUILD_PROFILE. */
+    class parameter_set
+    {
+    public:
+      typedef std::map<std::string, std::string>::const_iterator  const_iterator;
+
+      void set(std::string const & name, std::string const & value) { values_[name] = value; }
+      void set(std::string const & name, int value)
+      {
+        std::ostringstream ss;
+        ss << value;
+        values_[name] = ss.str();
+      }
+
+      bool has(std::string const & name) const { return values_.find(name) != values_.end(); }
+
+      std::string const & str(std::string const & name) const
+      {
+        static const std::string empty;
+        const_iterator it = values_.find(name);
+        return (it != values_.end()) ? it->second : empty;
+      }
+
+      int value(std::string const & name) const { return std::atoi(str(name).c_str()); }
+
+      /** @brief The build options defining all parameters as macros, followed by the flags of the build profile (if any) */
+      std::string build_options() const
+      {
+        std::ostringstream ss;
+        for (const_iterator it = values_.begin(); it != values_.end(); ++it)
+          if (it->first != "BUILD_PROFILE")
+            ss << (ss.tellp() > 0 ? " " : "") << "-D" << it->first << "=" << it->second;
+        std::string flags = has("BUILD_PROFILE") ? build_profile_options(str("BUILD_PROFILE")) : std::string();
+        if (!flags.empty())
+          ss << (ss.tellp() > 0 ? " " : "") << flags;
+        return ss.str();
+      }
+
+      /** @brief Human readable representation, e.g. 'TILE_M=64 TILE_N=64' */
+      std::string to_string() const
+      {
+        std::ostringstream ss;
+        for (const_iterator it = values_.begin(); it != values_.end(); ++it)
+          ss << (it == values_.begin() ? "" : " ") << it->first << "=" << it->second;
+        return ss.str();
+      }
+
+      const_iterator begin() const { return values_.begin(); }
+      const_iterator end()   const { return values_.end(); }
+
+      bool operator<(parameter_set const & other) const { return values_ < other.values_; }
+
+    private:
+      std::map<std::string, std::string> values_;
+    };
+
+
+    /** @brief The set of values to sweep for each parameter. configurations() returns the cartesian product. */
+    class parameter_space
+    {
+    public:
+      void add(std::string const & name, std::vector<std::string> const & values)
+      {
+        names_.push_back(name);
+        values_.push_back(values);
+      }
+
+      void add(std::string const & name, std::vector<int> const & values)
+      {
+        std::vector<std::string> string_values;
+        for (std::size_t i=0; i<values.size(); ++i)
+        {
+          std::ostringstream ss;
+          ss << values[i];
+          string_values.push_back(ss.str());
+        }
+        add(name, string_values);
+      }
+
+      std::vector<parameter_set> configurations() const
+      {
+        std::vector<parameter_set> result(1);
+        for (std::size_t i=0; i<names_.size(); ++i)
+        {
+          std::vector<parameter_set> extended;
+          for (std::size_t j=0; j<result.size(); ++j)
+            for (std::size_t k=0; k<values_[i].size(); ++k)
+            {
+              parameter_set p = result[j];
+              p.set(names_[i], values_[i][k]);
+              extended.push_back(p);
+            }
+          result.swap(extended);
+        }
+        return result;
+      }
+
+    private:
+      std::vector<std::string>               names_;
+      std::vector<std::vector<std::string> > values_;
+    };
+
+
+    struct tuning_result
+    {
+      tuning_result() : best_time(std::numeric_limits<double>::max()), tested(0) {}
+
+      parameter_set best;
+      double        best_time;   // seconds
+      std::size_t   tested;      // number of valid configurations
+    };
+
+
+    /** @brief Runs 'benchmark' for each configuration of 'space' and returns the fastest.
+    *
+    *  @param benchmark   Functor taking a parameter_set and returning the execution time in seconds.
+    *                     A negative return value marks the configuration as invalid (e.g. exceeding device limits).
+    *                     Configurations for which the OpenCL runtime throws (build failure, out of resources) are skipped.
+    */
+    template <typename BenchmarkT>
+    tuning_result tune(parameter_space const & space, BenchmarkT benchmark, bool verbose = false)
+    {
+      tuning_result result;
+      std::vector<parameter_set> configs = space.configurations();
+      for (std::size_t i=0; i<configs.size(); ++i)
+      {
+        double time = -1;
+        try
+        {
+          time = benchmark(configs[i]);
+        }
+        catch (std::exception const & e)
+        {
+          if (verbose)
+            std::cout << "#   " << configs[i].to_string() << ": skipped (" << e.what() << ")" << std::endl;
+          continue;
+        }
+
+        if (time < 0)
+          continue;
+
+        ++result.tested;
+        if (verbose)
+          std::cout << "#   " << configs[i].to_string() << ": " << time * 1e6 << " us" << std::endl;
+        if (time < result.best_time)
+        {
+          result.best_time = time;
+          result.best      = configs[i];
+        }
+      }
+      return result;
+    }
+
+  } //namespace ocl
+
+
+#endif
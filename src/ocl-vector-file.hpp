@@ -0,0 +1,194 @@
+#ifndef OPENCL_VECTOR_FILE_HPP_
+#define OPENCL_VECTOR_FILE_HPP_
+
+
+/** @file ocl-vector-file.hpp
+    @brief Memory-mapped binary vector files, passed to OpenCL without intermediate host copies
+
+    A file either starts with a vector_file_header, padded to one page so that the entries are page-aligned in the
+    mapping (as required for zero copy with CL_MEM_USE_HOST_PTR), or is a raw array of floats.
+    The mapping can be used as host pointer of a buffer directly, or streamed to the device in chunks with
+    non-blocking writes straight from the mapped pages. POSIX only.
+*/
+
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+
+  namespace ocl
+  {
+
+    /** @brief Offset of the entries in files with header */
+    static const std::size_t vector_file_data_offset = 4096;
+
+    struct vector_file_header
+    {
+      char     magic[8];        // "OCLVEC01"
+      uint64_t element_size;    // bytes per entry
+      uint64_t num_entries;
+    };
+
+
+    /** @brief A vector file mapped into memory. Existing files are mapped copy-on-write (changes never reach the file), new files are mapped shared. */
+    class vector_file
+    {
+    public:
+      /** @brief Maps an existing file. Files without header are treated as raw arrays of floats. */
+      explicit vector_file(std::string const & filename)
+        : filename_(filename), fd_(-1), mapping_(NULL), mapping_bytes_(0), offset_(0), element_size_(sizeof(float)), num_entries_(0), has_header_(false)
+      {
+        fd_ = open(filename.c_str(), O_RDONLY);
+        if (fd_ < 0)
+          fail("Cannot open");
+
+        struct stat st;
+        if (fstat(fd_, &st) != 0)
+          fail("Cannot stat");
+        mapping_bytes_ = std::size_t(st.st_size);
+
+        map(PROT_READ | PROT_WRITE, MAP_PRIVATE);
+
+        vector_file_header const * header = static_cast<vector_file_header const *>(mapping_);
+        if (mapping_bytes_ >= vector_file_data_offset && std::memcmp(header->magic, "OCLVEC01", 8) == 0)
+        {
+          has_header_   = true;
+          offset_       = vector_file_data_offset;
+          element_size_ = std::size_t(header->element_size);
+          num_entries_  = std::size_t(header->num_entries);
+          if (element_size_ == 0 || num_entries_ > (mapping_bytes_ - offset_) / element_size_)   // no overflow for corrupt sizes
+          {
+            errno = EINVAL;
+            fail("Truncated or corrupt header in");
+          }
+        }
+        else
+          num_entries_ = mapping_bytes_ / element_size_;
+      }
+
+      /** @brief Creates (or overwrites) a file with header for 'num_entries' entries of 'element_size' bytes each. Contents are written through data(). */
+      vector_file(std::string const & filename, std::size_t num_entries, std::size_t element_size = sizeof(float))
+        : filename_(filename), fd_(-1), mapping_(NULL), mapping_bytes_(vector_file_data_offset + num_entries * element_size),
+          offset_(vector_file_data_offset), element_size_(element_size), num_entries_(num_entries), has_header_(true)
+      {
+        fd_ = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+          fail("Cannot create");
+        if (ftruncate(fd_, off_t(mapping_bytes_)) != 0)
+          fail("Cannot resize");
+
+        map(PROT_READ | PROT_WRITE, MAP_SHARED);
+
+        vector_file_header * header = static_cast<vector_file_header *>(mapping_);
+        std::memcpy(header->magic, "OCLVEC01", 8);
+        header->element_size = element_size_;
+        header->num_entries  = num_entries_;
+      }
+
+      ~vector_file()
+      {
+        if (mapping_)
+          munmap(mapping_, mapping_bytes_);
+        if (fd_ >= 0)
+          close(fd_);
+      }
+
+      std::size_t size()         const { return num_entries_; }
+      std::size_t element_size() const { return element_size_; }
+      std::size_t bytes()        const { return num_entries_ * element_size_; }
+      bool        has_header()   const { return has_header_; }
+
+      void       * data()       { return static_cast<char *>(mapping_) + offset_; }
+      void const * data() const { return static_cast<char *>(mapping_) + offset_; }
+
+      /** @brief Hints the kernel that the file is read front to back (more read-ahead) */
+      void advise_sequential() const { madvise(mapping_, mapping_bytes_, MADV_SEQUENTIAL); }
+
+      /** @brief Writes modified pages of a file created by this object back to disk */
+      void sync() const
+      {
+        if (msync(mapping_, mapping_bytes_, MS_SYNC) != 0)
+          throw std::runtime_error("msync failed for " + filename_ + ": " + std::strerror(errno));
+      }
+
+      /** @brief Buffer using the mapped entries as storage (CL_MEM_USE_HOST_PTR), i.e. zero copy on CPUs and integrated GPUs */
+      cl_mem create_buffer(context const & ctx, cl_mem_flags flags = CL_MEM_READ_WRITE)
+      {
+        if (bytes() == 0)
+          throw std::runtime_error("Cannot create a buffer for the empty vector file " + filename_);
+        return ctx.create_buffer(bytes(), data(), flags | CL_MEM_USE_HOST_PTR);
+      }
+
+    private:
+      vector_file(vector_file const &);
+      vector_file & operator=(vector_file const &);
+
+      void map(int protection, int flags)
+      {
+        if (mapping_bytes_ == 0)
+          return;
+        mapping_ = mmap(NULL, mapping_bytes_, protection, flags, fd_, 0);
+        if (mapping_ == MAP_FAILED)
+        {
+          mapping_ = NULL;
+          fail("Cannot map");
+        }
+      }
+
+      void fail(std::string const & what)
+      {
+        std::string message = what + " " + filename_ + ": " + std::strerror(errno);
+        if (mapping_)
+          munmap(mapping_, mapping_bytes_);
+        if (fd_ >= 0)
+          close(fd_);
+        mapping_ = NULL;
+        fd_      = -1;
+        throw std::runtime_error(message);
+      }
+
+      std::string filename_;
+      int         fd_;
+      void *      mapping_;
+      std::size_t mapping_bytes_;
+      std::size_t offset_;
+      std::size_t element_size_;
+      std::size_t num_entries_;
+      bool        has_header_;
+    };
+
+
+    /** @brief Copies bytes [offset, offset + num_bytes) of the file to 'buffer' without blocking. The file must stay mapped until the write has completed. */
+    inline void enqueue_chunk_write(context const & ctx, vector_file const & file, std::size_t offset, std::size_t num_bytes, cl_mem buffer, cl_event * event = NULL)
+    {
+      cl_int err = clEnqueueWriteBuffer(ctx.queue(), buffer, CL_FALSE, 0, num_bytes,
+                                        static_cast<char const *>(file.data()) + offset, 0, NULL, event); OPENCL_ERR_CHECK(err);
+    }
+
+    /** @brief Copies 'num_bytes' from 'buffer' to bytes [offset, offset + num_bytes) of the file without blocking. */
+    inline void enqueue_chunk_read(context const & ctx, cl_mem buffer, vector_file & file, std::size_t offset, std::size_t num_bytes, cl_event * event = NULL)
+    {
+      cl_int err = clEnqueueReadBuffer(ctx.queue(), buffer, CL_FALSE, 0, num_bytes,
+                                       static_cast<char *>(file.data()) + offset, 0, NULL, event); OPENCL_ERR_CHECK(err);
+    }
+
+  } //namespace ocl
+
+
+#endif
@@ -0,0 +1,222 @@
+
+//
+// Performance regression check: throughput of vec_add, vec_dot and the other kernels against a stored baseline
+//
+// Usage:
+//   perf_check check  <baseline_dir> [tolerance]   fails if a kernel is slower than (1 - tolerance) times its baseline
+//   perf_check record <baseline_dir>               writes the current throughput as new baseline
+//
+// The baseline is <baseline_dir>/<device class>.json (cpu, gpu, accelerator), see ocl-perf-baseline.hpp.
+// Kernels without a baseline entry are reported, but do not fail the check. If none of the kernels has an entry,
+// 'check' exits with code 77 (ctest reports the test as skipped), so a missing baseline never passes as green.
+// Registered with ctest if configured with -DENABLE_PERF_TESTS=ON.
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-scan.hpp"
+#include "ocl-spmv.hpp"
+#include "ocl-perf-baseline.hpp"
+#include "benchmark-utils.hpp"
+
+
+// exit code of 'check' if nothing could be compared, registered as SKIP_RETURN_CODE with ctest
+static const int exit_no_baseline = 77;
+
+
+struct measurement
+{
+  std::string     name;
+  double          gbs;
+  BenchmarkResult timing;
+};
+
+
+// Median time of 'op' (which waits for its commands) from the benchmark harness, converted to GB/s
+template <typename OpT>
+measurement measure(std::string const & name, double bytes, OpT op)
+{
+  measurement m;
+  m.name   = name;
+  m.timing = benchmark(op);
+  m.gbs    = bytes / m.timing.median * 1e-9;
+  return m;
+}
+
+
+std::string with_size(std::string const & name, cl_uint N)
+{
+  std::ostringstream ss;
+  ss << name << "/" << N;
+  return ss.str();
+}
+
+
+std::vector<measurement> run_suite(ocl::context const & ctx)
+{
+  std::vector<measurement> results;
+
+  //
+  // BLAS level 1 kernels at sizes from cache-resident to far beyond the last-level cache:
+  //
+  ocl::blas1_kernels kernels(ctx);
+  cl_uint max_size = 16*1024*1024;
+  std::vector<ScalarType> x(max_size, 1.0), y(max_size, 2.0);
+  cl_mem ocl_x   = ctx.create_buffer(max_size * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_y   = ctx.create_buffer(max_size * sizeof(ScalarType), &(y[0]));
+  cl_mem scalars = ctx.create_buffer(2 * sizeof(ScalarType), &(x[0]));   // alpha = 1 for axpy
+  cl_mem result  = ctx.create_buffer(sizeof(ScalarType));
+
+  for (cl_uint N = 64*1024; N <= max_size; N *= 16)
+  {
+    results.push_back(measure(with_size("vec_add", N), 3.0 * sizeof(ScalarType) * N,
+                              [&]() { kernels.add(ocl_x, ocl_y, N); clFinish(ctx.queue()); }));
+    results.push_back(measure(with_size("vec_dot", N), 2.0 * sizeof(ScalarType) * N,
+                              [&]() { kernels.dot(ocl_x, ocl_y, result, 0, N); clFinish(ctx.queue()); }));
+    results.push_back(measure(with_size("axpy", N), 3.0 * sizeof(ScalarType) * N,
+                              [&]() { kernels.axpy(ocl_y, ocl_x, scalars, 0, 1, 1.0f, N); clFinish(ctx.queue()); }));
+  }
+
+  //
+  // Scan (reads x, writes y):
+  //
+  ocl::scan_kernels scan(ctx);
+  cl_uint scan_size = 4*1024*1024;
+  results.push_back(measure(with_size("scan_inclusive", scan_size), 2.0 * sizeof(ScalarType) * scan_size,
+                            [&]() { scan.inclusive(ocl_x, ocl_y, scan_size); clFinish(ctx.queue()); }));
+
+  //
+  // Sparse matrix-vector products for a 2D Poisson matrix:
+  //
+  ocl::spmv_kernels spmv(ctx);
+  ocl::host_csr_matrix host_A = ocl::poisson_2d(1024);
+  ocl::csr_matrix A(ctx, host_A);
+  ocl::sell_matrix B;
+  spmv.prepare_adaptive(A);
+  spmv.convert(A, B);
+  double spmv_bytes = double(A.nnz) * (sizeof(ScalarType) + sizeof(cl_uint))
+                    + double(A.rows + 1) * sizeof(cl_uint)
+                    + double(A.cols + A.rows) * sizeof(ScalarType);
+  results.push_back(measure(with_size("spmv_csr_vector", A.rows), spmv_bytes,
+                            [&]() { spmv.csr_vector(A, ocl_x, ocl_y); clFinish(ctx.queue()); }));
+  results.push_back(measure(with_size("spmv_csr_adaptive", A.rows), spmv_bytes,
+                            [&]() { spmv.csr_adaptive(A, ocl_x, ocl_y); clFinish(ctx.queue()); }));
+  results.push_back(measure(with_size("spmv_sell", A.rows), spmv_bytes,
+                            [&]() { spmv.sell(B, ocl_x, ocl_y); clFinish(ctx.queue()); }));
+
+  clReleaseMemObject(ocl_x);
+  clReleaseMemObject(ocl_y);
+  clReleaseMemObject(scalars);
+  clReleaseMemObject(result);
+  return results;
+}
+
+
+int main(int argc, char **argv)
+{
+  std::string mode = (argc > 2) ? argv[1] : "";
+  if (mode != "check" && mode != "record")
+  {
+    std::cout << "Usage: " << argv[0] << " check <baseline_dir> [tolerance]" << std::endl;
+    std::cout << "       " << argv[0] << " record <baseline_dir>" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context and load the baseline ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::string device_class = ocl::device_class(ctx);
+  std::string filename = std::string(argv[2]) + "/" + device_class + ".json";
+
+  ocl::perf_baseline baseline;
+  bool have_baseline = baseline.load(filename);
+  if (argc > 3)
+    baseline.tolerance(std::atof(argv[3]));
+
+  std::cout << "# Device: " << ctx.device_name() << " (class " << device_class << ")" << std::endl;
+  std::cout << "# Baseline: " << filename;
+  if (!have_baseline)
+    std::cout << " (not found)";
+  else if (!baseline.device().empty() && baseline.device() != ctx.device_name())
+    std::cout << " (recorded on " << baseline.device() << ")";
+  std::cout << ", tolerance " << baseline.tolerance() * 100 << " %" << std::endl;
+
+  //
+  /////////////////////////// Part 2: Run the kernels ///////////////////////////////////
+  //
+  std::vector<measurement> results = run_suite(ctx);
+
+  //
+  /////////////////////////// Part 3: Compare or record ///////////////////////////////////
+  //
+  std::cout << std::endl;
+  std::cout << "# kernel                       [GB/s]  baseline    ratio" << std::endl;
+  std::size_t regressions = 0, compared = 0;
+  for (std::size_t i=0; i<results.size(); ++i)
+  {
+    measurement const & m = results[i];
+    std::cout << std::left << std::setw(28) << m.name << std::right << std::fixed << std::setprecision(2) << std::setw(10) << m.gbs;
+    if (baseline.has(m.name))
+    {
+      double ratio = m.gbs / baseline.get(m.name);
+      bool regression = (ratio < 1.0 - baseline.tolerance());
+      std::cout << std::setw(10) << baseline.get(m.name) << std::setw(9) << ratio << (regression ? "  REGRESSION" : "");
+      if (regression)
+        ++regressions;
+      ++compared;
+    }
+    else
+      std::cout << std::setw(10) << "-" << std::setw(9) << "-";
+    if (m.timing.noisy || m.timing.drift || m.timing.frequency_changed())
+      std::cout << "  (noisy)";
+    std::cout << std::endl;
+  }
+  std::cout.unsetf(std::ios_base::floatfield);
+
+  if (mode == "record")
+  {
+    baseline.device_class(device_class);
+    baseline.device(ctx.device_name());
+    for (std::size_t i=0; i<results.size(); ++i)
+      baseline.set(results[i].name, results[i].gbs);
+    baseline.save(filename);
+    std::cout << std::endl << "# Baseline written to " << filename << std::endl;
+  }
+  else if (compared == 0)
+  {
+    std::cout << std::endl << "# No baseline entry for any kernel, nothing checked. Record one with '" << argv[0] << " record " << argv[2] << "'." << std::endl;
+    return exit_no_baseline;
+  }
+  else if (regressions > 0)
+  {
+    std::cout << std::endl << "# " << regressions << " kernel(s) slower than the baseline!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Performance check finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+
+//
+// Hardware performance counters next to OpenCL kernel timings for vec_add and vec_dot
+//
+// Meant for CPU OpenCL devices: the core counters cover all threads of this process, including the worker threads
+// of the OpenCL runtime. On GPUs they only show the host side. Counters are optional: if perf_event_open is not
+// permitted (see /proc/sys/kernel/perf_event_paranoid), only the OpenCL timings are reported.
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-perf-counters.hpp"
+#include "benchmark-utils.hpp"
+
+
+// Device time of a command in seconds
+double event_time(cl_event e)
+{
+  cl_ulong start, end;
+  cl_int err;
+  err = clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL); OPENCL_ERR_CHECK(err);
+  err = clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &end,   NULL); OPENCL_ERR_CHECK(err);
+  return (end - start) * 1e-9;
+}
+
+
+void report(std::string const & name, cl_uint N, double bytes_per_entry, double time, ocl::perf_sample const & sample)
+{
+  std::cout << std::setw(9) << N << "  " << name
+            << std::setw(10) << std::setprecision(4) << time * 1e6
+            << std::setw(10) << bytes_per_entry * N / time * 1e-9;
+  if (sample.has_core)
+    std::cout << std::setw(14) << sample.cycles << std::setw(8) << std::setprecision(3) << sample.ipc()
+              << std::setw(12) << std::setprecision(4) << sample.llc_misses / N;
+  if (sample.has_dram)
+    std::cout << std::setw(12) << sample.dram_bytes / time * 1e-9;
+  std::cout << std::endl;
+}
+
+
+int main()
+{
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx(CL_QUEUE_PROFILING_ENABLE);
+  std::cout << "# Device: " << ctx.device_name() << (ctx.device_type() & CL_DEVICE_TYPE_CPU ? " (CPU)" : " (not a CPU, counters only see the host)") << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create a program and extract kernels ///////////////////////////////////
+  //
+  ocl::blas1_kernels kernels(ctx);
+  cl_mem partials = ctx.create_buffer(ocl::blas1_kernels::num_partials() * sizeof(ScalarType));
+
+  cl_uint max_size = 16*1024*1024;
+  std::vector<ScalarType> x(max_size, 1.0), y(max_size, 2.0);
+  cl_mem ocl_x = ctx.create_buffer(max_size * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_y = ctx.create_buffer(max_size * sizeof(ScalarType), &(y[0]));
+
+  // run each kernel once, so that the worker threads of the runtime exist before the counters are attached:
+  kernels.add(ocl_x, ocl_y, max_size);
+  kernels.dot_partials(ocl_x, ocl_y, partials, max_size);
+  clFinish(ctx.queue());
+
+  ocl::perf_counters counters;
+  std::cout << "# Core counters: " << (counters.available() ? "attached to " : "not available");
+  if (counters.available())
+    std::cout << counters.threads() << " threads";
+  std::cout << ", memory controller counters: " << (counters.uncore_available() ? "available" : "not available") << std::endl;
+
+  //
+  /////////////////////////// Part 3: Run kernels with counters ///////////////////////////////////
+  //
+  std::cout << std::endl;
+  std::cout << "#       N  kernel   time [us]    [GB/s]        cycles     IPC  LLC miss/N  DRAM [GB/s]" << std::endl;
+
+  for (cl_uint N = 64*1024; N <= max_size; N *= 4)
+  {
+    cl_event e;
+
+    // vec_add: reads x and y, writes x
+    counters.start();
+    kernels.add(ocl_x, ocl_y, N, &e);
+    clWaitForEvents(1, &e);
+    ocl::perf_sample add_sample = counters.stop();
+    report("vec_add", N, 3.0 * sizeof(ScalarType), event_time(e), add_sample);
+    clReleaseEvent(e);
+
+    // vec_dot (first stage): reads x and y
+    counters.start();
+    kernels.dot_partials(ocl_x, ocl_y, partials, N, &e);
+    clWaitForEvents(1, &e);
+    ocl::perf_sample dot_sample = counters.stop();
+    report("vec_dot", N, 2.0 * sizeof(ScalarType), event_time(e), dot_sample);
+    clReleaseEvent(e);
+  }
+
+  std::cout << std::endl;
+  std::cout << "# Counters span from enqueue to completion, kernel times from the OpenCL profiling events." << std::endl;
+  std::cout << "# An IPC well below 1 with DRAM bandwidth close to the STREAM figure of the machine means bandwidth-bound." << std::endl;
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(ocl_x);
+  clReleaseMemObject(ocl_y);
+  clReleaseMemObject(partials);
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Performance counter benchmark finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+
+//
+// Roofline report: vec_add and vec_dot relative to the measured peak bandwidth and peak FLOP/s of the device
+//
+// Usage: roofline [remeasure]
+//
+// The peaks are measured once per device and driver and cached (see ocl-roofline.hpp), pass 'remeasure' to refresh them.
+// vec_add moves 12 bytes and executes 1 flop per entry, vec_dot moves 8 bytes and executes 2 flops per entry.
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-roofline.hpp"
+#include "benchmark-utils.hpp"
+
+
+// Time from the start of the first to the end of the last command, in seconds
+double event_span(cl_event first, cl_event last)
+{
+  cl_ulong start, end;
+  cl_int err;
+  err = clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL); OPENCL_ERR_CHECK(err);
+  err = clGetEventProfilingInfo(last,  CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &end,   NULL); OPENCL_ERR_CHECK(err);
+  return (end - start) * 1e-9;
+}
+
+
+void report(std::string const & name, cl_uint N, double bytes, double flop, BenchmarkResult const & timing, ocl::roofline const & peaks)
+{
+  double time = timing.median;
+  std::cout << std::setw(9) << N << "  " << name
+            << std::setw(10) << std::setprecision(4) << time * 1e6
+            << std::setw(10) << bytes / time * 1e-9
+            << std::setw(10) << flop / time * 1e-9
+            << std::setw(8)  << std::setprecision(3) << flop / bytes
+            << std::setw(10) << std::setprecision(3) << 100.0 * peaks.efficiency(bytes, flop, time) << " %"
+            << (timing.noisy || timing.drift || timing.frequency_changed() ? "  (noisy)" : "") << std::endl;
+}
+
+
+int main(int argc, char **argv)
+{
+  bool remeasure = (argc > 1 && std::string(argv[1]) == "remeasure");
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx(CL_QUEUE_PROFILING_ENABLE);
+  std::cout << "# Device: " << ctx.device_name() << " (driver " << ctx.driver_version() << ")" << std::endl;
+
+  //
+  /////////////////////////// Part 2: Peak bandwidth and FLOP/s ///////////////////////////////////
+  //
+  ocl::roofline peaks(ctx, ocl::roofline_cache_file(), remeasure);
+  std::cout << "# Peak bandwidth: " << peaks.bandwidth() * 1e-9 << " GB/s, peak: " << peaks.flops() * 1e-9 << " GFLOP/s"
+            << (peaks.cached() ? " (cached in " + ocl::roofline_cache_file() + ")" : " (measured)") << std::endl;
+  std::cout << "# Ridge point: " << peaks.ridge_point() << " flop/byte" << std::endl;
+
+  //
+  /////////////////////////// Part 3: Set up kernels and buffers ///////////////////////////////////
+  //
+  ocl::blas1_kernels kernels(ctx);
+
+  cl_uint max_size = 16*1024*1024;
+  std::vector<ScalarType> x(max_size, 1.0), y(max_size, 2.0);
+  cl_mem ocl_x    = ctx.create_buffer(max_size * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_y    = ctx.create_buffer(max_size * sizeof(ScalarType), &(y[0]));
+  cl_mem partials = ctx.create_buffer(ocl::blas1_kernels::num_partials() * sizeof(ScalarType));
+  cl_mem result   = ctx.create_buffer(sizeof(ScalarType));
+
+  //
+  /////////////////////////// Part 4: Kernels on the roofline ///////////////////////////////////
+  //
+  std::cout << std::endl;
+  std::cout << "#       N  kernel median [us]    [GB/s] [GFLOP/s] flop/B  of roofline" << std::endl;
+
+  for (cl_uint N = 64*1024; N <= max_size; N *= 4)
+  {
+    // device times from the profiling events, median of the benchmark harness:
+    BenchmarkResult add_timing = benchmark([&]() {
+        cl_event e;
+        kernels.add(ocl_x, ocl_y, N, &e);
+        clWaitForEvents(1, &e);
+        double time = event_span(e, e);
+        clReleaseEvent(e);
+        return time;
+      });
+
+    BenchmarkResult dot_timing = benchmark([&]() {
+        cl_event e_partials, e_sum;
+        kernels.dot_partials(ocl_x, ocl_y, partials, N, &e_partials);
+        kernels.sum(partials, ocl::blas1_kernels::num_partials(), result, 0, &e_sum);
+        clWaitForEvents(1, &e_sum);
+        double time = event_span(e_partials, e_sum);
+        clReleaseEvent(e_partials);
+        clReleaseEvent(e_sum);
+        return time;
+      });
+
+    report("vec_add", N, 3.0 * sizeof(ScalarType) * N, 1.0 * N, add_timing, peaks);
+    report("vec_dot", N, 2.0 * sizeof(ScalarType) * N, 2.0 * N, dot_timing, peaks);
+  }
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(ocl_x);
+  clReleaseMemObject(ocl_y);
+  clReleaseMemObject(partials);
+  clReleaseMemObject(result);
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Roofline benchmark finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+
+//
+// Benchmark for sparse matrix-vector products y = A*x with CSR (scalar, vector, adaptive) and SELL-C-sigma kernels
+//
+// Two test matrices: the 2D Poisson stencil (uniform short rows) and a matrix with a few very long rows
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-spmv.hpp"
+#include "benchmark-utils.hpp"
+
+
+// Poisson matrix, where every 64th row additionally couples to 'long_row_length' columns
+ocl::host_csr_matrix irregular_matrix(cl_uint n, cl_uint long_row_length)
+{
+  ocl::host_csr_matrix P = ocl::poisson_2d(n);
+  ocl::host_csr_matrix A;
+  A.rows = P.rows;
+  A.cols = P.cols;
+  A.row_ptr.push_back(0);
+  for (cl_uint i=0; i<P.rows; ++i)
+  {
+    for (cl_uint j=P.row_ptr[i]; j<P.row_ptr[i+1]; ++j)
+    {
+      A.col_idx.push_back(P.col_idx[j]);
+      A.values.push_back(P.values[j]);
+    }
+    if (i % 64 == 0)
+      for (cl_uint k=0; k<long_row_length; ++k)
+      {
+        A.col_idx.push_back((i + 7 * k + 1) % A.cols);
+        A.values.push_back(0.001f);
+      }
+    A.row_ptr.push_back(cl_uint(A.col_idx.size()));
+  }
+  return A;
+}
+
+
+bool check_result(std::vector<ScalarType> const & result, std::vector<ScalarType> const & reference)
+{
+  for (size_t i=0; i<reference.size(); ++i)
+    if (std::fabs(result[i] - reference[i]) > 1e-4 * (1 + std::fabs(reference[i])))
+    {
+      std::cout << "Mismatch at row " << i << ": " << result[i] << " vs. " << reference[i] << std::endl;
+      return false;
+    }
+  return true;
+}
+
+
+int main()
+{
+  cl_int err;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create a program and extract kernels ///////////////////////////////////
+  //
+  ocl::spmv_kernels spmv(ctx);
+
+  bool all_ok = true;
+
+  for (int matrix_type = 0; matrix_type < 2; ++matrix_type)
+  {
+    //
+    /////////////////////////// Part 3: Create matrices and vectors ///////////////////////////////////
+    //
+    cl_uint n = 1024;
+    ocl::host_csr_matrix host_A = (matrix_type == 0) ? ocl::poisson_2d(n) : irregular_matrix(n, 2000);
+    std::cout << std::endl;
+    std::cout << "# Matrix: " << (matrix_type == 0 ? "2D Poisson" : "2D Poisson with long rows")
+              << ", rows: " << host_A.rows << ", nonzeros: " << host_A.values.size() << std::endl;
+
+    std::vector<ScalarType> x(host_A.cols);
+    for (size_t i=0; i<x.size(); ++i)
+      x[i] = ScalarType(i % 7) / 7;
+    std::vector<ScalarType> y(host_A.rows);
+    std::vector<ScalarType> reference(host_A.rows);
+    host_A.apply(x, reference);
+
+    ocl::csr_matrix A(ctx, host_A);
+    cl_mem ocl_x = ctx.create_buffer(x.size() * sizeof(ScalarType), &(x[0]));
+    cl_mem ocl_y = ctx.create_buffer(y.size() * sizeof(ScalarType));
+
+    // format conversions on the device:
+    Timer timer;
+    spmv.prepare_adaptive(A);
+    clFinish(ctx.queue());
+    std::cout << "# CSR-adaptive setup:   " << timer.get() << " s, " << A.num_row_blocks << " row blocks" << std::endl;
+
+    ocl::sell_matrix B;
+    timer.start();
+    spmv.convert(A, B);
+    clFinish(ctx.queue());
+    std::cout << "# SELL-32-256 setup:    " << timer.get() << " s, " << B.stored_entries << " stored entries" << std::endl;
+
+    //
+    /////////////////////////// Part 4: Run kernels ///////////////////////////////////
+    //
+    // bytes moved: values and column indices once, row pointers, x at least once, y once
+    double bytes = double(A.nnz) * (sizeof(ScalarType) + sizeof(cl_uint))
+                 + double(A.rows + 1) * sizeof(cl_uint)
+                 + double(A.cols + A.rows) * sizeof(ScalarType);
+
+    for (int variant = 0; variant < 4; ++variant)
+    {
+      BenchmarkResult timing = benchmark([&]() {
+          switch (variant)
+          {
+            case 0: spmv.csr_scalar(A, ocl_x, ocl_y); break;
+            case 1: spmv.csr_vector(A, ocl_x, ocl_y); break;
+            case 2: spmv.csr_adaptive(A, ocl_x, ocl_y); break;
+            default: spmv.sell(B, ocl_x, ocl_y);
+          }
+          clFinish(ctx.queue());
+        });
+      double time = timing.median;
+
+      //
+      /////////////////////////// Part 5: Get data from OpenCL buffer ///////////////////////////////////
+      //
+      err = clEnqueueReadBuffer(ctx.queue(), ocl_y, CL_TRUE, 0, sizeof(ScalarType) * y.size(), &(y[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+      all_ok &= check_result(y, reference);
+
+      const char * names[] = { "CSR scalar:  ", "CSR vector:  ", "CSR adaptive:", "SELL-C-sigma:" };
+      std::cout << names[variant] << " " << bytes / time * 1e-9 << " GB/s, ";
+      timing.print(std::cout);
+      std::cout << std::endl;
+
+      std::fill(y.begin(), y.end(), ScalarType(0));
+      err = clEnqueueWriteBuffer(ctx.queue(), ocl_y, CL_TRUE, 0, sizeof(ScalarType) * y.size(), &(y[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+    }
+
+    clReleaseMemObject(ocl_x);
+    clReleaseMemObject(ocl_y);
+  }
+
+  if (!all_ok)
+  {
+    std::cout << "# SpMV results do NOT match the host reference!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# SpMV benchmark finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+
+//
+// Tutorial for the task graph: two independent dot products are computed concurrently, followed by a host callback
+//
+//   upload a, b, c, d  -->  dot(a,b)  --> read both -->  host: print both results
+//                           dot(c,d)  -->
+//                           add(a, c) (depends on both dots, since they read a and c)
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-task-graph.hpp"
+#include "ocl-trace.hpp"
+#include "benchmark-utils.hpp"
+
+
+// Prints the device time span of the last command of a task (for dot tasks: the final reduction kernel)
+void print_span(std::string const & name, ocl::task_graph const & graph, ocl::task_graph::task_id id, cl_ulong t0)
+{
+  cl_ulong start, end;
+  cl_int err;
+  err = clGetEventProfilingInfo(graph.event(id), CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL); OPENCL_ERR_CHECK(err);
+  err = clGetEventProfilingInfo(graph.event(id), CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &end,   NULL); OPENCL_ERR_CHECK(err);
+  std::cout << "  " << name << ": " << (start - t0) * 1e-3 << " us -- " << (end - t0) * 1e-3 << " us" << std::endl;
+}
+
+
+int main(int argc, char **argv)
+{
+  // host spans and device commands of both passes on one timeline. Pass a file name to get a Chrome trace:
+  ocl::trace trace;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2 and 3: Create buffers ///////////////////////////////////
+  //
+  cl_uint vector_size = 4*1024*1024;
+  std::vector<ScalarType> a(vector_size, 1.0), b(vector_size, 2.0), c(vector_size, 3.0), d(vector_size, 4.0);
+  size_t num_bytes = vector_size * sizeof(ScalarType);
+
+  cl_mem ocl_a = ctx.create_buffer(num_bytes);
+  cl_mem ocl_b = ctx.create_buffer(num_bytes);
+  cl_mem ocl_c = ctx.create_buffer(num_bytes);
+  cl_mem ocl_d = ctx.create_buffer(num_bytes);
+  cl_mem ocl_results = ctx.create_buffer(2 * sizeof(ScalarType));
+  ScalarType results[2] = {0, 0};
+
+  for (int use_graph_queues = 0; use_graph_queues < 2; ++use_graph_queues)
+  {
+    // first pass: a single in-order queue (everything serialized), second pass: out-of-order or multiple queues
+    ocl::task_graph graph(ctx, use_graph_queues ? 4 : 1, use_graph_queues != 0, CL_QUEUE_PROFILING_ENABLE);
+    std::cout << std::endl;
+    std::cout << "# " << (graph.out_of_order() ? "one out-of-order queue" : "in-order queues: ");
+    if (!graph.out_of_order())
+      std::cout << graph.num_queues();
+    std::cout << std::endl;
+
+    //
+    /////////////////////////// Part 4: Build and run the task graph ///////////////////////////////////
+    //
+    Timer timer;
+    trace.begin(use_graph_queues ? "graph queues" : "single in-order queue");
+    trace.begin("enqueue tasks");
+    ocl::task_graph::task_id up_a = graph.upload(ocl_a, num_bytes, &(a[0]));  trace.record(graph.event(up_a), "upload a");
+    ocl::task_graph::task_id up_b = graph.upload(ocl_b, num_bytes, &(b[0]));  trace.record(graph.event(up_b), "upload b");
+    ocl::task_graph::task_id up_c = graph.upload(ocl_c, num_bytes, &(c[0]));  trace.record(graph.event(up_c), "upload c");
+    ocl::task_graph::task_id up_d = graph.upload(ocl_d, num_bytes, &(d[0]));  trace.record(graph.event(up_d), "upload d");
+
+    ocl::task_graph::task_id dot_ab = graph.dot(ocl_a, ocl_b, ocl_results, 0, vector_size, {up_a, up_b});  trace.record(graph.event(dot_ab), "dot(a,b)");
+    ocl::task_graph::task_id dot_cd = graph.dot(ocl_c, ocl_d, ocl_results, 1, vector_size, {up_c, up_d});  trace.record(graph.event(dot_cd), "dot(c,d)");
+
+    // one read for both results: reads into overlapping host memory must not run concurrently
+    ocl::task_graph::task_id read_dots = graph.read(ocl_results, 2 * sizeof(ScalarType), &(results[0]), {dot_ab, dot_cd});  trace.record(graph.event(read_dots), "read both dots");
+
+    graph.host([&results]() { std::cout << "  host callback: dot(a,b) = " << results[0] << ", dot(c,d) = " << results[1] << std::endl; },
+               {read_dots});
+
+    ocl::task_graph::task_id add_ac = graph.add(ocl_a, ocl_c, vector_size, {dot_ab, dot_cd});  trace.record(graph.event(add_ac), "a += c");
+    trace.end();
+
+    //
+    /////////////////////////// Part 5: Wait and report ///////////////////////////////////
+    //
+    trace.begin("wait");
+    graph.wait();
+    trace.end();
+    trace.end();
+    trace.fetch_profiling_info();   // while the queues of the graph are alive
+    std::cout << "  total time: " << timer.get() * 1e3 << " ms" << std::endl;
+
+    cl_ulong t0;
+    cl_int err = clGetEventProfilingInfo(graph.event(up_a), CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &t0, NULL); OPENCL_ERR_CHECK(err);
+    print_span("dot(a,b)", graph, dot_ab, t0);
+    print_span("dot(c,d)", graph, dot_cd, t0);
+    print_span("a += c  ", graph, add_ac, t0);
+  }
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(ocl_a);
+  clReleaseMemObject(ocl_b);
+  clReleaseMemObject(ocl_c);
+  clReleaseMemObject(ocl_d);
+  clReleaseMemObject(ocl_results);
+
+  std::cout << std::endl;
+  trace.print_commands(std::cout);
+  if (argc > 1)
+  {
+    trace.write_chrome_trace(argv[1]);
+    std::cout << "# Chrome trace written to " << argv[1] << std::endl;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Task graph application finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -21,6 +21,9 @@ typedef float       ScalarType;
 
 // Helper include files taken from ViennaCL for error checking and timing
 #include "ocl-error.hpp"
+#include "ocl-host-allocator.hpp"
+#include "ocl-trace.hpp"
+#include "benchmark-utils.hpp"
 
 
 const char *my_opencl_program = ""
@@ -35,20 +38,26 @@ const char *my_opencl_program = ""
 "}";
 
 
-int main()
+int main(int argc, char **argv)
 {
   cl_int err;
 
+  // wall-clock time of each phase and device time of each command. Pass a file name to also get a Chrome trace (chrome://tracing or ui.perfetto.dev):
+  ocl::trace profile;
+
   //
   /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
   //
+  profile.begin("Part 1: Set up context");
 
   //
   // Query platform:
   //
   cl_uint num_platforms;
   cl_platform_id platform_ids[42];   //no more than 42 platforms supported...
+  profile.begin("clGetPlatformIDs");
   err = clGetPlatformIDs(42, platform_ids, &num_platforms); OPENCL_ERR_CHECK(err);
+  profile.end();
   std::cout << "# Platforms found: " << num_platforms << std::endl;
   cl_platform_id my_platform = platform_ids[0];
 
@@ -58,7 +67,9 @@ int main()
   //
   cl_device_id device_ids[42];
   cl_uint num_devices;
+  profile.begin("clGetDeviceIDs");
   err = clGetDeviceIDs(my_platform, CL_DEVICE_TYPE_ALL, 42, device_ids, &num_devices); OPENCL_ERR_CHECK(err);
+  profile.end();
   std::cout << "# Devices found: " << num_devices << std::endl;
   cl_device_id my_device_id = device_ids[0];
 
@@ -66,44 +77,61 @@ int main()
   //
   // Create context:
   //
+  profile.begin("clCreateContext");
   cl_context my_context = clCreateContext(0, 1, &my_device_id, NULL, NULL, &err); OPENCL_ERR_CHECK(err);
+  profile.end();
 
 
   //
-  // create a command queue for the device:
+  // create a command queue for the device. Profiling is enabled so that the trace also shows when the device ran each command:
   //
-  cl_command_queue my_queue = clCreateCommandQueue(my_context, my_device_id, 0, &err); OPENCL_ERR_CHECK(err);
+  profile.begin("clCreateCommandQueue");
+  cl_command_queue my_queue = clCreateCommandQueue(my_context, my_device_id, CL_QUEUE_PROFILING_ENABLE, &err); OPENCL_ERR_CHECK(err);
+  profile.end();
+  profile.end();
 
 
 
   //
   /////////////////////////// Part 2: Create a program and extract kernels ///////////////////////////////////
   //
+  profile.begin("Part 2: Build program");
 
   //
   // Build the program:
   //
+  profile.begin("clBuildProgram");
   size_t source_len = std::string(my_opencl_program).length();
   cl_program prog = clCreateProgramWithSource(my_context, 1, &my_opencl_program, &source_len, &err);
   err = clBuildProgram(prog, 0, NULL, NULL, NULL, NULL); OPENCL_ERR_CHECK(err);
+  profile.end();
 
   //
   // Extract the only kernel in the program:
   //
+  profile.begin("clCreateKernel");
   cl_kernel my_kernel = clCreateKernel(prog, "vec_add", &err); OPENCL_ERR_CHECK(err);
+  profile.end();
+  profile.end();
 
 
 
   //
   /////////////////////////// Part 3: Create memory buffers ///////////////////////////////////
   //
+  profile.begin("Part 3: Create buffers");
 
   //
   // Set up buffers on host:
   //
   cl_uint vector_size = 128*1024;
-  std::vector<ScalarType> x(vector_size, 1.0);
-  std::vector<ScalarType> y(vector_size, 2.0);
+  profile.begin("host vectors");
+  // page-aligned and initialized in parallel (first touch), so that the OpenCL buffers below can work on this memory directly:
+  ocl::host_vector<ScalarType> x(vector_size);
+  ocl::host_vector<ScalarType> y(vector_size);
+  ocl::first_touch_fill(x, ScalarType(1.0));
+  ocl::first_touch_fill(y, ScalarType(2.0));
+  profile.end();
 
   std::cout << std::endl;
   std::cout << "Vectors before kernel launch:" << std::endl;
@@ -111,15 +139,19 @@ int main()
   std::cout << "y: " << y[0] << " " << y[1] << " " << y[2] << " ..." << std::endl;
 
   //
-  // Now set up OpenCL buffers:
+  // Now set up OpenCL buffers. CL_MEM_USE_HOST_PTR avoids a copy on CPUs and integrated GPUs (zero copy):
   //
-  cl_mem ocl_x = clCreateBuffer(my_context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, vector_size * sizeof(ScalarType), &(x[0]), &err); OPENCL_ERR_CHECK(err);
-  cl_mem ocl_y = clCreateBuffer(my_context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, vector_size * sizeof(ScalarType), &(y[0]), &err); OPENCL_ERR_CHECK(err);
+  profile.begin("clCreateBuffer");
+  cl_mem ocl_x = clCreateBuffer(my_context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,  vector_size * sizeof(ScalarType), &(x[0]), &err); OPENCL_ERR_CHECK(err);
+  cl_mem ocl_y = clCreateBuffer(my_context, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR,  vector_size * sizeof(ScalarType), &(y[0]), &err); OPENCL_ERR_CHECK(err);
+  profile.end();
+  profile.end();
 
 
   //
   /////////////////////////// Part 4: Run kernel ///////////////////////////////////
   //
+  profile.begin("Part 4: Run kernel");
   size_t  local_size = 128;
   size_t global_size = 128*128;
 
@@ -133,29 +165,78 @@ int main()
   //
   // Enqueue kernel in command queue:
   //
-  err = clEnqueueNDRangeKernel(my_queue, my_kernel, 1, NULL, &global_size, &local_size, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  cl_event kernel_event;
+  profile.begin("clEnqueueNDRangeKernel");
+  err = clEnqueueNDRangeKernel(my_queue, my_kernel, 1, NULL, &global_size, &local_size, 0, NULL, &kernel_event); OPENCL_ERR_CHECK(err);
+  profile.record(kernel_event, "vec_add");
+  profile.end();
+  clReleaseEvent(kernel_event);
+  profile.end();
 
 
 
   //
   /////////////////////////// Part 5: Get data from OpenCL buffer ///////////////////////////////////
   //
-
-  err = clEnqueueReadBuffer(my_queue, ocl_x, CL_TRUE, 0, sizeof(ScalarType) * x.size(), &(x[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  profile.begin("Part 5: Read results");
+  cl_event read_event;
+  profile.begin("clEnqueueReadBuffer (waits for the kernel)");
+  err = clEnqueueReadBuffer(my_queue, ocl_x, CL_TRUE, 0, sizeof(ScalarType) * x.size(), &(x[0]), 0, NULL, &read_event); OPENCL_ERR_CHECK(err);
+  profile.record(read_event, "read");
+  profile.end();
+  clReleaseEvent(read_event);
+  profile.end();
 
   std::cout << std::endl;
   std::cout << "Vectors after kernel execution:" << std::endl;
   std::cout << "x: " << x[0] << " " << x[1] << " " << x[2] << " ..." << std::endl;
   std::cout << "y: " << y[0] << " " << y[1] << " " << y[2] << " ..." << std::endl;
 
+
+  //
+  /////////////////////////// Part 6: Benchmark the kernel ///////////////////////////////////
+  //
+  // The single launch above includes lazy compilation and page faults. The benchmark harness launches the kernel a few
+  // times for warmup, then reports the median device time of the profiling events over many launches:
+  profile.begin("Part 6: Benchmark");
+  BenchmarkResult timing = benchmark([&]() {
+      cl_event e;
+      cl_ulong start, end;
+      cl_int status = clEnqueueNDRangeKernel(my_queue, my_kernel, 1, NULL, &global_size, &local_size, 0, NULL, &e); OPENCL_ERR_CHECK(status);
+      status = clWaitForEvents(1, &e); OPENCL_ERR_CHECK(status);
+      status = clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL); OPENCL_ERR_CHECK(status);
+      status = clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_END,   sizeof(cl_ulong), &end,   NULL); OPENCL_ERR_CHECK(status);
+      clReleaseEvent(e);
+      return (end - start) * 1e-9;
+    });
+  profile.end();
+
+  std::cout << std::endl;
+  std::cout << "vec_add kernel: " << 3.0 * sizeof(ScalarType) * vector_size / timing.median * 1e-9 << " GB/s, ";
+  timing.print(std::cout);
+  std::cout << std::endl;
+
+  profile.fetch_profiling_info();   // the events are only queried while the context is alive
+
   //
   // cleanup
   //
+  profile.begin("cleanup");
   clReleaseMemObject(ocl_x);
   clReleaseMemObject(ocl_y);
   clReleaseProgram(prog);
   clReleaseCommandQueue(my_queue);
   clReleaseContext(my_context);
+  profile.end();
+
+  std::cout << std::endl;
+  profile.print_phases(std::cout);
+  profile.print_commands(std::cout);
+  if (argc > 1)
+  {
+    profile.write_chrome_trace(argv[1]);
+    std::cout << "# Chrome trace written to " << argv[1] << std::endl;
+  }
 
   std::cout << std::endl;
   std::cout << "#" << std::endl;
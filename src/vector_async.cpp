@@ -0,0 +1,128 @@
+
+//
+// Tutorial for non-blocking vector addition and dot product: the host keeps working while the device computes
+//
+// Compare with vector_add.cpp and vector_dot.cpp, where clEnqueueReadBuffer(..., CL_TRUE, ...) blocks until the queue has drained.
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-async.hpp"
+#include "benchmark-utils.hpp"
+
+
+// Set from a thread of the OpenCL runtime, hence static: the callback may run as late as the release of the context
+static std::atomic<bool> add_callback_fired(false);
+
+
+// Some unrelated host work, done in small pieces between polls of the device
+double host_work_piece(std::vector<double> & data)
+{
+  double sum = 0;
+  for (std::size_t i=0; i<data.size(); ++i)
+  {
+    data[i] = std::sqrt(data[i] + 1.0);
+    sum += data[i];
+  }
+  return sum;
+}
+
+
+int main()
+{
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create a program and extract kernels ///////////////////////////////////
+  //
+  ocl::blas1_kernels kernels(ctx);
+  ocl::async_blas1   blas1(ctx, kernels);
+
+  //
+  /////////////////////////// Part 3: Create memory buffers ///////////////////////////////////
+  //
+  cl_uint vector_size = 16*1024*1024;
+  std::vector<ScalarType> x(vector_size, 1.0);
+  std::vector<ScalarType> y(vector_size, 2.0);
+
+  cl_mem ocl_x = ctx.create_buffer(vector_size * sizeof(ScalarType), &(x[0]));
+  cl_mem ocl_y = ctx.create_buffer(vector_size * sizeof(ScalarType), &(y[0]));
+
+  std::vector<double> host_data(64*1024, 1.0);
+  double host_result = 0;
+
+  //
+  /////////////////////////// Part 4: Run kernels without blocking ///////////////////////////////////
+  //
+  Timer timer;
+
+  // x += y, then dot(x, y). Both calls return immediately.
+  ocl::event_future add_done = blas1.add(ocl_x, ocl_y, vector_size);
+  ocl::dot_future   dot      = blas1.dot(ocl_x, ocl_y, vector_size);
+  double enqueue_time = timer.get();
+
+  // get notified by the OpenCL runtime once the addition is done:
+  add_done.then([]() { add_callback_fired = true; });
+
+  // poll the dot product while doing host work:
+  std::size_t host_pieces = 0;
+  while (!dot.ready())
+  {
+    host_result += host_work_piece(host_data);
+    ++host_pieces;
+  }
+  double device_time = timer.get();
+
+  //
+  /////////////////////////// Part 5: Get results ///////////////////////////////////
+  //
+  ScalarType dot_result = dot.get();   // ready, hence does not block
+
+  std::vector<ScalarType> x_result(vector_size);
+  ocl::event_future x_read = blas1.read(ocl_x, vector_size * sizeof(ScalarType), &(x_result[0]));
+  x_read.wait();
+
+  std::cout << std::endl;
+  std::cout << "Time to enqueue add and dot: " << enqueue_time * 1e6 << " us" << std::endl;
+  std::cout << "Time until dot was ready:    " << device_time * 1e3 << " ms" << std::endl;
+  std::cout << "Host work done meanwhile:    " << host_pieces << " pieces (checksum " << host_result << ")" << std::endl;
+  std::cout << "Callback after add fired:    " << (add_callback_fired ? "yes" : "not yet") << std::endl;
+  std::cout << std::endl;
+  std::cout << "x: " << x_result[0] << " " << x_result[1] << " " << x_result[2] << " ..." << std::endl;
+  std::cout << "Result of dot(x,y): " << dot_result << " (expected " << 6.0 * vector_size << ")" << std::endl;
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(ocl_x);
+  clReleaseMemObject(ocl_y);
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Asynchronous OpenCL application finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+
+//
+// Many small vector operations: one kernel launch per operation vs. recorded batches with fused element-wise kernels
+//
+// Each iteration computes x += y, z += y, w += x and x^T z on short vectors, where the launch overhead dominates.
+// Three variants are compared:
+//  - synchronous:  blas1_kernels, clFinish after every operation
+//  - queued:       blas1_kernels, one clFinish at the end
+//  - batched:      ocl::batch, the three additions become one generated kernel, unchanged kernel arguments are not set again
+//
+// Each variant runs once untimed first, so building the generated kernels is not part of the comparison. The times are
+// medians over the runs of the benchmark harness, excluding the reset of the vectors before each run.
+//
+// Usage: vector_batch [size] [iterations]
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-program-cache.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-batch.hpp"
+#include "benchmark-utils.hpp"
+
+
+int main(int argc, char **argv)
+{
+  cl_uint N          = (argc > 1) ? cl_uint(std::atof(argv[1])) : 4096;
+  cl_uint iterations = (argc > 2) ? cl_uint(std::atof(argv[2])) : 1000;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create the kernels and the batch ///////////////////////////////////
+  //
+  ocl::blas1_kernels kernels(ctx);
+  ocl::program_cache cache(ctx);
+  ocl::batch         batch(ctx, cache);
+
+  //
+  /////////////////////////// Part 3: Create memory buffers ///////////////////////////////////
+  //
+  std::vector<ScalarType> zeros(N, 0), ones(N, 1);
+  cl_mem x       = ctx.create_buffer(N * sizeof(ScalarType));
+  cl_mem y       = ctx.create_buffer(N * sizeof(ScalarType), &(ones[0]));
+  cl_mem z       = ctx.create_buffer(N * sizeof(ScalarType));
+  cl_mem w       = ctx.create_buffer(N * sizeof(ScalarType));
+  cl_mem results = ctx.create_buffer(iterations * sizeof(ScalarType));
+
+  // x = z = w = 0, hence x = z = k and w = k(k+1)/2 after iteration k, and x^T z = N k^2:
+  bool all_ok = true;
+  auto reset = [&]() {
+    cl_mem vectors[3] = { x, z, w };
+    for (int i=0; i<3; ++i)
+    {
+      cl_int status = clEnqueueWriteBuffer(ctx.queue(), vectors[i], CL_TRUE, 0, N * sizeof(ScalarType), &(zeros[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+    }
+  };
+  auto check = [&]() {
+    std::vector<ScalarType> host_x(N), host_w(N), host_results(iterations);
+    cl_int status;
+    status = clEnqueueReadBuffer(ctx.queue(), x, CL_TRUE, 0, N * sizeof(ScalarType), &(host_x[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+    status = clEnqueueReadBuffer(ctx.queue(), w, CL_TRUE, 0, N * sizeof(ScalarType), &(host_w[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+    status = clEnqueueReadBuffer(ctx.queue(), results, CL_TRUE, 0, iterations * sizeof(ScalarType), &(host_results[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+    double k = iterations;
+    for (cl_uint i=0; i<N; ++i)
+      all_ok &= (host_x[i] == ScalarType(k)) && (std::fabs(host_w[i] - k * (k + 1) / 2) <= 1e-6 * k * k);
+    for (cl_uint i=0; i<iterations; ++i)
+      all_ok &= (std::fabs(host_results[i] - double(N) * (i + 1) * (i + 1)) <= 1e-5 * double(N) * (i + 1) * (i + 1));
+  };
+
+  // runs 'variant' once untimed (builds the fused kernels, warms up the runtime), then returns the median time of
+  // further runs from the benchmark harness. The vectors are reset before each run, outside of the timed region.
+  auto run = [&](std::function<void()> variant) {
+    reset();
+    variant();
+    BenchmarkSettings settings;
+    std::vector<double> times;
+    benchmark([&]() {
+        reset();
+        Timer timer;
+        variant();
+        times.push_back(timer.get());
+      }, settings);
+    check();
+    times.erase(times.begin(), times.begin() + std::min(settings.warmup_runs, times.size() - 1));   // keep the timed runs only
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+  };
+
+  //
+  /////////////////////////// Part 4: Run the three variants ///////////////////////////////////
+  //
+  double time_sync = run([&]() {
+      cl_int status;
+      for (cl_uint i=0; i<iterations; ++i)
+      {
+        kernels.add(x, y, N);                  status = clFinish(ctx.queue()); OPENCL_ERR_CHECK(status);
+        kernels.add(z, y, N);                  status = clFinish(ctx.queue()); OPENCL_ERR_CHECK(status);
+        kernels.add(w, x, N);                  status = clFinish(ctx.queue()); OPENCL_ERR_CHECK(status);
+        kernels.dot(x, z, results, i, N);      status = clFinish(ctx.queue()); OPENCL_ERR_CHECK(status);
+      }
+    });
+
+  double time_queued = run([&]() {
+      for (cl_uint i=0; i<iterations; ++i)
+      {
+        kernels.add(x, y, N);
+        kernels.add(z, y, N);
+        kernels.add(w, x, N);
+        kernels.dot(x, z, results, i, N);
+      }
+      cl_int status = clFinish(ctx.queue()); OPENCL_ERR_CHECK(status);
+    });
+
+  std::size_t launches_before = batch.launches(), batch_runs = 0;
+  double time_batched = run([&]() {
+      for (cl_uint i=0; i<iterations; ++i)
+      {
+        batch.add(x, y, N);
+        batch.add(z, y, N);
+        batch.add(w, x, N);
+        batch.dot(x, z, results, i, N);
+      }
+      batch.finish();
+      ++batch_runs;
+    });
+  std::size_t batch_launches = (batch.launches() - launches_before) / batch_runs;
+
+  //
+  /////////////////////////// Part 5: Report ///////////////////////////////////
+  //
+  double ops = 4.0 * iterations;
+  std::cout << std::endl;
+  std::cout << "N = " << N << ", " << iterations << " iterations of three additions and one dot product:" << std::endl;
+  std::cout << "  synchronous: " << time_sync    / ops * 1e6 << " us per operation, " << 5 * iterations << " launches" << std::endl;
+  std::cout << "  queued:      " << time_queued  / ops * 1e6 << " us per operation, " << 5 * iterations << " launches" << std::endl;
+  std::cout << "  batched:     " << time_batched / ops * 1e6 << " us per operation, " << batch_launches << " launches, "
+            << batch.programs() << " generated kernel(s), " << batch.args_skipped() << " clSetKernelArg calls skipped" << std::endl;
+
+  //
+  // cleanup
+  //
+  clReleaseMemObject(x);
+  clReleaseMemObject(y);
+  clReleaseMemObject(z);
+  clReleaseMemObject(w);
+  clReleaseMemObject(results);
+
+  if (!all_ok)
+  {
+    std::cout << "# Results do NOT match the expected values!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Batched vector operations finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+
+//
+// Runs vec_add and vec_dot on vectors stored in binary files, which are memory-mapped instead of read into host vectors
+//
+// Usage:
+//   vector_file generate <file> <size> <value>            writes a vector file with header
+//   vector_file <x_file> <y_file> [out_file] [chunk_size]  computes x^T y and, if 'out_file' is given, out = x + y
+//
+// With chunk_size 0 (default) the mapped files are used as storage of the OpenCL buffers (CL_MEM_USE_HOST_PTR, zero copy
+// on CPUs and integrated GPUs). Otherwise the files are streamed through device buffers of 'chunk_size' entries,
+// so vectors larger than the device memory can be processed.
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-vector-file.hpp"
+#include "benchmark-utils.hpp"
+
+
+int generate(std::string const & filename, std::size_t vector_size, ScalarType value)
+{
+  ocl::vector_file file(filename, vector_size, sizeof(ScalarType));
+  ScalarType * data = static_cast<ScalarType *>(file.data());
+  std::fill(data, data + vector_size, value);
+  file.sync();
+  std::cout << "# Wrote " << vector_size << " entries to " << filename << std::endl;
+  return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char **argv)
+{
+  if (argc == 5 && std::string(argv[1]) == "generate")
+    return generate(argv[2], std::size_t(std::atof(argv[3])), ScalarType(std::atof(argv[4])));
+
+  if (argc < 3)
+  {
+    std::cout << "Usage: " << argv[0] << " generate <file> <size> <value>" << std::endl;
+    std::cout << "       " << argv[0] << " <x_file> <y_file> [out_file] [chunk_size]" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string out_filename = (argc > 3) ? argv[3] : "";
+  std::size_t chunk_size   = (argc > 4) ? std::size_t(std::atof(argv[4])) : 0;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create a program and extract kernels ///////////////////////////////////
+  //
+  ocl::blas1_kernels blas1(ctx);
+
+  //
+  /////////////////////////// Part 3: Map the files ///////////////////////////////////
+  //
+  ocl::vector_file x(argv[1]);
+  ocl::vector_file y(argv[2]);
+  if (x.element_size() != sizeof(ScalarType) || y.element_size() != sizeof(ScalarType))
+    throw std::runtime_error("Vector files must hold single precision entries");
+  if (x.size() != y.size() || x.size() == 0)
+    throw std::runtime_error("Vector files must be non-empty and of equal size");
+
+  std::size_t vector_size = x.size();
+  std::size_t num_bytes   = vector_size * sizeof(ScalarType);
+  std::cout << "# Vector size: " << vector_size << " (" << num_bytes / (1024.0 * 1024.0) << " MB per vector, "
+            << (x.has_header() ? "with header" : "raw") << ")" << std::endl;
+
+  std::unique_ptr<ocl::vector_file> out;
+  if (out_filename.size())
+    out.reset(new ocl::vector_file(out_filename, vector_size, sizeof(ScalarType)));
+
+  //
+  /////////////////////////// Part 4: Run kernels ///////////////////////////////////
+  //
+  cl_int err;
+  double dot_result = 0;
+  Timer timer;
+
+  if (chunk_size == 0)
+  {
+    // zero copy: the mapped pages are the storage of the buffers
+    if (vector_size > 0xFFFFFFFFul)
+      throw std::runtime_error("Vector too large for a single kernel launch, please pass a chunk size");
+
+    cl_uint N = cl_uint(vector_size);
+    cl_mem ocl_x      = x.create_buffer(ctx, CL_MEM_READ_ONLY);
+    cl_mem ocl_y      = y.create_buffer(ctx, CL_MEM_READ_ONLY);
+    cl_mem ocl_result = ctx.create_buffer(sizeof(ScalarType));
+
+    blas1.dot(ocl_x, ocl_y, ocl_result, 0, N);
+
+    if (out)
+    {
+      cl_mem ocl_out = out->create_buffer(ctx);
+      err = clEnqueueCopyBuffer(ctx.queue(), ocl_x, ocl_out, 0, 0, num_bytes, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+      blas1.add(ocl_out, ocl_y, N);
+
+      // mapping makes the host pages (i.e. the file) up to date:
+      void * ptr = clEnqueueMapBuffer(ctx.queue(), ocl_out, CL_TRUE, CL_MAP_READ, 0, num_bytes, 0, NULL, NULL, &err); OPENCL_ERR_CHECK(err);
+      err = clEnqueueUnmapMemObject(ctx.queue(), ocl_out, ptr, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+      clReleaseMemObject(ocl_out);
+    }
+
+    ScalarType result;
+    err = clEnqueueReadBuffer(ctx.queue(), ocl_result, CL_TRUE, 0, sizeof(ScalarType), &result, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+    dot_result = result;
+
+    clReleaseMemObject(ocl_x);
+    clReleaseMemObject(ocl_y);
+    clReleaseMemObject(ocl_result);
+  }
+  else
+  {
+    // streaming: chunks are written straight from the mapped pages. The in-order queue ensures that a chunk buffer is only overwritten after the previous chunk is done.
+    x.advise_sequential();
+    y.advise_sequential();
+
+    chunk_size = std::min(chunk_size, vector_size);
+    std::size_t num_chunks  = (vector_size + chunk_size - 1) / chunk_size;
+    std::size_t chunk_bytes = chunk_size * sizeof(ScalarType);
+    cl_mem ocl_x       = ctx.create_buffer(chunk_bytes);
+    cl_mem ocl_y       = ctx.create_buffer(chunk_bytes);
+    cl_mem ocl_results = ctx.create_buffer(num_chunks * sizeof(ScalarType));
+
+    for (std::size_t k=0; k<num_chunks; ++k)
+    {
+      std::size_t offset = k * chunk_bytes;
+      std::size_t bytes  = std::min(chunk_bytes, num_bytes - offset);
+      cl_uint N          = cl_uint(bytes / sizeof(ScalarType));
+
+      ocl::enqueue_chunk_write(ctx, x, offset, bytes, ocl_x);
+      ocl::enqueue_chunk_write(ctx, y, offset, bytes, ocl_y);
+      blas1.dot(ocl_x, ocl_y, ocl_results, cl_uint(k), N);
+      if (out)
+      {
+        blas1.add(ocl_x, ocl_y, N);
+        ocl::enqueue_chunk_read(ctx, ocl_x, *out, offset, bytes);
+      }
+      err = clFlush(ctx.queue()); OPENCL_ERR_CHECK(err);
+    }
+
+    std::vector<ScalarType> results(num_chunks);
+    err = clEnqueueReadBuffer(ctx.queue(), ocl_results, CL_TRUE, 0, num_chunks * sizeof(ScalarType), &(results[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+    for (std::size_t k=0; k<num_chunks; ++k)
+      dot_result += results[k];
+
+    clReleaseMemObject(ocl_x);
+    clReleaseMemObject(ocl_y);
+    clReleaseMemObject(ocl_results);
+  }
+
+  double time = timer.get();
+
+  //
+  /////////////////////////// Part 5: Report ///////////////////////////////////
+  //
+  if (out)
+  {
+    out->sync();
+    out.reset();
+  }
+
+  double bytes_processed = (out_filename.size() ? 3.0 : 2.0) * num_bytes;
+  std::cout << std::endl;
+  std::cout << "Mode:       " << (chunk_size ? "streaming" : "zero copy") << std::endl;
+  std::cout << "Result of dot(x,y): " << dot_result << std::endl;
+  if (out_filename.size())
+    std::cout << "x + y written to:   " << out_filename << std::endl;
+  std::cout << "Time: " << time * 1e3 << " ms (" << bytes_processed / time * 1e-9 << " GB/s of file data)" << std::endl;
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Vector file application finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+
+//
+// Benchmark for inclusive and exclusive prefix sums (scans) of OpenCL device vectors
+//
+// Compares the multi-level scan and the single-pass decoupled look-back scan from ocl-scan.hpp
+// with std::inclusive_scan on the host.
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-scan.hpp"
+#include "benchmark-utils.hpp"
+
+
+// Compares the device result with the reference. Entries are small integers, hence all partial sums are exact in single precision.
+bool check_result(std::vector<ScalarType> const & result, std::vector<ScalarType> const & reference)
+{
+  for (size_t i=0; i<reference.size(); ++i)
+    if (result[i] != reference[i])
+    {
+      std::cout << "Mismatch at index " << i << ": " << result[i] << " vs. " << reference[i] << std::endl;
+      return false;
+    }
+  return true;
+}
+
+
+int main()
+{
+  cl_int err;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create a program and extract kernels ///////////////////////////////////
+  //
+  ocl::scan_kernels scan(ctx);
+  std::cout << "# Single-pass decoupled look-back scan: " << (scan.single_pass_available() ? "available" : "not supported, using multi-level scan") << std::endl;
+
+  bool all_ok = true;
+
+  std::cout << std::endl;
+  std::cout << "#       N  host [GB/s]  multi-level incl. [GB/s]  multi-level excl. [GB/s]  single-pass incl. [GB/s]" << std::endl;
+
+  for (cl_uint vector_size = 1024; vector_size <= 4*1024*1024; vector_size *= 4)
+  {
+    //
+    /////////////////////////// Part 3: Create memory buffers ///////////////////////////////////
+    //
+    std::vector<ScalarType> x(vector_size);
+    for (size_t i=0; i<x.size(); ++i)
+      x[i] = ScalarType(i % 4);
+    std::vector<ScalarType> y(vector_size);
+    std::vector<ScalarType> reference(vector_size);
+
+    cl_mem ocl_x = ctx.create_buffer(vector_size * sizeof(ScalarType), &(x[0]));
+    cl_mem ocl_y = ctx.create_buffer(vector_size * sizeof(ScalarType));
+
+    double bytes = 2.0 * vector_size * sizeof(ScalarType);
+
+    //
+    /////////////////////////// Part 4: Run kernels ///////////////////////////////////
+    //
+
+    // host reference:
+    double time_host = benchmark([&]() { std::inclusive_scan(x.begin(), x.end(), reference.begin()); }).median;
+
+    // multi-level inclusive:
+    double time_inclusive = benchmark([&]() { scan.inclusive(ocl_x, ocl_y, vector_size); clFinish(ctx.queue()); }).median;
+
+    err = clEnqueueReadBuffer(ctx.queue(), ocl_y, CL_TRUE, 0, sizeof(ScalarType) * y.size(), &(y[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+    all_ok &= check_result(y, reference);
+
+    // multi-level exclusive:
+    double time_exclusive = benchmark([&]() { scan.exclusive(ocl_x, ocl_y, vector_size); clFinish(ctx.queue()); }).median;
+
+    err = clEnqueueReadBuffer(ctx.queue(), ocl_y, CL_TRUE, 0, sizeof(ScalarType) * y.size(), &(y[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+    std::vector<ScalarType> reference_exclusive(vector_size, 0);
+    std::exclusive_scan(x.begin(), x.end(), reference_exclusive.begin(), ScalarType(0));
+    all_ok &= check_result(y, reference_exclusive);
+
+    // single-pass inclusive:
+    double time_single_pass = benchmark([&]() { scan.inclusive_single_pass(ocl_x, ocl_y, vector_size); clFinish(ctx.queue()); }).median;
+
+    err = clEnqueueReadBuffer(ctx.queue(), ocl_y, CL_TRUE, 0, sizeof(ScalarType) * y.size(), &(y[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+    all_ok &= check_result(y, reference);
+
+    //
+    /////////////////////////// Part 5: Report ///////////////////////////////////
+    //
+    std::cout << vector_size
+              << "  " << bytes / time_host * 1e-9
+              << "  " << bytes / time_inclusive * 1e-9
+              << "  " << bytes / time_exclusive * 1e-9
+              << "  " << bytes / time_single_pass * 1e-9 << std::endl;
+
+    clReleaseMemObject(ocl_x);
+    clReleaseMemObject(ocl_y);
+  }
+
+  if (!all_ok)
+  {
+    std::cout << "# Scan results do NOT match the host reference!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Scan benchmark finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+
+//
+// vec_add and vec_dot issued concurrently from several host threads into one command queue
+//
+// Each thread repeats x += y and x^T y on its own vectors. Three ways to share the kernels are compared:
+//  - locked:     one blas1_kernels object for all threads, each call under a mutex
+//  - per call:   clCreateKernel, clSetKernelArg and clReleaseKernel on every call, no lock needed
+//  - per thread: concurrent_blas1, one cl_kernel per thread and kernel name, unchanged arguments are not set again
+//
+// Usage: vector_threads [threads] [size] [iterations]
+//
+
+typedef float       ScalarType;
+
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+// Helper include files taken from ViennaCL for error checking and timing
+#include "ocl-error.hpp"
+#include "ocl-context.hpp"
+#include "ocl-blas1.hpp"
+#include "ocl-kernel-cache.hpp"
+#include "benchmark-utils.hpp"
+
+
+struct thread_data
+{
+  cl_mem x;
+  cl_mem y;
+  cl_mem partials;   // only used by the 'per call' variant
+  cl_mem results;    // one dot product per iteration
+};
+
+
+// x += y and results[i] = x^T y with a kernel created for this call only
+void add_dot_per_call(ocl::context const & ctx, cl_program prog, thread_data const & d, cl_uint i, cl_uint N)
+{
+  cl_int err;
+  size_t global_size = ocl::blas1_global_size, local_size = ocl::blas1_local_size;
+
+  cl_kernel k = clCreateKernel(prog, "vec_add", &err); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&d.x); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&d.y); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 2, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+  err = clEnqueueNDRangeKernel(ctx.queue(), k, 1, NULL, &global_size, &local_size, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  clReleaseKernel(k);
+
+  k = clCreateKernel(prog, "vec_dot", &err); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&d.x); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 1, sizeof(cl_mem),  (void*)&d.y); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&d.partials); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 3, sizeof(cl_uint), (void*)&N); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 4, sizeof(float) * local_size, NULL); OPENCL_ERR_CHECK(err);
+  err = clEnqueueNDRangeKernel(ctx.queue(), k, 1, NULL, &global_size, &local_size, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  clReleaseKernel(k);
+
+  cl_uint num_partials = ocl::blas1_kernels::num_partials();
+  k = clCreateKernel(prog, "vec_sum", &err); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 0, sizeof(cl_mem),  (void*)&d.partials); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 1, sizeof(cl_uint), (void*)&num_partials); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 2, sizeof(cl_mem),  (void*)&d.results); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 3, sizeof(cl_uint), (void*)&i); OPENCL_ERR_CHECK(err);
+  err = clSetKernelArg(k, 4, sizeof(float) * local_size, NULL); OPENCL_ERR_CHECK(err);
+  err = clEnqueueNDRangeKernel(ctx.queue(), k, 1, NULL, &local_size, &local_size, 0, NULL, NULL); OPENCL_ERR_CHECK(err);
+  clReleaseKernel(k);
+}
+
+
+int main(int argc, char **argv)
+{
+  std::size_t num_threads = (argc > 1) ? std::size_t(std::atoi(argv[1])) : std::min<std::size_t>(std::max<std::size_t>(std::thread::hardware_concurrency(), 2), 8);
+  cl_uint     N           = (argc > 2) ? cl_uint(std::atof(argv[2])) : 64*1024;
+  cl_uint     iterations  = (argc > 3) ? cl_uint(std::atof(argv[3])) : 500;
+
+  //
+  /////////////////////////// Part 1: Set up an OpenCL context with one device ///////////////////////////////////
+  //
+  ocl::context ctx;
+  std::cout << "# Device: " << ctx.device_name() << std::endl;
+
+  //
+  /////////////////////////// Part 2: Create the programs and kernels ///////////////////////////////////
+  //
+  ocl::blas1_kernels     shared_kernels(ctx);
+  ocl::concurrent_blas1  concurrent(ctx);
+  cl_program prog = ctx.build_program(ocl::blas1_program_source);
+
+  //
+  /////////////////////////// Part 3: Create memory buffers, one set per thread ///////////////////////////////////
+  //
+  std::vector<ScalarType> zeros(N, 0), ones(N, 1);
+  std::vector<thread_data> data(num_threads);
+  for (std::size_t t=0; t<num_threads; ++t)
+  {
+    data[t].x        = ctx.create_buffer(N * sizeof(ScalarType));
+    data[t].y        = ctx.create_buffer(N * sizeof(ScalarType), &(ones[0]));
+    data[t].partials = ctx.create_buffer(ocl::blas1_kernels::num_partials() * sizeof(ScalarType));
+    data[t].results  = ctx.create_buffer(iterations * sizeof(ScalarType));
+  }
+
+  // x = 0 and y = 1, hence x^T y = N k after iteration k:
+  bool all_ok = true;
+  auto reset = [&]() {
+    for (std::size_t t=0; t<num_threads; ++t)
+    {
+      cl_int status = clEnqueueWriteBuffer(ctx.queue(), data[t].x, CL_TRUE, 0, N * sizeof(ScalarType), &(zeros[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+    }
+  };
+  auto check = [&]() {
+    std::vector<ScalarType> results(iterations);
+    for (std::size_t t=0; t<num_threads; ++t)
+    {
+      cl_int status = clEnqueueReadBuffer(ctx.queue(), data[t].results, CL_TRUE, 0, iterations * sizeof(ScalarType), &(results[0]), 0, NULL, NULL); OPENCL_ERR_CHECK(status);
+      for (cl_uint i=0; i<iterations; ++i)
+        all_ok &= (std::fabs(results[i] - double(N) * (i + 1)) <= 1e-5 * double(N) * (i + 1));
+    }
+  };
+
+  // runs 'work(thread index)' on all threads and returns the time until the queue has drained:
+  Timer timer;
+  auto run = [&](std::function<void(std::size_t)> work) {
+    reset();
+    timer.start();
+    std::vector<std::thread> threads;
+    for (std::size_t t=0; t<num_threads; ++t)
+      threads.push_back(std::thread(work, t));
+    for (std::size_t t=0; t<num_threads; ++t)
+      threads[t].join();
+    cl_int status = clFinish(ctx.queue()); OPENCL_ERR_CHECK(status);
+    double time = timer.get();
+    check();
+    return time;
+  };
+
+  //
+  /////////////////////////// Part 4: Run the three variants ///////////////////////////////////
+  //
+  std::mutex kernels_mutex;
+  double time_locked = run([&](std::size_t t) {
+      for (cl_uint i=0; i<iterations; ++i)
+      {
+        std::lock_guard<std::mutex> lock(kernels_mutex);
+        shared_kernels.add(data[t].x, data[t].y, N);
+        shared_kernels.dot(data[t].x, data[t].y, data[t].results, i, N);
+      }
+    });
+
+  double time_per_call = run([&](std::size_t t) {
+      for (cl_uint i=0; i<iterations; ++i)
+        add_dot_per_call(ctx, prog, data[t], i, N);
+    });
+
+  double time_per_thread = run([&](std::size_t t) {
+      for (cl_uint i=0; i<iterations; ++i)
+      {
+        concurrent.add(data[t].x, data[t].y, N);
+        concurrent.dot(data[t].x, data[t].y, data[t].results, i, N);
+      }
+    });
+
+  //
+  /////////////////////////// Part 5: Report ///////////////////////////////////
+  //
+  double calls = 2.0 * iterations * num_threads;
+  std::cout << std::endl;
+  std::cout << num_threads << " threads, N = " << N << ", " << iterations << " x (vec_add + vec_dot) each:" << std::endl;
+  std::cout << "  locked:     " << time_locked     / calls * 1e6 << " us per call" << std::endl;
+  std::cout << "  per call:   " << time_per_call   / calls * 1e6 << " us per call" << std::endl;
+  std::cout << "  per thread: " << time_per_thread / calls * 1e6 << " us per call ("
+            << concurrent.kernels().threads() << " threads with own kernels)" << std::endl;
+
+  //
+  // cleanup
+  //
+  for (std::size_t t=0; t<num_threads; ++t)
+  {
+    clReleaseMemObject(data[t].x);
+    clReleaseMemObject(data[t].y);
+    clReleaseMemObject(data[t].partials);
+    clReleaseMemObject(data[t].results);
+  }
+  clReleaseProgram(prog);
+
+  if (!all_ok)
+  {
+    std::cout << "# Results do NOT match the expected values!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << std::endl;
+  std::cout << "#" << std::endl;
+  std::cout << "# Concurrent vector operations finished successfully!" << std::endl;
+  std::cout << "#" << std::endl;
+  return EXIT_SUCCESS;
+}